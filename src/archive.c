@@ -0,0 +1,484 @@
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <limits.h>
+#include <sys/stat.h>
+#include <zlib.h>
+
+#include "error.h"
+#include "archive.h"
+
+/*
+ * Members are streamed straight out of the (decompressed) archive into the
+ * member callback, nothing is extracted to disk.
+ */
+
+static boolean has_suffix(const char *str, const char *suffix) {
+  int len = strlen(str), suffix_len = strlen(suffix);
+
+  return len > suffix_len && !strcmp(str + len - suffix_len, suffix);
+}
+
+int archive_type(const char *filename) {
+  if (has_suffix(filename, ".tar") || has_suffix(filename, ".tar.gz") || has_suffix(filename, ".tgz")) {
+    return ARCHIVE_TAR;
+  }
+
+  if (has_suffix(filename, ".zip")) {
+    return ARCHIVE_ZIP;
+  }
+
+  return ARCHIVE_NONE;
+}
+
+/*
+ * build "archive!member", dropping a leading "./" of member, -1 when
+ * member_len is negative or the name does not fit in PATH_MAX
+ */
+static int member_name(char *buf, const char *filename, const char *member, int member_len) {
+  int len = strlen(filename);
+
+  if (member_len < 0 || member_len >= PATH_MAX || len + 1 + member_len >= PATH_MAX) {
+    return -1;
+  }
+
+  if (member_len > 2 && member[0] == '.' && member[1] == '/') {
+    member += 2;
+    member_len -= 2;
+  }
+
+  memcpy(buf, filename, len);
+  buf[len] = ARCHIVE_MEMBER_SEP;
+  memcpy(buf + len + 1, member, member_len);
+  buf[len + 1 + member_len] = '\0';
+
+  return 0;
+}
+
+/*
+ * tar, read through zlib's gz stream so plain and gzip compressed archives
+ * share one code path
+ */
+
+struct tar_member {
+  gzFile gz;
+  unsigned long long left;
+};
+
+static ssize_t tar_member_read(void *stream, char *buf, size_t size) {
+  struct tar_member *member = (struct tar_member *) stream;
+  int bytes_read;
+
+  if (!member->left) {
+    return 0;
+  }
+
+  if (size > member->left) {
+    size = member->left;
+  }
+
+  if ((bytes_read = gzread(member->gz, buf, size)) <= 0) {
+    return -1;
+  }
+
+  member->left -= bytes_read;
+
+  return bytes_read;
+}
+
+static unsigned long long tar_number(const char *field, int len) {
+  unsigned long long n = 0;
+  int i;
+
+  if (field[0] & 0x80) {        /* GNU base-256 encoding for big sizes */
+    n = field[0] & 0x3f;
+    for (i = 1; i < len; i++) {
+      n = (n << 8) | (unsigned char) field[i];
+    }
+    return n;
+  }
+
+  for (i = 0; i < len && field[i] == ' '; i++);
+  for (; i < len && field[i] >= '0' && field[i] <= '7'; i++) {
+    n = (n << 3) + field[i] - '0';
+  }
+
+  return n;
+}
+
+static void tar_skip(gzFile gz, unsigned long long len, const char *filename) {
+  if (len && gzseek(gz, len, SEEK_CUR) == -1) {
+    error(EXIT_FAILURE, "Truncated tar archive: %s", filename);
+  }
+}
+
+/* read a GNU long name or pax header payload, keep the path in name */
+static int tar_read_ext_name(gzFile gz, unsigned long long size, char type, char *name, const char *filename) {
+  char *buf, *p, *end;
+  int name_len = -1;
+
+  if (size > 1024 * 1024) {
+    error(EXIT_FAILURE, "Too big tar extended header: %s", filename);
+  }
+
+  if (!(buf = malloc(size + 1))) {
+    error(EXIT_FAILURE, "Cannot alloc tar extended header");
+  }
+
+  if (gzread(gz, buf, size) != (int) size) {
+    error(EXIT_FAILURE, "Truncated tar archive: %s", filename);
+  }
+  buf[size] = '\0';
+
+  if (type == 'L') {
+    name_len = strnlen(buf, size);
+  } else {
+    /* pax records: "<len> <key>=<value>\n" */
+    for (p = buf, end = buf + size; p < end; ) {
+      char *key;
+      long len = strtol(p, &key, 10);
+
+      if (len <= 0 || p + len > end || *key != ' ') {
+        break;
+      }
+
+      key++;
+      if (!strncmp(key, "path=", 5)) {
+        name_len = p + len - (key + 5) - 1;
+        memmove(buf, key + 5, name_len);
+        break;
+      }
+
+      p += len;
+    }
+  }
+
+  if (name_len >= PATH_MAX) {
+    name_len = PATH_MAX - 1;
+  }
+
+  if (name_len >= 0) {
+    memcpy(name, buf, name_len);
+    name[name_len] = '\0';
+  }
+
+  free(buf);
+
+  return name_len;
+}
+
+static void scan_tar(const char *filename, archive_member_func func, void *arg) {
+  gzFile gz;
+  char block[TAR_BLOCK_SIZE];
+  char ext_name[PATH_MAX], name[PATH_MAX];
+  int ext_name_len = -1, bytes_read;
+  struct tar_member member;
+
+  if (!(gz = gzopen(filename, "rb"))) {
+    error(EXIT_FAILURE, "Cannot open archive: %s", filename);
+  }
+
+  gzbuffer(gz, ARCHIVE_BUFFER_SIZE);
+  member.gz = gz;
+
+  while ((bytes_read = gzread(gz, block, TAR_BLOCK_SIZE))) {
+    unsigned long long size, padding;
+    char type;
+    int len;
+
+    if (bytes_read != TAR_BLOCK_SIZE) {
+      error(EXIT_FAILURE, "Truncated tar archive: %s", filename);
+    }
+
+    if (block[0] == '\0') {     /* end of archive */
+      break;
+    }
+
+    size = tar_number(block + 124, 12);
+    padding = (TAR_BLOCK_SIZE - size % TAR_BLOCK_SIZE) % TAR_BLOCK_SIZE;
+    type = block[156];
+
+    switch (type) {
+    case 'L':
+    case 'x':
+      ext_name_len = tar_read_ext_name(gz, size, type, ext_name, filename);
+      tar_skip(gz, padding, filename);
+      continue;
+    case '0':
+    case '\0':
+    case '7':
+      if (ext_name_len >= 0) {
+        len = member_name(name, filename, ext_name, ext_name_len);
+      } else {
+        char path[TAR_BLOCK_SIZE];
+
+        len = 0;
+
+        if (!strncmp(block + 257, "ustar", 5) && block[345]) {
+          len = strnlen(block + 345, 155);
+          memcpy(path, block + 345, len);
+          path[len++] = '/';
+        }
+        memcpy(path + len, block, strnlen(block, 100));
+        len += strnlen(block, 100);
+
+        len = member_name(name, filename, path, len);
+      }
+
+      if (len == -1) {
+        fprintf(stderr, "Too long member name, skip count file: %s\n", filename);
+        tar_skip(gz, size + padding, filename);
+        break;
+      }
+
+      member.left = size;
+      func(name, tar_member_read, &member, arg);
+
+      tar_skip(gz, member.left + padding, filename);
+      break;
+    default:                    /* directories, links, devices... */
+      tar_skip(gz, size + padding, filename);
+      break;
+    }
+
+    ext_name_len = -1;
+  }
+
+  gzclose(gz);
+}
+
+/*
+ * zip, members are visited in local header order after reading the central
+ * directory once, so the archive is still read front to back
+ */
+
+#define ZIP_EOCD_SIG 0x06054b50
+#define ZIP_CDH_SIG 0x02014b50
+#define ZIP_LFH_SIG 0x04034b50
+
+#define ZIP_EOCD_SIZE 22
+#define ZIP_CDH_SIZE 46
+#define ZIP_LFH_SIZE 30
+#define ZIP_MAX_COMMENT 0xffff
+
+enum {
+  ZIP_STORED = 0,
+  ZIP_DEFLATED = 8,
+};
+
+struct zip_entry {
+  unsigned long offset;
+  unsigned long comp_size;
+  unsigned long size;
+  int method;
+  int name_len;
+  const char *name;
+};
+
+struct zip_member {
+  int fd;
+  int method;
+  unsigned long comp_left;
+  unsigned long left;
+  z_stream zs;
+  unsigned char *in;
+};
+
+#define zip_u16(p) ((unsigned) (p)[0] | (unsigned) (p)[1] << 8)
+#define zip_u32(p) (zip_u16(p) | (unsigned long) zip_u16((p) + 2) << 16)
+
+static ssize_t zip_member_read(void *stream, char *buf, size_t size) {
+  struct zip_member *member = (struct zip_member *) stream;
+  ssize_t bytes_read;
+  int ret;
+
+  if (!member->left) {
+    return 0;
+  }
+
+  if (size > member->left) {
+    size = member->left;
+  }
+
+  if (member->method == ZIP_STORED) {
+    if ((bytes_read = read(member->fd, buf, size)) <= 0) {
+      return -1;
+    }
+
+    member->left -= bytes_read;
+
+    return bytes_read;
+  }
+
+  member->zs.next_out = (unsigned char *) buf;
+  member->zs.avail_out = size;
+  do {
+    if (!member->zs.avail_in) {
+      size_t len = member->comp_left < ARCHIVE_BUFFER_SIZE ? member->comp_left : ARCHIVE_BUFFER_SIZE;
+
+      if (!len || (bytes_read = read(member->fd, member->in, len)) <= 0) {
+        return -1;
+      }
+
+      member->comp_left -= bytes_read;
+      member->zs.next_in = member->in;
+      member->zs.avail_in = bytes_read;
+    }
+
+    ret = inflate(&member->zs, Z_NO_FLUSH);
+    if (ret == Z_STREAM_END) {
+      break;
+    } else if (ret != Z_OK) {
+      return -1;
+    }
+  } while (member->zs.avail_out == size);
+
+  bytes_read = size - member->zs.avail_out;
+  member->left = ret == Z_STREAM_END ? 0 : member->left - bytes_read;
+
+  return bytes_read;
+}
+
+static int zip_entry_cmp(const void *a, const void *b) {
+  unsigned long x = ((const struct zip_entry *) a)->offset, y = ((const struct zip_entry *) b)->offset;
+
+  return x < y ? -1 : x > y;
+}
+
+static void zip_read_at(int fd, off_t offset, unsigned char *buf, size_t len, const char *filename) {
+  if (lseek(fd, offset, SEEK_SET) == -1 || read(fd, buf, len) != (ssize_t) len) {
+    error(EXIT_FAILURE, "Corrupted zip archive: %s", filename);
+  }
+}
+
+static void scan_zip(const char *filename, archive_member_func func, void *arg) {
+  int fd, i, count;
+  struct stat sb;
+  unsigned char *tail, *cd, *p;
+  unsigned long cd_size, cd_offset;
+  size_t tail_len;
+  struct zip_entry *entries;
+  struct zip_member member;
+  char name[PATH_MAX];
+
+  if ((fd = open(filename, O_RDONLY | O_CLOEXEC)) == -1 || fstat(fd, &sb) == -1) {
+    error(EXIT_FAILURE, "Cannot open archive: %s", filename);
+  }
+
+  /* end of central directory record is within the last 64 KiB + 22 bytes */
+  tail_len = sb.st_size < ZIP_EOCD_SIZE + ZIP_MAX_COMMENT ? sb.st_size : ZIP_EOCD_SIZE + ZIP_MAX_COMMENT;
+  if (tail_len < ZIP_EOCD_SIZE || !(tail = malloc(tail_len))) {
+    error(EXIT_FAILURE, "Corrupted zip archive: %s", filename);
+  }
+
+  zip_read_at(fd, sb.st_size - tail_len, tail, tail_len, filename);
+
+  for (p = tail + tail_len - ZIP_EOCD_SIZE; p >= tail && zip_u32(p) != ZIP_EOCD_SIG; p--);
+  if (p < tail) {
+    error(EXIT_FAILURE, "Corrupted zip archive: %s", filename);
+  }
+
+  count = zip_u16(p + 10);
+  cd_size = zip_u32(p + 12);
+  cd_offset = zip_u32(p + 16);
+  free(tail);
+
+  if (cd_offset == 0xffffffff || cd_offset + cd_size > (unsigned long) sb.st_size) {
+    error(EXIT_FAILURE, "Unsupported zip64 archive: %s", filename);
+  }
+
+  if (!(cd = malloc(cd_size)) || !(entries = malloc(sizeof(struct zip_entry) * (count ? count : 1)))) {
+    error(EXIT_FAILURE, "Cannot alloc zip central directory");
+  }
+
+  zip_read_at(fd, cd_offset, cd, cd_size, filename);
+
+  for (i = 0, p = cd; i < count; i++) {
+    /* the variable fields must be within the central directory as well */
+    if ((size_t) (cd + cd_size - p) < ZIP_CDH_SIZE || zip_u32(p) != ZIP_CDH_SIG
+        || (size_t) (cd + cd_size - p) < (size_t) ZIP_CDH_SIZE + zip_u16(p + 28) + zip_u16(p + 30) + zip_u16(p + 32)) {
+      error(EXIT_FAILURE, "Corrupted zip archive: %s", filename);
+    }
+
+    entries[i].method = zip_u16(p + 10);
+    entries[i].comp_size = zip_u32(p + 20);
+    entries[i].size = zip_u32(p + 24);
+    entries[i].name_len = zip_u16(p + 28);
+    entries[i].offset = zip_u32(p + 42);
+    entries[i].name = (const char *) p + ZIP_CDH_SIZE;
+
+    p += ZIP_CDH_SIZE + entries[i].name_len + zip_u16(p + 30) + zip_u16(p + 32);
+  }
+
+  qsort(entries, count, sizeof(struct zip_entry), zip_entry_cmp);
+
+  if (!(member.in = malloc(ARCHIVE_BUFFER_SIZE))) {
+    error(EXIT_FAILURE, "Cannot alloc zip input buffer");
+  }
+  member.fd = fd;
+
+  for (i = 0; i < count; i++) {
+    struct zip_entry *entry = &entries[i];
+    unsigned char lfh[ZIP_LFH_SIZE];
+
+    if (entry->name_len && entry->name[entry->name_len - 1] == '/') { /* directory */
+      continue;
+    }
+
+    if (member_name(name, filename, entry->name, entry->name_len) == -1) {
+      fprintf(stderr, "Too long member name, skip count file: %s\n", filename);
+      continue;
+    }
+
+    if (entry->size == 0xffffffff || entry->comp_size == 0xffffffff) {
+      fprintf(stderr, "Unsupported zip64 member, skip count file: %s\n", name);
+      continue;
+    }
+
+    if (entry->method != ZIP_STORED && entry->method != ZIP_DEFLATED) {
+      fprintf(stderr, "Unsupported zip compression method %d, skip count file: %s\n", entry->method, name);
+      continue;
+    }
+
+    zip_read_at(fd, entry->offset, lfh, ZIP_LFH_SIZE, filename);
+    if (zip_u32(lfh) != ZIP_LFH_SIG
+        || lseek(fd, entry->offset + ZIP_LFH_SIZE + zip_u16(lfh + 26) + zip_u16(lfh + 28), SEEK_SET) == -1) {
+      error(EXIT_FAILURE, "Corrupted zip archive: %s", filename);
+    }
+
+    member.method = entry->method;
+    member.comp_left = entry->comp_size;
+    member.left = entry->size;
+
+    if (member.method == ZIP_DEFLATED) {
+      memset(&member.zs, 0, sizeof(z_stream));
+      if (inflateInit2(&member.zs, -MAX_WBITS) != Z_OK) {
+        error(EXIT_FAILURE, "Cannot init inflate stream");
+      }
+    }
+
+    func(name, zip_member_read, &member, arg);
+
+    if (member.method == ZIP_DEFLATED) {
+      inflateEnd(&member.zs);
+    }
+  }
+
+  free(member.in);
+  free(entries);
+  free(cd);
+  close(fd);
+}
+
+void archive_scan(const char *filename, int type, archive_member_func func, void *arg) {
+  switch (type) {
+  case ARCHIVE_TAR:
+    scan_tar(filename, func, arg);
+    break;
+  case ARCHIVE_ZIP:
+    scan_zip(filename, func, arg);
+    break;
+  }
+}
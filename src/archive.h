@@ -0,0 +1,26 @@
+#ifndef __HCC_ARCHIVE_H
+#define __HCC_ARCHIVE_H
+
+#include "hcc.h"
+
+#define ARCHIVE_MEMBER_SEP '!'
+
+#define TAR_BLOCK_SIZE 512
+#define ARCHIVE_BUFFER_SIZE (128 * 1024)
+
+enum {
+  ARCHIVE_NONE,
+  ARCHIVE_TAR,                  /* plain or gzip compressed tar */
+  ARCHIVE_ZIP,
+};
+
+/*
+ * Called once per regular member, name is "archive!member". The member data
+ * can be pulled with reader until it returns 0, unread data is skipped.
+ */
+typedef void (*archive_member_func) (const char *name, stream_reader reader, void *stream, void *arg);
+
+int archive_type(const char *filename);
+void archive_scan(const char *filename, int type, archive_member_func func, void *arg);
+
+#endif
@@ -0,0 +1,199 @@
+#define _GNU_SOURCE             /* required by strdup & st_mtim */
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#include "error.h"
+#include "blob_cache.h"
+
+static boolean blob_cache_lookup(const char *filename, const char *lang, const struct stat *sb, struct line_counter *counter, void *arg);
+static void blob_cache_store(const char *filename, const char *lang, const struct stat *sb, const struct line_counter *counter, void *arg);
+
+void blob_cache_init(struct blob_cache *cache, const struct hcc_context *ctx, const char *dir) {
+  char sub[PATH_MAX];
+  int i;
+
+  memset(cache, 0, sizeof(struct blob_cache));
+  cache->ctx = ctx;
+  cache->hook.lookup = blob_cache_lookup;
+  cache->hook.store = blob_cache_store;
+  cache->hook.arg = cache;
+
+  if (!(cache->dir = malloc(strlen(dir) + 18))) {
+    error(EXIT_FAILURE, "Cannot alloc blob cache");
+  }
+  sprintf(cache->dir, "%s/%016llx", dir, hcc_defs_fingerprint(ctx));
+
+  if ((mkdir(dir, 0777) && errno != EEXIST) || (mkdir(cache->dir, 0777) && errno != EEXIST)) {
+    error(EXIT_FAILURE, "Cannot create blob cache: %s", cache->dir);
+  }
+
+  /* every fan-out directory up front, stores are then a file each */
+  for (i = 0; i < 1 << (4 * BLOB_CACHE_FANOUT); i++) {
+    snprintf(sub, PATH_MAX, "%s/%0*x", cache->dir, BLOB_CACHE_FANOUT, i);
+    if (mkdir(sub, 0777) && errno != EEXIST) {
+      error(EXIT_FAILURE, "Cannot create blob cache: %s", sub);
+    }
+  }
+}
+
+void blob_cache_add_root(struct blob_cache *cache, const char *path) {
+  struct blob_root *root;
+  struct stat sb;
+  char abs[PATH_MAX], *gitdir, *top, *rel;
+  int i, len;
+
+  if (!(gitdir = git_find_work_tree(path, &top)) || !realpath(path, abs) || stat(abs, &sb)) {
+    free(gitdir);
+    return;
+  }
+
+  for (i = 0; i < cache->ntrees && strcmp(cache->trees[i].top, top); i++);
+
+  if (i == cache->ntrees) {
+    if (!(cache->trees = realloc(cache->trees, (cache->ntrees + 1) * sizeof(struct blob_tree)))) {
+      error(EXIT_FAILURE, "Cannot alloc blob cache");
+    }
+    cache->trees[i].top = top;
+    /* no index, nothing to look up, but the tree is known */
+    git_read_index(gitdir, &cache->trees[i].index);
+    cache->ntrees++;
+  } else {
+    free(top);
+  }
+  free(gitdir);
+
+  if (!(cache->roots = realloc(cache->roots, (cache->nroots + 1) * sizeof(struct blob_root)))) {
+    error(EXIT_FAILURE, "Cannot alloc blob cache");
+  }
+  root = &cache->roots[cache->nroots++];
+  root->tree = i;
+
+  /* the walk drops trailing slashes, the root "/" is reported as "" */
+  len = strlen(path);
+  while (len > 1 && path[len - 1] == '/') {
+    len--;
+  }
+  root->arg_len = len == 1 && path[0] == '/' ? 0 : len;
+
+  len = strlen(cache->trees[i].top);
+  rel = abs + (strcmp(cache->trees[i].top, "/") ? len : 0);
+  rel += *rel == '/';
+
+  if (!(root->arg = strndup(path, root->arg_len)) || !(root->prefix = malloc(strlen(rel) + 2))) {
+    error(EXIT_FAILURE, "Cannot alloc blob cache");
+  }
+  sprintf(root->prefix, "%s%s", rel, *rel && S_ISDIR(sb.st_mode) ? "/" : "");
+}
+
+void blob_cache_free(struct blob_cache *cache) {
+  int i;
+
+  for (i = 0; i < cache->ntrees; i++) {
+    free(cache->trees[i].top);
+    git_index_free(&cache->trees[i].index);
+  }
+  for (i = 0; i < cache->nroots; i++) {
+    free(cache->roots[i].arg);
+    free(cache->roots[i].prefix);
+  }
+  free(cache->trees);
+  free(cache->roots);
+  free(cache->dir);
+}
+
+/* the cache file of filename in buf, FALSE when filename has no blob id to trust */
+static boolean cache_filename(struct blob_cache *cache, const char *filename, const char *lang, const struct stat *sb, char *buf) {
+  const struct git_index_entry *entry;
+  const struct blob_root *root;
+  char path[PATH_MAX], hex[GIT_HEX_SIZE + 1];
+  const char *rest;
+  int i;
+
+  for (i = 0; i < cache->nroots; i++) {
+    root = &cache->roots[i];
+    if (!strncmp(filename, root->arg, root->arg_len) && (filename[root->arg_len] == '/' || !filename[root->arg_len])) {
+      break;
+    }
+  }
+
+  if (i == cache->nroots || (lang && strchr(lang, '/'))) {
+    return FALSE;
+  }
+
+  rest = filename + root->arg_len;
+  rest += *rest == '/';
+  if (snprintf(path, PATH_MAX, "%s%s", root->prefix, rest) >= PATH_MAX
+      || !(entry = git_index_lookup(&cache->trees[root->tree].index, path, sb))) {
+    return FALSE;
+  }
+
+  git_oid_hex(entry->oid, hex);
+
+  return snprintf(buf, PATH_MAX, "%s/%.*s/%s.%s", cache->dir, BLOB_CACHE_FANOUT, hex, hex + BLOB_CACHE_FANOUT,
+                  lang ? lang : "-") < PATH_MAX;
+}
+
+static boolean blob_cache_lookup(const char *filename, const char *lang, const struct stat *sb, struct line_counter *counter, void *arg) {
+  struct blob_cache *cache = (struct blob_cache *) arg;
+  struct line_counter saved;
+  char buf[PATH_MAX], line[BLOB_CACHE_LINE_SIZE], name[MAX_LANG_SIZE + 1];
+  ssize_t len;
+  int fd;
+
+  if (!cache_filename(cache, filename, lang, sb, buf) || (fd = open(buf, O_RDONLY | O_CLOEXEC)) == -1) {
+    return FALSE;
+  }
+
+  len = read(fd, line, sizeof(line) - 1);
+  close(fd);
+  if (len <= 0) {
+    return FALSE;
+  }
+  line[len] = '\0';
+
+  /* a torn or foreign file is only a miss */
+  memset(&saved, 0, sizeof(struct line_counter));
+  if (sscanf(line, "%10s %d %d %d %lld %d %d %d %lld", name, &saved.code_lines, &saved.comment_lines, &saved.blank_lines,
+             &saved.metrics.bytes, &saved.metrics.max_line_len, &saved.metrics.trailing_space_lines,
+             &saved.metrics.tab_indent_lines, &saved.metrics.line_len_sum) != 9 || !(saved.lang = (char *) hcc_find_lang(cache->ctx, name))) {
+    return FALSE;
+  }
+
+  *counter = saved;
+
+  return TRUE;
+}
+
+static void blob_cache_store(const char *filename, const char *lang, const struct stat *sb, const struct line_counter *counter, void *arg) {
+  struct blob_cache *cache = (struct blob_cache *) arg;
+  char buf[PATH_MAX], tmp[PATH_MAX + 64], line[BLOB_CACHE_LINE_SIZE];
+  int fd, len;
+  boolean written;
+
+  if (!cache_filename(cache, filename, lang, sb, buf)) {
+    return;
+  }
+
+  snprintf(tmp, sizeof(tmp), "%s.%d.%lx.tmp", buf, (int) getpid(), (unsigned long) pthread_self());
+  if ((fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666)) == -1) {
+    return;
+  }
+
+  len = snprintf(line, sizeof(line), "%s %d %d %d %lld %d %d %d %lld\n", counter->lang, counter->code_lines, counter->comment_lines,
+                 counter->blank_lines, counter->metrics.bytes, counter->metrics.max_line_len,
+                 counter->metrics.trailing_space_lines, counter->metrics.tab_indent_lines, counter->metrics.line_len_sum);
+
+  /* a cache that cannot be written is only slower */
+  written = write(fd, line, len) == len;
+  if (close(fd) || !written || rename(tmp, buf)) {
+    unlink(tmp);
+  }
+}
@@ -0,0 +1,47 @@
+#ifndef __HCC_BLOB_CACHE_H
+#define __HCC_BLOB_CACHE_H
+
+#include "hcc.h"
+#include "git.h"
+#include "libhcc.h"
+
+#define BLOB_CACHE_FANOUT 2     /* hex digits of the blob id naming the subdirectory */
+#define BLOB_CACHE_LINE_SIZE 160 /* a counted file, language and nine numbers */
+
+/* a work tree and its index, read once for all the arguments in it */
+struct blob_tree {
+  char *top;
+  struct git_index index;
+};
+
+/* an argument, the path of its files from the top of the work tree is prefix and the rest */
+struct blob_root {
+  char *arg;                    /* as the walk reports it, without trailing slashes */
+  int arg_len;
+  char *prefix;                 /* "", "dir/" or the path of a file argument */
+  int tree;
+};
+
+/*
+ * Counts shared by every checkout of a repository, keyed by the blob id
+ * the git index holds for a file whose stat data still matches, so no
+ * content is hashed. Results live in dir/FINGERPRINT/xx/ID.LANG, one small
+ * file each written by rename, so any number of runs may share dir.
+ */
+struct blob_cache {
+  struct hcc_cache hook;
+  const struct hcc_context *ctx;
+  char *dir;                    /* dir/FINGERPRINT */
+  struct blob_tree *trees;
+  int ntrees;
+  struct blob_root *roots;
+  int nroots;
+};
+
+/* the definitions of ctx must be loaded, they are part of the key */
+void blob_cache_init(struct blob_cache *cache, const struct hcc_context *ctx, const char *dir);
+/* files of path are cached when it is in a git work tree, before counting starts */
+void blob_cache_add_root(struct blob_cache *cache, const char *path);
+void blob_cache_free(struct blob_cache *cache);
+
+#endif
@@ -0,0 +1,347 @@
+#define _POSIX_C_SOURCE 200809L /* required by fsync & strdup */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include "error.h"
+#include "trace.h"
+#include "checkpoint.h"
+
+void checkpoint_init(struct checkpoint *ck, const char *filename, long long interval) {
+  memset(ck, 0, sizeof(struct checkpoint));
+  pthread_mutex_init(&ck->lock, NULL);
+  ck->filename = filename;
+  ck->interval = interval;
+  ck->next = trace_now() + interval;
+}
+
+static int compare_path(const void *a, const void *b) {
+  return strcmp(*(char **) a, *(char **) b);
+}
+
+static struct line_counter *checkpoint_lang(struct checkpoint *ck, const char *lang) {
+  int i;
+
+  for (i = 0; i < ck->nlangs; i++) {
+    if (!strcmp(ck->langs[i].lang, lang)) {
+      return &ck->langs[i];
+    }
+  }
+
+  if (ck->nlangs == ck->size) {
+    ck->size = ck->size ? ck->size << 1 : INIT_CHECKPOINT_LIST_SIZE;
+    if (!(ck->langs = realloc(ck->langs, ck->size * sizeof(struct line_counter)))) {
+      error(EXIT_FAILURE, "Cannot alloc checkpoint languages");
+    }
+  }
+
+  memset(&ck->langs[ck->nlangs], 0, sizeof(struct line_counter));
+  if (!(ck->langs[ck->nlangs].lang = strdup(lang))) {
+    error(EXIT_FAILURE, "Cannot alloc checkpoint languages");
+  }
+
+  return &ck->langs[ck->nlangs++];
+}
+
+static char *read_checkpoint_file(FILE *in, size_t *len) {
+  char *buf = NULL;
+  size_t size = 0, n;
+
+  *len = 0;
+  do {
+    if (*len + 1 >= size) {
+      size = size ? size << 1 : 64 * 1024;
+      if (!(buf = realloc(buf, size))) {
+        error(EXIT_FAILURE, "Cannot alloc checkpoint buffer");
+      }
+    }
+
+    n = fread(buf + *len, 1, size - *len - 1, in);
+    *len += n;
+  } while (n);
+
+  if (ferror(in)) {
+    error(EXIT_FAILURE, "Cannot read checkpoint");
+  }
+
+  buf[*len] = '\0';
+
+  return buf;
+}
+
+boolean checkpoint_load(struct checkpoint *ck) {
+  struct line_counter *counter, saved;
+  char lang[PATTERN_MAX], *buf, *p, *end;
+  size_t len, size = 0;
+  FILE *in;
+
+  if (!(in = fopen(ck->filename, "r"))) {
+    if (errno == ENOENT) {
+      return FALSE;
+    }
+    error(EXIT_FAILURE, "Cannot open checkpoint: %s", ck->filename);
+  }
+
+  buf = read_checkpoint_file(in, &len);
+  fclose(in);
+
+  if (strncmp(buf, CHECKPOINT_MAGIC "\n", sizeof(CHECKPOINT_MAGIC))) {
+    error(EXIT_FAILURE, "Not a checkpoint: %s", ck->filename);
+  }
+
+  /* records are NUL terminated, a language line or a path done */
+  end = buf + len;
+  for (p = buf + sizeof(CHECKPOINT_MAGIC); p < end; p += strlen(p) + 1) {
+    if (*p == 'L') {
+      memset(&saved, 0, sizeof(struct line_counter));
+      if (sscanf(p + 1, "%127[^\t]\t%d\t%d\t%d\t%lld\t%d\t%d\t%d\t%lld", lang, &saved.code_lines, &saved.comment_lines,
+                 &saved.blank_lines, &saved.metrics.bytes, &saved.metrics.max_line_len, &saved.metrics.trailing_space_lines,
+                 &saved.metrics.tab_indent_lines, &saved.metrics.line_len_sum) != 9) {
+        error(EXIT_FAILURE, "Corrupt checkpoint: %s", ck->filename);
+      }
+
+      counter = checkpoint_lang(ck, lang);
+      saved.lang = counter->lang;
+      *counter = saved;
+    } else if (*p == 'D') {
+      if (ck->nresumed == size) {
+        size = size ? size << 1 : INIT_CHECKPOINT_LIST_SIZE;
+        if (!(ck->resumed = realloc(ck->resumed, size * sizeof(char *)))) {
+          error(EXIT_FAILURE, "Cannot alloc checkpoint paths");
+        }
+      }
+      if (!(ck->resumed[ck->nresumed++] = strdup(p + 1))) {
+        error(EXIT_FAILURE, "Cannot alloc checkpoint paths");
+      }
+    } else {
+      error(EXIT_FAILURE, "Corrupt checkpoint: %s", ck->filename);
+    }
+  }
+
+  free(buf);
+  qsort(ck->resumed, ck->nresumed, sizeof(char *), compare_path);
+
+  if (ck->nresumed && !(ck->taken = calloc(ck->nresumed, sizeof(boolean)))) {
+    error(EXIT_FAILURE, "Cannot alloc checkpoint paths");
+  }
+
+  return TRUE;
+}
+
+/* name of path in node, the full path for the arguments */
+static void node_done(struct checkpoint *ck, struct ckpt_node *node, const char *path) {
+  const char *name = node == &ck->top ? path : path + node->path_len + 1;
+
+  if (node->ndone == node->size) {
+    node->size = node->size ? node->size << 1 : INIT_CHECKPOINT_LIST_SIZE;
+    if (!(node->done = realloc(node->done, node->size * sizeof(char *)))) {
+      error(EXIT_FAILURE, "Cannot alloc checkpoint frontier");
+    }
+  }
+
+  if (!(node->done[node->ndone++] = strdup(name))) {
+    error(EXIT_FAILURE, "Cannot alloc checkpoint frontier");
+  }
+}
+
+/* a finished directory folds into a name of its parent */
+static void node_release(struct checkpoint *ck, struct ckpt_node *node) {
+  struct ckpt_node *parent;
+  int i;
+
+  while (node != &ck->top && !--node->pending) {
+    parent = node->parent;
+    node_done(ck, parent, node->path);
+
+    for (i = 0; i < node->ndone; i++) {
+      free(node->done[i]);
+    }
+    free(node->done);
+    free(node->path);
+
+    if (node->prev) {
+      node->prev->next = node->next;
+    } else {
+      ck->nodes = node->next;
+    }
+    if (node->next) {
+      node->next->prev = node->prev;
+    }
+    free(node);
+
+    node = parent;
+  }
+}
+
+boolean checkpoint_skip(struct checkpoint *ck, struct ckpt_node *node, const char *path) {
+  char **resumed;
+
+  if (!ck->nresumed || !(resumed = bsearch(&path, ck->resumed, ck->nresumed, sizeof(char *), compare_path))) {
+    return FALSE;
+  }
+
+  pthread_mutex_lock(&ck->lock);
+  ck->taken[resumed - ck->resumed] = TRUE;
+  node_done(ck, node ? node : &ck->top, path);
+  pthread_mutex_unlock(&ck->lock);
+
+  return TRUE;
+}
+
+int checkpoint_dir_enter(struct walk_dir *dir, const char *path, void *arg) {
+  struct checkpoint *ck = (struct checkpoint *) arg;
+  struct ckpt_node *parent = dir->parent ? (struct ckpt_node *) dir->parent->data : &ck->top;
+  struct ckpt_node *node;
+
+  if (checkpoint_skip(ck, parent, path)) {
+    return 1;
+  }
+
+  if (!(node = calloc(1, sizeof(struct ckpt_node))) || !(node->path = strdup(path))) {
+    error(EXIT_FAILURE, "Cannot alloc checkpoint frontier");
+  }
+
+  node->path_len = strcmp(path, "/") ? strlen(path) : 0;
+  node->pending = 1;
+  node->parent = parent;
+
+  pthread_mutex_lock(&ck->lock);
+  if (parent != &ck->top) {
+    parent->pending++;
+  }
+  node->next = ck->nodes;
+  if (ck->nodes) {
+    ck->nodes->prev = node;
+  }
+  ck->nodes = node;
+  pthread_mutex_unlock(&ck->lock);
+
+  dir->data = node;
+  checkpoint_tick(ck);
+
+  return 0;
+}
+
+void checkpoint_dir_leave(struct walk_dir *dir, void *arg) {
+  checkpoint_release((struct checkpoint *) arg, (struct ckpt_node *) dir->data);
+}
+
+void checkpoint_expect(struct checkpoint *ck, struct ckpt_node *node) {
+  if (node) {
+    pthread_mutex_lock(&ck->lock);
+    node->pending++;
+    pthread_mutex_unlock(&ck->lock);
+  }
+}
+
+void checkpoint_file(struct checkpoint *ck, struct ckpt_node *node, const char *path, const struct line_counter *counter) {
+  struct line_counter *lang_counter;
+
+  pthread_mutex_lock(&ck->lock);
+
+  if (counter) {
+    lang_counter = checkpoint_lang(ck, counter->lang);
+    lang_counter->code_lines += counter->code_lines;
+    lang_counter->comment_lines += counter->comment_lines;
+    lang_counter->blank_lines += counter->blank_lines;
+    lang_counter->metrics.bytes += counter->metrics.bytes;
+    lang_counter->metrics.line_len_sum += counter->metrics.line_len_sum;
+    lang_counter->metrics.trailing_space_lines += counter->metrics.trailing_space_lines;
+    lang_counter->metrics.tab_indent_lines += counter->metrics.tab_indent_lines;
+    if (counter->metrics.max_line_len > lang_counter->metrics.max_line_len) {
+      lang_counter->metrics.max_line_len = counter->metrics.max_line_len;
+    }
+  }
+
+  if (path) {
+    node_done(ck, node ? node : &ck->top, path);
+  }
+
+  pthread_mutex_unlock(&ck->lock);
+}
+
+void checkpoint_release(struct checkpoint *ck, struct ckpt_node *node) {
+  if (node) {
+    pthread_mutex_lock(&ck->lock);
+    node_release(ck, node);
+    pthread_mutex_unlock(&ck->lock);
+  }
+}
+
+static void write_done(struct checkpoint *ck, const struct ckpt_node *node, FILE *out) {
+  int i;
+
+  for (i = 0; i < node->ndone; i++) {
+    fputc('D', out);
+    if (node != &ck->top) {
+      fwrite(node->path, 1, node->path_len, out);
+      fputc('/', out);
+    }
+    fputs(node->done[i], out);
+    fputc('\0', out);
+  }
+}
+
+void checkpoint_write(struct checkpoint *ck) {
+  char tmp[PATH_MAX];
+  const struct ckpt_node *node;
+  FILE *out;
+  size_t j;
+  int i;
+
+  snprintf(tmp, PATH_MAX, "%s.tmp", ck->filename);
+  if (!(out = fopen(tmp, "w"))) {
+    error(EXIT_FAILURE, "Cannot write checkpoint: %s", tmp);
+  }
+
+  pthread_mutex_lock(&ck->lock);
+
+  fputs(CHECKPOINT_MAGIC "\n", out);
+  for (i = 0; i < ck->nlangs; i++) {
+    fprintf(out, "L%s\t%d\t%d\t%d\t%lld\t%d\t%d\t%d\t%lld", ck->langs[i].lang, ck->langs[i].code_lines, ck->langs[i].comment_lines,
+            ck->langs[i].blank_lines, ck->langs[i].metrics.bytes, ck->langs[i].metrics.max_line_len,
+            ck->langs[i].metrics.trailing_space_lines, ck->langs[i].metrics.tab_indent_lines, ck->langs[i].metrics.line_len_sum);
+    fputc('\0', out);
+  }
+
+  write_done(ck, &ck->top, out);
+  for (node = ck->nodes; node; node = node->next) {
+    write_done(ck, node, out);
+  }
+
+  /* a stopped walk may not have come back to all the paths resumed */
+  for (j = 0; j < ck->nresumed; j++) {
+    if (!ck->taken[j]) {
+      fprintf(out, "D%s", ck->resumed[j]);
+      fputc('\0', out);
+    }
+  }
+
+  /* the data is with the kernel, workers need not wait for the disk */
+  i = fflush(out);
+  pthread_mutex_unlock(&ck->lock);
+
+  /* the old checkpoint stays until the new one is complete on disk */
+  if (i || fsync(fileno(out)) || fclose(out) || rename(tmp, ck->filename)) {
+    error(EXIT_FAILURE, "Cannot write checkpoint: %s", tmp);
+  }
+}
+
+void checkpoint_tick(struct checkpoint *ck) {
+  long long now = trace_now();
+
+  if (now >= ck->next) {
+    checkpoint_write(ck);
+    ck->next = now + ck->interval;
+  }
+}
+
+void checkpoint_remove(struct checkpoint *ck) {
+  if (unlink(ck->filename) && errno != ENOENT) {
+    error(EXIT_FAILURE, "Cannot remove checkpoint: %s", ck->filename);
+  }
+}
@@ -0,0 +1,75 @@
+#ifndef __HCC_CHECKPOINT_H
+#define __HCC_CHECKPOINT_H
+
+#include <pthread.h>
+#include <sys/types.h>
+
+#include "hcc.h"
+#include "walk.h"
+
+#define CHECKPOINT_MAGIC "hcc checkpoint 2"
+#define DEFAULT_CHECKPOINT_INTERVAL 60
+#define INIT_CHECKPOINT_LIST_SIZE 16
+
+/*
+ * A directory of the walk frontier: walked, or with files still queued.
+ * Its finished entries are kept by name until the whole directory is done,
+ * then it becomes one name of its parent.
+ */
+struct ckpt_node {
+  char *path;
+  int path_len;                 /* 0 for "/" */
+  int pending;                  /* the walk itself and queued files */
+  char **done;
+  int ndone;
+  int size;
+  struct ckpt_node *parent;
+  struct ckpt_node *prev;
+  struct ckpt_node *next;
+};
+
+/*
+ * Resumable state of a run: the per language totals of the files done and
+ * the frontier that tells them apart from the rest. Written atomically
+ * every interval, so a run killed at any point loses at most one interval.
+ * Safe to share between threads, writes only come from the walking one.
+ */
+struct checkpoint {
+  pthread_mutex_t lock;
+  const char *filename;
+  long long interval;           /* nanoseconds */
+  long long next;
+
+  struct ckpt_node top;         /* the arguments done, by full path */
+  struct ckpt_node *nodes;      /* the frontier */
+
+  struct line_counter *langs;
+  int nlangs;
+  int size;
+
+  char **resumed;               /* sorted paths done by the run resumed */
+  boolean *taken;               /* met again by this walk, in a node now */
+  size_t nresumed;
+};
+
+void checkpoint_init(struct checkpoint *ck, const char *filename, long long interval);
+/* restore the state of filename, FALSE when there is none */
+boolean checkpoint_load(struct checkpoint *ck);
+/* a path done by the resumed run, it is taken over as done */
+boolean checkpoint_skip(struct checkpoint *ck, struct ckpt_node *node, const char *path);
+/* walk hooks, the node of a directory is kept in walk_dir.data */
+int checkpoint_dir_enter(struct walk_dir *dir, const char *path, void *arg);
+void checkpoint_dir_leave(struct walk_dir *dir, void *arg);
+/* a file queued to be done later in node, NULL for an argument */
+void checkpoint_expect(struct checkpoint *ck, struct ckpt_node *node);
+/* path is done, counter is NULL when it had nothing to count */
+void checkpoint_file(struct checkpoint *ck, struct ckpt_node *node, const char *path, const struct line_counter *counter);
+/* a queued file is over */
+void checkpoint_release(struct checkpoint *ck, struct ckpt_node *node);
+/* write when the interval is over */
+void checkpoint_tick(struct checkpoint *ck);
+void checkpoint_write(struct checkpoint *ck);
+/* the run is complete, the checkpoint is not needed anymore */
+void checkpoint_remove(struct checkpoint *ck);
+
+#endif
@@ -0,0 +1,30 @@
+static const char *comment_defs_string = 
+  "[C]\n"
+  "pattern = *.h\n"
+  "pattern = *.c\n"
+  "modeline = c\n"
+  "comment = //\n"
+  "comment = /* */\n"
+  "[C++]\n"
+  "pattern = *.cpp\n"
+  "modeline = cpp\n"
+  "modeline = c++\n"
+  "comment = //\n"
+  "comment = /* */\n"
+  "[Shell]\n"
+  "pattern = *.sh\n"
+  "interpreter = sh\n"
+  "interpreter = bash\n"
+  "interpreter = dash\n"
+  "interpreter = ksh\n"
+  "interpreter = zsh\n"
+  "modeline = sh\n"
+  "modeline = shell-script\n"
+  "comment = #\n"
+  "[PHP]\n"
+  "pattern = *.php\n"
+  "interpreter = php*\n"
+  "modeline = php\n"
+  "comment = //\n"
+  "comment = /* */\n"
+  "comment = #\n";
@@ -3,6 +3,6 @@
 
 #define ERR_BUF_SIZE 100
 
-void error(int status, const char *format, ...);
+void error(int status, const char *format, ...) __attribute__((noreturn));
 
 #endif
@@ -0,0 +1,358 @@
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <math.h>
+#include <fcntl.h>
+
+#include "error.h"
+#include "estimate.h"
+
+/* fixed seed, the same tree gives the same estimate */
+#define ESTIMATE_SEED 0x9E3779B97F4A7C15ULL
+
+void init_estimate(struct estimate *est, const struct hcc_context *ctx, double error) {
+  memset(est, 0, sizeof(struct estimate));
+  est->ctx = ctx;
+  est->error = error;
+  est->rand_state = ESTIMATE_SEED;
+  est->nlangs = 1;
+}
+
+/* xorshift64*, uniform in [0, n) */
+static size_t estimate_rand(struct estimate *est, size_t n) {
+  unsigned long long x = est->rand_state;
+
+  x ^= x >> 12;
+  x ^= x << 25;
+  x ^= x >> 27;
+  est->rand_state = x;
+
+  return (x * 0x2545F4914F6CDD1DULL) % n;
+}
+
+static int estimate_bucket(off_t size) {
+  int bucket = 0;
+
+  while (size > 0 && bucket < ESTIMATE_SIZE_BUCKETS - 1) {
+    size >>= 1;
+    bucket++;
+  }
+
+  return bucket;
+}
+
+static struct estimate_stratum *estimate_stratum(struct estimate *est, const char *lang, off_t size) {
+  int i = 0;
+
+  if (lang) {
+    for (i = 1; i < est->nlangs && strcmp(est->langs[i], lang); i++);
+
+    if (i == est->nlangs) {
+      if (i == ESTIMATE_MAX_LANGS) {
+        error(EXIT_FAILURE, "Too many languages to estimate");
+      }
+      est->langs[est->nlangs++] = lang;
+    }
+  }
+
+  if (!est->strata[i] && !(est->strata[i] = calloc(ESTIMATE_SIZE_BUCKETS, sizeof(struct estimate_stratum)))) {
+    error(EXIT_FAILURE, "Cannot alloc estimate strata");
+  }
+
+  return &est->strata[i][estimate_bucket(size)];
+}
+
+static void estimate_add(struct estimate *est, struct path_node *path, const char *filename, off_t size) {
+  struct estimate_stratum *stratum;
+  const char *lang;
+
+  if (hcc_match_file(est->ctx, filename, &lang) != HCC_OK) {
+    return;
+  }
+
+  stratum = estimate_stratum(est, lang, size);
+
+  if (stratum->nfiles == stratum->size) {
+    stratum->size = stratum->size ? stratum->size << 1 : 16;
+    if (!(stratum->files = realloc(stratum->files, stratum->size * sizeof(struct estimate_file)))) {
+      error(EXIT_FAILURE, "Cannot alloc estimate files");
+    }
+  }
+
+  if (!path) {
+    error(EXIT_FAILURE, "Cannot alloc path node");
+  }
+
+  stratum->files[stratum->nfiles].path = path;
+  stratum->files[stratum->nfiles].size = size;
+  stratum->nfiles++;
+  stratum->bytes += size;
+
+  est->files++;
+  est->bytes += size;
+}
+
+static int estimate_add_entry(const struct walk_entry *entry, void *arg) {
+  struct estimate *est = (struct estimate *) arg;
+
+  estimate_add(est, path_node_new(walk_entry_dir_node(entry), entry->name, strlen(entry->name)), entry->path, entry->size);
+
+  return 0;
+}
+
+int estimate_add_tree(struct estimate *est, const char *root) {
+  return walk_tree(root, &est->ctx->walk_opts, estimate_add_entry, est);
+}
+
+void estimate_add_file(struct estimate *est, const char *filename, off_t size) {
+  estimate_add(est, path_node_new(NULL, filename, strlen(filename)), filename, size);
+}
+
+static struct estimate_acc *estimate_acc(struct estimate_stratum *stratum, const char *lang) {
+  struct estimate_acc *acc;
+
+  for (acc = stratum->accs; acc; acc = acc->next) {
+    if (!strcmp(acc->lang, lang)) {
+      return acc;
+    }
+  }
+
+  if (!(acc = calloc(1, sizeof(struct estimate_acc)))) {
+    error(EXIT_FAILURE, "Cannot alloc estimate accumulator");
+  }
+
+  acc->lang = lang;
+  acc->next = stratum->accs;
+  stratum->accs = acc;
+
+  return acc;
+}
+
+static void estimate_acc_add(struct estimate_acc *acc, const struct line_counter *counter) {
+  double value[ESTIMATE_METRICS];
+  int k;
+
+  value[ESTIMATE_CODE] = counter->code_lines;
+  value[ESTIMATE_COMMENT] = counter->comment_lines;
+  value[ESTIMATE_BLANK] = counter->blank_lines;
+
+  for (k = 0; k < ESTIMATE_METRICS; k++) {
+    acc->sum[k] += value[k];
+    acc->sumsq[k] += value[k] * value[k];
+  }
+}
+
+/* draw the next file of the stratum at random and count it */
+static void estimate_sample(struct estimate *est, struct estimate_stratum *stratum) {
+  struct estimate_file tmp;
+  struct line_counter counter;
+  char pathname[PATH_MAX];
+  size_t j;
+  int status;
+
+  j = stratum->sampled + estimate_rand(est, stratum->nfiles - stratum->sampled);
+  tmp = stratum->files[j];
+  stratum->files[j] = stratum->files[stratum->sampled];
+  stratum->files[stratum->sampled++] = tmp;
+
+  path_node_format(tmp.path, pathname, PATH_MAX);
+  status = hcc_count_file_rb(est->ctx, &est->rb, AT_FDCWD, pathname, tmp.size, pathname, &counter);
+
+  est->sampled++;
+  est->sampled_bytes += tmp.size;
+
+  /* a file with no language found counts as zero lines */
+  if (status == HCC_SKIPPED) {
+    return;
+  } else if (status != HCC_OK) {
+    error(EXIT_FAILURE, "%s: %s", hcc_strerror(status), pathname);
+  }
+
+  if (counter.code_lines) {
+    est->sampled_code += counter.code_lines;
+    est->sampled_code_bytes += tmp.size;
+  }
+  estimate_acc_add(estimate_acc(stratum, counter.lang), &counter);
+  estimate_acc_add(&stratum->total, &counter);
+}
+
+/* sample variance from sums over n draws */
+static double estimate_var(double sum, double sumsq, size_t n) {
+  double var;
+
+  if (n < 2) {
+    return 0;
+  }
+
+  var = (sumsq - sum * sum / n) / (n - 1);
+
+  return var > 0 ? var : 0;
+}
+
+/* contribution of a stratum to the variance of an extrapolated total */
+static double estimate_total_var(const struct estimate_stratum *stratum, double sum, double sumsq) {
+  double n = stratum->sampled, N = stratum->nfiles;
+
+  if (!stratum->sampled || stratum->sampled == stratum->nfiles) {
+    return 0;
+  }
+
+  return N * N * (1 - n / N) * estimate_var(sum, sumsq, stratum->sampled) / n;
+}
+
+/*
+ * Standard deviation of code lines driving the allocation. A stratum whose
+ * draws all came out the same may still hide a few big files, so one more
+ * draw at the code lines per byte of the source files sampled is assumed.
+ */
+static double estimate_alloc_sd(const struct estimate *est, const struct estimate_stratum *stratum) {
+  double x = 0, sum = stratum->total.sum[ESTIMATE_CODE], sumsq = stratum->total.sumsq[ESTIMATE_CODE];
+
+  if (stratum->sampled == stratum->nfiles) {
+    return 0;
+  }
+
+  if (est->sampled_code_bytes) {
+    x = (double) est->sampled_code / est->sampled_code_bytes * stratum->bytes / stratum->nfiles;
+  }
+
+  return sqrt(estimate_var(sum + x, sumsq + x * x, stratum->sampled + 1));
+}
+
+#define for_each_stratum(est, i, b, stratum)                            \
+  for (i = 0; i < (est)->nlangs; i++)                                   \
+    for (b = 0; (est)->strata[i] && b < ESTIMATE_SIZE_BUCKETS; b++)     \
+      if ((stratum = &(est)->strata[i][b])->nfiles)
+
+/*
+ * Neyman allocation of the sample needed for the code lines total to reach
+ * the error bound. Return FALSE when no stratum needs more files.
+ */
+static boolean estimate_allocate(struct estimate *est) {
+  struct estimate_stratum *stratum;
+  double total = 0, var = 0, weight = 0, weight_var = 0, bound, n;
+  boolean more = FALSE;
+  int i, b;
+
+  for_each_stratum(est, i, b, stratum) {
+    double sd = estimate_alloc_sd(est, stratum), n = stratum->sampled, N = stratum->nfiles;
+
+    total += N * stratum->total.sum[ESTIMATE_CODE] / n;
+    var += N * N * (1 - n / N) * sd * sd / n;
+    weight += stratum->nfiles * sd;
+    weight_var += stratum->nfiles * sd * sd;
+  }
+
+  bound = est->error * total / ESTIMATE_Z;
+  if (var <= bound * bound || weight == 0) {
+    return FALSE;
+  }
+
+  n = weight * weight / (bound * bound + weight_var);
+
+  /*
+   * Strata sampled past their share by the pilot leave the others short of
+   * the bound, grow the sample until some stratum gets more files.
+   */
+  do {
+    boolean full = TRUE;
+
+    for_each_stratum(est, i, b, stratum) {
+      double sd = estimate_alloc_sd(est, stratum);
+      size_t want = ceil(n * stratum->nfiles * sd / weight);
+
+      if (want > stratum->nfiles) {
+        want = stratum->nfiles;
+      }
+
+      while (stratum->sampled < want) {
+        estimate_sample(est, stratum);
+        more = TRUE;
+      }
+
+      if (sd > 0 && stratum->sampled < stratum->nfiles) {
+        full = FALSE;
+      }
+    }
+
+    if (full) {
+      break;
+    }
+    n *= 2;
+  } while (!more);
+
+  return more;
+}
+
+static void estimate_result_add(struct estimate_lang *result, const struct estimate_stratum *stratum, const struct estimate_acc *acc) {
+  int k;
+
+  for (k = 0; k < ESTIMATE_METRICS; k++) {
+    result->value[k] += stratum->nfiles * acc->sum[k] / stratum->sampled;
+    result->ci[k] += estimate_total_var(stratum, acc->sum[k], acc->sumsq[k]);
+  }
+}
+
+static struct estimate_lang *estimate_result(struct estimate *est, const char *lang) {
+  int i;
+
+  for (i = 0; i < est->nresults; i++) {
+    if (!strcmp(est->results[i].lang, lang)) {
+      return &est->results[i];
+    }
+  }
+
+  if (!(est->results = realloc(est->results, (est->nresults + 1) * sizeof(struct estimate_lang)))) {
+    error(EXIT_FAILURE, "Cannot alloc estimate results");
+  }
+
+  memset(&est->results[est->nresults], 0, sizeof(struct estimate_lang));
+  est->results[est->nresults].lang = lang;
+
+  return &est->results[est->nresults++];
+}
+
+void estimate_run(struct estimate *est) {
+  struct estimate_stratum *stratum;
+  struct estimate_acc *acc;
+  int i, b, k, round;
+
+  init_read_buffers(&est->rb, &est->ctx->read_opts);
+
+  /* a pilot sample from every stratum, small ones are counted in full */
+  for_each_stratum(est, i, b, stratum) {
+    while (stratum->sampled < stratum->nfiles && stratum->sampled < ESTIMATE_PILOT_SIZE) {
+      estimate_sample(est, stratum);
+    }
+  }
+
+  for (round = 0; round < ESTIMATE_MAX_ROUNDS && estimate_allocate(est); round++);
+
+  free_read_buffers(&est->rb);
+
+  /* variances are summed over strata, intervals are taken at the end */
+  for_each_stratum(est, i, b, stratum) {
+    for (acc = stratum->accs; acc; acc = acc->next) {
+      estimate_result_add(estimate_result(est, acc->lang), stratum, acc);
+    }
+    estimate_result_add(&est->total, stratum, &stratum->total);
+  }
+
+  for (k = 0; k < ESTIMATE_METRICS; k++) {
+    for (i = 0; i < est->nresults; i++) {
+      est->results[i].ci[k] = ESTIMATE_Z * sqrt(est->results[i].ci[k]);
+    }
+    est->total.ci[k] = ESTIMATE_Z * sqrt(est->total.ci[k]);
+  }
+}
+
+void estimate_add_exact(struct estimate *est, const struct line_counter *counter) {
+  struct estimate_lang *result = estimate_result(est, counter->lang);
+
+  result->value[ESTIMATE_CODE] += counter->code_lines;
+  result->value[ESTIMATE_COMMENT] += counter->comment_lines;
+  result->value[ESTIMATE_BLANK] += counter->blank_lines;
+  est->total.value[ESTIMATE_CODE] += counter->code_lines;
+  est->total.value[ESTIMATE_COMMENT] += counter->comment_lines;
+  est->total.value[ESTIMATE_BLANK] += counter->blank_lines;
+}
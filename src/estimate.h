@@ -0,0 +1,88 @@
+#ifndef __HCC_ESTIMATE_H
+#define __HCC_ESTIMATE_H
+
+#include "libhcc.h"
+
+#define ESTIMATE_SIZE_BUCKETS 64
+#define ESTIMATE_PILOT_SIZE 10
+#define ESTIMATE_MAX_ROUNDS 16
+#define ESTIMATE_Z 1.96         /* 95% confidence */
+#define ESTIMATE_MAX_LANGS 256
+
+enum {
+  ESTIMATE_CODE,
+  ESTIMATE_COMMENT,
+  ESTIMATE_BLANK,
+  ESTIMATE_METRICS,
+};
+
+struct estimate_file {
+  struct path_node *path;
+  off_t size;
+};
+
+/* sums over the sampled files of one stratum for one language */
+struct estimate_acc {
+  const char *lang;
+  double sum[ESTIMATE_METRICS];
+  double sumsq[ESTIMATE_METRICS];
+  struct estimate_acc *next;
+};
+
+/*
+ * Files of one pattern language and one power of 2 size bucket. The files
+ * before sampled are counted, the rest are still to draw from.
+ */
+struct estimate_stratum {
+  struct estimate_file *files;
+  size_t nfiles;
+  size_t size;
+  size_t sampled;
+  long long bytes;
+  struct estimate_acc total;    /* all languages, drives the allocation */
+  struct estimate_acc *accs;
+};
+
+struct estimate_lang {
+  const char *lang;
+  double value[ESTIMATE_METRICS];
+  double ci[ESTIMATE_METRICS];  /* half width of the confidence interval */
+};
+
+/*
+ * Stratified sampling by language and file size, totals are extrapolated
+ * until the code lines total is within error of itself at 95% confidence.
+ */
+struct estimate {
+  const struct hcc_context *ctx;
+  double error;
+  unsigned long long rand_state;
+  struct read_buffers rb;       /* of the samples, while they are counted */
+
+  /* index 0 is for files whose language is only known from the content */
+  const char *langs[ESTIMATE_MAX_LANGS];
+  int nlangs;
+  struct estimate_stratum *strata[ESTIMATE_MAX_LANGS];
+
+  size_t files;
+  size_t sampled;
+  long long sampled_bytes;
+  long long sampled_code;         /* code lines and bytes of the files with code */
+  long long sampled_code_bytes;
+  long long bytes;
+
+  struct estimate_lang *results;
+  int nresults;
+  struct estimate_lang total;
+};
+
+void init_estimate(struct estimate *est, const struct hcc_context *ctx, double error);
+/* enumerate a tree or a single file without reading it */
+int estimate_add_tree(struct estimate *est, const char *root);
+void estimate_add_file(struct estimate *est, const char *filename, off_t size);
+/* a result known exactly, e.g. an archive member */
+void estimate_add_exact(struct estimate *est, const struct line_counter *counter);
+/* sample and fill est->results */
+void estimate_run(struct estimate *est);
+
+#endif
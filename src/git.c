@@ -0,0 +1,1520 @@
+#define _XOPEN_SOURCE 700       /* required by strdup & realpath */
+
+#include <fcntl.h>
+#include <ctype.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <dirent.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <zlib.h>
+
+#include "error.h"
+#include "git.h"
+
+/*
+ * Blobs are inflated straight out of the object store into the blob
+ * callback, the revision is never checked out.
+ */
+
+static const char *const type_names[] = { NULL, "commit", "tree", "blob", "tag" };
+
+static int hex_value(char c) {
+  if (c >= '0' && c <= '9') {
+    return c - '0';
+  } else if (c >= 'a' && c <= 'f') {
+    return c - 'a' + 10;
+  }
+
+  return -1;
+}
+
+static boolean parse_oid(const char *hex, unsigned char *oid) {
+  int i, hi, lo;
+
+  for (i = 0; i < GIT_OID_SIZE; i++) {
+    if ((hi = hex_value(hex[2 * i])) < 0 || (lo = hex_value(hex[2 * i + 1])) < 0) {
+      return FALSE;
+    }
+    oid[i] = hi << 4 | lo;
+  }
+
+  return TRUE;
+}
+
+void git_oid_hex(const unsigned char *oid, char *hex) {
+  static const char digits[] = "0123456789abcdef";
+  int i;
+
+  for (i = 0; i < GIT_OID_SIZE; i++) {
+    hex[2 * i] = digits[oid[i] >> 4];
+    hex[2 * i + 1] = digits[oid[i] & 0xf];
+  }
+  hex[GIT_HEX_SIZE] = '\0';
+}
+
+static unsigned int get_be32(const unsigned char *p) {
+  return (unsigned int) p[0] << 24 | p[1] << 16 | p[2] << 8 | p[3];
+}
+
+static const void *map_file(const char *filename, size_t *size) {
+  struct stat sb;
+  void *data;
+  int fd;
+
+  if ((fd = open(filename, O_RDONLY)) == -1 || fstat(fd, &sb) == -1) {
+    error(EXIT_FAILURE, "Cannot open git file: %s", filename);
+  }
+
+  *size = sb.st_size;
+  if ((data = mmap(NULL, *size ? *size : 1, PROT_READ, MAP_PRIVATE, fd, 0)) == MAP_FAILED) {
+    error(EXIT_FAILURE, "Cannot map git file: %s", filename);
+  }
+  close(fd);
+
+  return data;
+}
+
+/* first line of a small file, FALSE when there is no such file */
+static boolean read_line_file(const char *filename, char *buf, int size) {
+  FILE *in;
+  int len;
+
+  if (!(in = fopen(filename, "r"))) {
+    return FALSE;
+  }
+
+  if (!fgets(buf, size, in)) {
+    buf[0] = '\0';
+  }
+  fclose(in);
+
+  len = strlen(buf);
+  while (len > 0 && (buf[len - 1] == '\n' || buf[len - 1] == '\r')) {
+    buf[--len] = '\0';
+  }
+
+  return TRUE;
+}
+
+/* dir/path in a new string, an absolute path stays as it is */
+static char *join_path(const char *dir, const char *path) {
+  char *buf;
+
+  if (!(buf = malloc(strlen(dir) + strlen(path) + 2))) {
+    error(EXIT_FAILURE, "Cannot alloc git path");
+  }
+
+  if (path[0] == '/' || !dir[0]) {
+    strcpy(buf, path);
+  } else {
+    sprintf(buf, "%s/%s", dir, path);
+  }
+
+  return buf;
+}
+
+static void open_pack(struct git_pack *pack, const char *idx_file) {
+  const unsigned char *idx;
+  char filename[PATH_MAX];
+  size_t table;
+  int len;
+
+  pack->idx = idx = map_file(idx_file, &pack->idx_size);
+
+  if (pack->idx_size >= 8 && !memcmp(idx, "\377tOc", 4)) {
+    if (get_be32(idx + 4) != 2) {
+      error(EXIT_FAILURE, "Unknown git pack index version: %s", idx_file);
+    }
+    pack->fanout = idx + 8;
+    pack->names = pack->fanout + 256 * 4;
+    pack->name_stride = GIT_OID_SIZE;
+  } else {
+    pack->fanout = idx;
+    pack->names = idx + 256 * 4 + 4;
+    pack->name_stride = 4 + GIT_OID_SIZE;
+  }
+
+  if ((size_t) (pack->names - idx) > pack->idx_size) {
+    error(EXIT_FAILURE, "Corrupt git pack index: %s", idx_file);
+  }
+
+  pack->nobjects = get_be32(pack->fanout + 255 * 4);
+  table = (size_t) pack->nobjects * pack->name_stride;
+
+  if (pack->name_stride == GIT_OID_SIZE) {
+    pack->offsets = pack->names + table + (size_t) pack->nobjects * 4;
+    pack->large_offsets = pack->offsets + (size_t) pack->nobjects * 4;
+    table = pack->large_offsets - pack->names;
+  }
+
+  if ((size_t) (pack->names - idx) + table > pack->idx_size) {
+    error(EXIT_FAILURE, "Corrupt git pack index: %s", idx_file);
+  }
+
+  len = strlen(idx_file) - strlen(".idx");
+  snprintf(filename, PATH_MAX, "%.*s.pack", len, idx_file);
+  if (!(pack->filename = strdup(filename))) {
+    error(EXIT_FAILURE, "Cannot alloc git pack");
+  }
+
+  pack->data = map_file(filename, &pack->size);
+  if (pack->size < 12 || memcmp(pack->data, "PACK", 4)) {
+    error(EXIT_FAILURE, "Not a git pack: %s", filename);
+  }
+}
+
+static void open_packs(struct git_repo *repo) {
+  char *dirname, *filename;
+  struct dirent *dent;
+  int size = 0, len;
+  DIR *dir;
+
+  dirname = join_path(repo->objects, "pack");
+  if (!(dir = opendir(dirname))) {
+    free(dirname);
+    return;
+  }
+
+  while ((dent = readdir(dir))) {
+    len = strlen(dent->d_name);
+    if (len <= 4 || strcmp(dent->d_name + len - 4, ".idx")) {
+      continue;
+    }
+
+    if (repo->npacks == size) {
+      size = size ? size << 1 : 8;
+      if (!(repo->packs = realloc(repo->packs, size * sizeof(struct git_pack)))) {
+        error(EXIT_FAILURE, "Cannot alloc git packs");
+      }
+    }
+
+    memset(&repo->packs[repo->npacks], 0, sizeof(struct git_pack));
+    filename = join_path(dirname, dent->d_name);
+    open_pack(&repo->packs[repo->npacks++], filename);
+    free(filename);
+  }
+
+  closedir(dir);
+  free(dirname);
+}
+
+void git_open(struct git_repo *repo, const char *path) {
+  char buf[PATH_MAX], line[PATH_MAX];
+  struct stat sb;
+
+  memset(repo, 0, sizeof(struct git_repo));
+
+  /* a work tree, where .git may also be a file pointing at the gitdir */
+  snprintf(buf, PATH_MAX, "%s/.git", path);
+  if (!stat(buf, &sb) && S_ISDIR(sb.st_mode)) {
+    repo->gitdir = join_path(path, ".git");
+  } else if (!stat(buf, &sb) && S_ISREG(sb.st_mode)) {
+    if (!read_line_file(buf, line, PATH_MAX) || strncmp(line, "gitdir: ", 8)) {
+      error(EXIT_FAILURE, "Invalid gitfile: %s", buf);
+    }
+    repo->gitdir = join_path(path, line + 8);
+  } else {
+    repo->gitdir = join_path("", path);
+  }
+
+  snprintf(buf, PATH_MAX, "%s/HEAD", repo->gitdir);
+  if (stat(buf, &sb)) {
+    fprintf(stderr, "Error: not a git repository: %s\n", path);
+    exit(EXIT_FAILURE);
+  }
+
+  /* a linked worktree shares the refs and objects of the main one */
+  snprintf(buf, PATH_MAX, "%s/commondir", repo->gitdir);
+  if (read_line_file(buf, line, PATH_MAX)) {
+    repo->commondir = join_path(repo->gitdir, line);
+  } else {
+    repo->commondir = join_path("", repo->gitdir);
+  }
+
+  repo->objects = join_path(repo->commondir, "objects");
+  open_packs(repo);
+}
+
+void git_close(struct git_repo *repo) {
+  int i;
+
+  for (i = 0; i < repo->npacks; i++) {
+    munmap((void *) repo->packs[i].idx, repo->packs[i].idx_size ? repo->packs[i].idx_size : 1);
+    munmap((void *) repo->packs[i].data, repo->packs[i].size ? repo->packs[i].size : 1);
+    free(repo->packs[i].filename);
+  }
+  free(repo->packs);
+
+  for (i = 0; i < GIT_DELTA_CACHE_SLOTS; i++) {
+    free(repo->cache[i].buf);
+  }
+
+  free(repo->gitdir);
+  free(repo->commondir);
+  free(repo->objects);
+}
+
+static const unsigned char *pack_name(const struct git_pack *pack, unsigned int i) {
+  return pack->names + (size_t) i * pack->name_stride + (pack->name_stride - GIT_OID_SIZE);
+}
+
+static off_t pack_offset(const struct git_pack *pack, unsigned int i) {
+  const unsigned char *p;
+  unsigned int offset;
+
+  if (!pack->offsets) {
+    return get_be32(pack->names + (size_t) i * pack->name_stride);
+  }
+
+  /* offsets past 2G are kept in the table of large ones */
+  offset = get_be32(pack->offsets + (size_t) i * 4);
+  if (!(offset & 0x80000000)) {
+    return offset;
+  }
+
+  p = pack->large_offsets + (size_t) (offset & 0x7fffffff) * 8;
+  if (p + 8 > pack->idx + pack->idx_size) {
+    error(EXIT_FAILURE, "Corrupt git pack index: %s", pack->filename);
+  }
+
+  return (off_t) get_be32(p) << 32 | get_be32(p + 4);
+}
+
+/* the objects starting with the byte of oid are [lo, hi) */
+static void fanout_range(const struct git_pack *pack, unsigned char first, unsigned int *lo, unsigned int *hi) {
+  *lo = first ? get_be32(pack->fanout + (first - 1) * 4) : 0;
+  *hi = get_be32(pack->fanout + first * 4);
+}
+
+static boolean find_packed(const struct git_repo *repo, const unsigned char *oid, struct git_pack **pack, off_t *offset) {
+  unsigned int lo, hi, mid;
+  int i, cmp;
+
+  for (i = 0; i < repo->npacks; i++) {
+    fanout_range(&repo->packs[i], oid[0], &lo, &hi);
+
+    while (lo < hi) {
+      mid = lo + (hi - lo) / 2;
+      if (!(cmp = memcmp(oid, pack_name(&repo->packs[i], mid), GIT_OID_SIZE))) {
+        *pack = &repo->packs[i];
+        *offset = pack_offset(*pack, mid);
+        return TRUE;
+      } else if (cmp < 0) {
+        hi = mid;
+      } else {
+        lo = mid + 1;
+      }
+    }
+  }
+
+  return FALSE;
+}
+
+/* inflate exactly size bytes, one more is given room to see a longer stream */
+static char *inflate_data(const unsigned char *data, size_t avail, size_t size, const char *filename) {
+  z_stream zs;
+  char *buf;
+  int ret;
+
+  if (!(buf = malloc(size + 1))) {
+    error(EXIT_FAILURE, "Cannot alloc git object");
+  }
+
+  memset(&zs, 0, sizeof(z_stream));
+  if (inflateInit(&zs) != Z_OK) {
+    error(EXIT_FAILURE, "Cannot init zlib");
+  }
+
+  zs.next_in = (unsigned char *) data;
+  zs.avail_in = avail > UINT_MAX ? UINT_MAX : avail;
+  zs.next_out = (unsigned char *) buf;
+  zs.avail_out = size + 1;
+
+  ret = inflate(&zs, Z_FINISH);
+  inflateEnd(&zs);
+
+  if (ret != Z_STREAM_END || zs.total_out != size) {
+    error(EXIT_FAILURE, "Corrupt git object in %s", filename);
+  }
+
+  return buf;
+}
+
+static size_t delta_varint(const unsigned char **p, const unsigned char *end, const char *filename) {
+  size_t n = 0;
+  int shift = 0;
+  unsigned char c;
+
+  do {
+    if (*p >= end || shift > 63) {
+      error(EXIT_FAILURE, "Corrupt git delta in %s", filename);
+    }
+    c = *(*p)++;
+    n |= (size_t) (c & 0x7f) << shift;
+    shift += 7;
+  } while (c & 0x80);
+
+  return n;
+}
+
+/* rebuild an object from its base, the delta copies from it or inserts */
+static char *apply_delta(const char *base, size_t base_len, const unsigned char *delta, size_t delta_len, size_t *len, const char *filename) {
+  const unsigned char *p = delta, *end = delta + delta_len;
+  size_t src, dst, offset, size;
+  char *buf, *out;
+  unsigned char c;
+  int i;
+
+  src = delta_varint(&p, end, filename);
+  dst = delta_varint(&p, end, filename);
+  if (src != base_len) {
+    error(EXIT_FAILURE, "Corrupt git delta in %s", filename);
+  }
+
+  if (!(out = buf = malloc(dst + 1))) {
+    error(EXIT_FAILURE, "Cannot alloc git object");
+  }
+
+  while (p < end) {
+    c = *p++;
+
+    if (c & 0x80) {
+      offset = size = 0;
+      for (i = 0; i < 4; i++) {
+        if (c & (1 << i)) {
+          if (p >= end) {
+            error(EXIT_FAILURE, "Corrupt git delta in %s", filename);
+          }
+          offset |= (size_t) *p++ << (8 * i);
+        }
+      }
+      for (i = 0; i < 3; i++) {
+        if (c & (0x10 << i)) {
+          if (p >= end) {
+            error(EXIT_FAILURE, "Corrupt git delta in %s", filename);
+          }
+          size |= (size_t) *p++ << (8 * i);
+        }
+      }
+      if (!size) {
+        size = 0x10000;
+      }
+
+      if (offset > base_len || size > base_len - offset || size > dst - (out - buf)) {
+        error(EXIT_FAILURE, "Corrupt git delta in %s", filename);
+      }
+      memcpy(out, base + offset, size);
+      out += size;
+    } else if (c) {
+      if (c > end - p || c > dst - (out - buf)) {
+        error(EXIT_FAILURE, "Corrupt git delta in %s", filename);
+      }
+      memcpy(out, p, c);
+      out += c;
+      p += c;
+    } else {
+      error(EXIT_FAILURE, "Corrupt git delta in %s", filename);
+    }
+  }
+
+  if ((size_t) (out - buf) != dst) {
+    error(EXIT_FAILURE, "Corrupt git delta in %s", filename);
+  }
+
+  *len = dst;
+
+  return buf;
+}
+
+static char *read_packed(struct git_repo *repo, const struct git_pack *pack, off_t offset, int *type, size_t *len);
+static char *read_loose(struct git_repo *repo, const unsigned char *oid, int *type, size_t *len);
+
+/*
+ * An object some delta is based on, owned by the cache. It stays valid
+ * until the next object is put in the cache.
+ */
+static const char *delta_base(struct git_repo *repo, const struct git_pack *pack, off_t offset, int *type, size_t *len) {
+  struct git_delta_base *slot = &repo->cache[(size_t) (offset ^ (off_t) (pack - repo->packs) << 24) % GIT_DELTA_CACHE_SLOTS];
+  struct git_delta_base *victim;
+  char *buf;
+
+  if (slot->buf && slot->pack == pack && slot->offset == offset) {
+    *type = slot->type;
+    *len = slot->len;
+    return slot->buf;
+  }
+
+  buf = read_packed(repo, pack, offset, type, len);
+
+  if (slot->buf) {
+    repo->cached -= slot->len;
+    free(slot->buf);
+  }
+  slot->pack = pack;
+  slot->offset = offset;
+  slot->type = *type;
+  slot->buf = buf;
+  slot->len = *len;
+  repo->cached += *len;
+
+  /* the slots are evicted in turn, a big base may be alone in the cache */
+  while (repo->cached > GIT_DELTA_CACHE_SIZE) {
+    victim = &repo->cache[repo->hand];
+    repo->hand = (repo->hand + 1) % GIT_DELTA_CACHE_SLOTS;
+    if (victim->buf && victim != slot) {
+      repo->cached -= victim->len;
+      free(victim->buf);
+      victim->buf = NULL;
+    } else if (repo->cached == slot->len) {
+      break;
+    }
+  }
+
+  return buf;
+}
+
+static char *read_packed(struct git_repo *repo, const struct git_pack *pack, off_t offset, int *type, size_t *len) {
+  const unsigned char *p = pack->data + offset, *end = pack->data + pack->size;
+  const unsigned char *base_oid;
+  const struct git_pack *base_pack;
+  const char *base;
+  char *delta, *buf, *loose = NULL;
+  size_t size, base_len;
+  off_t base_offset;
+  unsigned char c;
+  int shift = 4;
+
+  if (offset < 12 || (size_t) offset >= pack->size) {
+    error(EXIT_FAILURE, "Corrupt git pack: %s", pack->filename);
+  }
+
+  /* type and size, then the base of a delta */
+  c = *p++;
+  *type = (c >> 4) & 7;
+  size = c & 0xf;
+  while (c & 0x80) {
+    if (p >= end || shift > 60) {
+      error(EXIT_FAILURE, "Corrupt git pack: %s", pack->filename);
+    }
+    c = *p++;
+    size |= (size_t) (c & 0x7f) << shift;
+    shift += 7;
+  }
+
+  switch (*type) {
+  case GIT_OBJ_COMMIT:
+  case GIT_OBJ_TREE:
+  case GIT_OBJ_BLOB:
+  case GIT_OBJ_TAG:
+    *len = size;
+    return inflate_data(p, end - p, size, pack->filename);
+  case GIT_OBJ_OFS_DELTA:
+    if (p >= end) {
+      error(EXIT_FAILURE, "Corrupt git pack: %s", pack->filename);
+    }
+    c = *p++;
+    base_offset = c & 0x7f;
+    while (c & 0x80) {
+      if (p >= end || base_offset >= offset) {
+        error(EXIT_FAILURE, "Corrupt git pack: %s", pack->filename);
+      }
+      c = *p++;
+      base_offset = ((base_offset + 1) << 7) | (c & 0x7f);
+    }
+    if (base_offset <= 0 || base_offset >= offset) {
+      error(EXIT_FAILURE, "Corrupt git pack: %s", pack->filename);
+    }
+
+    delta = inflate_data(p, end - p, size, pack->filename);
+    base = delta_base(repo, pack, offset - base_offset, type, &base_len);
+    break;
+  case GIT_OBJ_REF_DELTA:
+    if (end - p < GIT_OID_SIZE) {
+      error(EXIT_FAILURE, "Corrupt git pack: %s", pack->filename);
+    }
+    base_oid = p;
+    p += GIT_OID_SIZE;
+
+    delta = inflate_data(p, end - p, size, pack->filename);
+    if (find_packed(repo, base_oid, (struct git_pack **) &base_pack, &base_offset)) {
+      base = delta_base(repo, base_pack, base_offset, type, &base_len);
+    } else if (!(base = loose = read_loose(repo, base_oid, type, &base_len))) {
+      error(EXIT_FAILURE, "Missing git delta base in %s", pack->filename);
+    }
+    break;
+  default:
+    error(EXIT_FAILURE, "Corrupt git pack: %s", pack->filename);
+    return NULL;
+  }
+
+  buf = apply_delta(base, base_len, (unsigned char *) delta, size, len, pack->filename);
+  free(delta);
+  free(loose);
+
+  return buf;
+}
+
+static void loose_path(const struct git_repo *repo, const unsigned char *oid, char *filename) {
+  char hex[GIT_HEX_SIZE + 1];
+
+  git_oid_hex(oid, hex);
+  snprintf(filename, PATH_MAX, "%s/%.2s/%s", repo->objects, hex, hex + 2);
+}
+
+/* "<type> <size>\0" then the content, all deflated */
+static char *read_loose(struct git_repo *repo, const unsigned char *oid, int *type, size_t *len) {
+  char filename[PATH_MAX], header[64], *nul, *buf, *end;
+  const unsigned char *data;
+  size_t size, got;
+  z_stream zs;
+  int ret;
+
+  loose_path(repo, oid, filename);
+  if (access(filename, F_OK)) {
+    return NULL;
+  }
+
+  data = map_file(filename, &size);
+
+  memset(&zs, 0, sizeof(z_stream));
+  if (inflateInit(&zs) != Z_OK) {
+    error(EXIT_FAILURE, "Cannot init zlib");
+  }
+  zs.next_in = (unsigned char *) data;
+  zs.avail_in = size > UINT_MAX ? UINT_MAX : size;
+  zs.next_out = (unsigned char *) header;
+  zs.avail_out = sizeof(header);
+
+  ret = inflate(&zs, Z_SYNC_FLUSH);
+  if ((ret != Z_OK && ret != Z_STREAM_END) || !(nul = memchr(header, '\0', sizeof(header) - zs.avail_out))) {
+    error(EXIT_FAILURE, "Corrupt git object: %s", filename);
+  }
+
+  for (*type = GIT_OBJ_TAG; *type > 0; (*type)--) {
+    int name_len = strlen(type_names[*type]);
+
+    if (!strncmp(header, type_names[*type], name_len) && header[name_len] == ' ') {
+      break;
+    }
+  }
+
+  *len = strtoull(strchr(header, ' ') ? strchr(header, ' ') + 1 : header, &end, 10);
+  if (!*type || end != nul) {
+    error(EXIT_FAILURE, "Corrupt git object: %s", filename);
+  }
+
+  got = (char *) zs.next_out - (nul + 1);
+  if (got > *len || !(buf = malloc(*len + 1))) {
+    error(EXIT_FAILURE, "Corrupt git object: %s", filename);
+  }
+  memcpy(buf, nul + 1, got);
+
+  if (ret != Z_STREAM_END) {
+    zs.next_out = (unsigned char *) buf + got;
+    zs.avail_out = *len + 1 - got;
+    ret = inflate(&zs, Z_FINISH);
+  }
+  inflateEnd(&zs);
+  munmap((void *) data, size ? size : 1);
+
+  if (ret != Z_STREAM_END || zs.total_out != (nul + 1 - header) + *len) {
+    error(EXIT_FAILURE, "Corrupt git object: %s", filename);
+  }
+
+  return buf;
+}
+
+char *git_read_object(struct git_repo *repo, const unsigned char *oid, int *type, size_t *len) {
+  struct git_pack *pack;
+  off_t offset;
+
+  if (find_packed(repo, oid, &pack, &offset)) {
+    return read_packed(repo, pack, offset, type, len);
+  }
+
+  return read_loose(repo, oid, type, len);
+}
+
+/* loose refs first, then the packed ones, symbolic refs are followed */
+static boolean resolve_ref(struct git_repo *repo, const char *ref, unsigned char *oid, int depth) {
+  char filename[PATH_MAX], line[PATH_MAX + GIT_HEX_SIZE + 2];
+  size_t ref_len = strlen(ref);
+  FILE *in;
+
+  snprintf(filename, PATH_MAX, "%s/%s", repo->gitdir, ref);
+  if (!read_line_file(filename, line, sizeof(line))) {
+    snprintf(filename, PATH_MAX, "%s/%s", repo->commondir, ref);
+    if (!read_line_file(filename, line, sizeof(line))) {
+      line[0] = '\0';
+    }
+  }
+
+  if (!strncmp(line, "ref: ", 5)) {
+    return depth < GIT_MAX_SYMREF_DEPTH && resolve_ref(repo, line + 5, oid, depth + 1);
+  } else if (line[0]) {
+    return strlen(line) == GIT_HEX_SIZE && parse_oid(line, oid);
+  }
+
+  snprintf(filename, PATH_MAX, "%s/packed-refs", repo->commondir);
+  if (!(in = fopen(filename, "r"))) {
+    return FALSE;
+  }
+
+  /* "<oid> <ref>" lines, '#' starts the header and '^' a peeled tag */
+  while (fgets(line, sizeof(line), in)) {
+    if (line[0] != '#' && line[0] != '^' && line[GIT_HEX_SIZE] == ' '
+        && !strncmp(line + GIT_HEX_SIZE + 1, ref, ref_len)
+        && (line[GIT_HEX_SIZE + 1 + ref_len] == '\n' || line[GIT_HEX_SIZE + 1 + ref_len] == '\0')) {
+      fclose(in);
+      return parse_oid(line, oid);
+    }
+  }
+  fclose(in);
+
+  return FALSE;
+}
+
+static boolean hex_prefix(const unsigned char *oid, const char *hex, int len) {
+  int i;
+
+  for (i = 0; i < len; i++) {
+    if (hex_value(hex[i]) != (i & 1 ? oid[i / 2] & 0xf : oid[i / 2] >> 4)) {
+      return FALSE;
+    }
+  }
+
+  return TRUE;
+}
+
+/* the objects of an abbreviated name, counted up to the second one */
+static int find_abbrev(struct git_repo *repo, const char *hex, int len, unsigned char *oid) {
+  char dirname[PATH_MAX], name[GIT_HEX_SIZE + 1];
+  unsigned char found[GIT_OID_SIZE];
+  unsigned int lo, hi, first;
+  struct dirent *dent;
+  int i, matches = 0;
+  DIR *dir;
+
+  first = hex_value(hex[0]) << 4 | hex_value(hex[1]);
+
+  for (i = 0; i < repo->npacks; i++) {
+    for (fanout_range(&repo->packs[i], first, &lo, &hi); lo < hi; lo++) {
+      if (hex_prefix(pack_name(&repo->packs[i], lo), hex, len)
+          && (!matches || memcmp(oid, pack_name(&repo->packs[i], lo), GIT_OID_SIZE))) {
+        memcpy(oid, pack_name(&repo->packs[i], lo), GIT_OID_SIZE);
+        matches++;
+      }
+    }
+  }
+
+  snprintf(dirname, PATH_MAX, "%s/%.2s", repo->objects, hex);
+  if ((dir = opendir(dirname))) {
+    while ((dent = readdir(dir))) {
+      if (strlen(dent->d_name) != GIT_HEX_SIZE - 2) {
+        continue;
+      }
+
+      memcpy(name, hex, 2);
+      memcpy(name + 2, dent->d_name, GIT_HEX_SIZE - 2);
+      if (parse_oid(name, found) && hex_prefix(found, hex, len) && (!matches || memcmp(oid, found, GIT_OID_SIZE))) {
+        memcpy(oid, found, GIT_OID_SIZE);
+        matches++;
+      }
+    }
+    closedir(dir);
+  }
+
+  return matches;
+}
+
+static void resolve_name(struct git_repo *repo, const char *rev, unsigned char *oid) {
+  /* the order git looks up a short ref in */
+  static const char *const rules[] = {
+    "%s", "refs/%s", "refs/tags/%s", "refs/heads/%s", "refs/remotes/%s", "refs/remotes/%s/HEAD", NULL,
+  };
+  char ref[PATH_MAX];
+  int i, len = strlen(rev);
+
+  if (len == GIT_HEX_SIZE && parse_oid(rev, oid)) {
+    return;
+  }
+
+  for (i = 0; rules[i]; i++) {
+    snprintf(ref, PATH_MAX, rules[i], rev);
+    if (resolve_ref(repo, ref, oid, 0)) {
+      return;
+    }
+  }
+
+  for (i = 0; i < len && hex_value(rev[i]) >= 0; i++);
+  if (i == len && len >= GIT_MIN_ABBREV && len < GIT_HEX_SIZE) {
+    if ((i = find_abbrev(repo, rev, len, oid)) == 1) {
+      return;
+    } else if (i > 1) {
+      fprintf(stderr, "Error: ambiguous git revision: %s\n", rev);
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  fprintf(stderr, "Error: unknown git revision: %s\n", rev);
+  exit(EXIT_FAILURE);
+}
+
+/* tags are peeled to their object until one of type want, its content is returned */
+static char *peel(struct git_repo *repo, const char *rev, unsigned char *oid, int want) {
+  char *buf, *field;
+  size_t len;
+  int type;
+
+  for (;;) {
+    if (!(buf = git_read_object(repo, oid, &type, &len))) {
+      fprintf(stderr, "Error: missing git object of %s\n", rev);
+      exit(EXIT_FAILURE);
+    }
+
+    buf[len] = '\0';
+    if (type == want) {
+      return buf;
+    }
+
+    /* the tree of a commit is its first header */
+    if (type == GIT_OBJ_TAG && !strncmp(buf, "object ", 7)) {
+      field = buf + 7;
+    } else if (type == GIT_OBJ_COMMIT && want == GIT_OBJ_TREE && !strncmp(buf, "tree ", 5)) {
+      field = buf + 5;
+    } else {
+      fprintf(stderr, "Error: not a %s: %s\n", type_names[want], rev);
+      exit(EXIT_FAILURE);
+    }
+
+    if (!parse_oid(field, oid)) {
+      error(EXIT_FAILURE, "Corrupt git object of %s", rev);
+    }
+    free(buf);
+  }
+}
+
+static void peel_to_tree(struct git_repo *repo, const char *rev, unsigned char *oid) {
+  free(peel(repo, rev, oid, GIT_OBJ_TREE));
+}
+
+/* the nth parent of the commit, the commit itself for 0 */
+static void commit_parent(struct git_repo *repo, const char *rev, unsigned char *oid, long n) {
+  char *buf = peel(repo, rev, oid, GIT_OBJ_COMMIT), *p, *end;
+  long i;
+
+  /* the message may quote headers too */
+  if ((end = strstr(buf, "\n\n"))) {
+    *end = '\0';
+  }
+
+  for (p = buf, i = 0; i < n && (p = strstr(p, "\nparent ")); i++) {
+    p += 8;
+  }
+
+  if (n && (!p || !parse_oid(p, oid))) {
+    fprintf(stderr, "Error: no such parent: %s\n", rev);
+    exit(EXIT_FAILURE);
+  }
+
+  free(buf);
+}
+
+void git_resolve_rev(struct git_repo *repo, const char *rev, unsigned char *oid) {
+  const char *p = rev + strcspn(rev, "~^");
+  char name[PATH_MAX], *end;
+  long n;
+  int op;
+
+  snprintf(name, PATH_MAX, "%.*s", (int) (p - rev), rev);
+  resolve_name(repo, name, oid);
+
+  /* rev~N follows the first parent N times, rev^N is the Nth parent */
+  while (*p) {
+    if (!strcmp(p, "^{tree}")) {
+      peel_to_tree(repo, rev, oid);
+      return;
+    } else if (!strcmp(p, "^{commit}") || !strcmp(p, "^{}")) {
+      commit_parent(repo, rev, oid, 0);
+      return;
+    }
+
+    op = *p++;
+    n = 1;
+    if (isdigit((unsigned char) *p)) {
+      n = strtol(p, &end, 10);
+      p = end;
+    }
+
+    if (op == '~') {
+      while (n--) {
+        commit_parent(repo, rev, oid, 1);
+      }
+    } else if (op == '^') {
+      commit_parent(repo, rev, oid, n);
+    } else {
+      fprintf(stderr, "Error: unknown git revision: %s\n", rev);
+      exit(EXIT_FAILURE);
+    }
+  }
+}
+
+/* a blob to count, where it is in the store */
+struct git_blob {
+  unsigned char oid[GIT_OID_SIZE];
+  char *path;
+  int pack;                     /* -1 for a loose object */
+  off_t offset;
+};
+
+struct git_blob_list {
+  struct git_blob *blobs;
+  int nblobs;
+  int size;
+};
+
+static void add_blob(struct git_repo *repo, struct git_blob_list *list, const unsigned char *oid, const char *path) {
+  struct git_blob *blob;
+  struct git_pack *pack;
+
+  if (list->nblobs == list->size) {
+    list->size = list->size ? list->size << 1 : INIT_GIT_LIST_SIZE;
+    if (!(list->blobs = realloc(list->blobs, list->size * sizeof(struct git_blob)))) {
+      error(EXIT_FAILURE, "Cannot alloc git blobs");
+    }
+  }
+
+  blob = &list->blobs[list->nblobs++];
+  memcpy(blob->oid, oid, GIT_OID_SIZE);
+  if (!(blob->path = strdup(path))) {
+    error(EXIT_FAILURE, "Cannot alloc git blobs");
+  }
+
+  blob->pack = -1;
+  blob->offset = 0;
+  if (find_packed(repo, oid, &pack, &blob->offset)) {
+    blob->pack = pack - repo->packs;
+  }
+}
+
+/* "<octal mode> <name>\0<oid>" entries */
+boolean git_tree_next(const char **p, const char *end, struct git_tree_entry *entry) {
+  const char *nul;
+  char *name;
+
+  if (*p >= end) {
+    return FALSE;
+  }
+
+  entry->mode = strtoul(*p, &name, 8);
+  if (*name++ != ' ' || !(nul = memchr(name, '\0', end - name)) || end - nul <= GIT_OID_SIZE) {
+    error(EXIT_FAILURE, "Corrupt git tree");
+  }
+
+  entry->name = name;
+  entry->name_len = nul - name;
+  entry->oid = (const unsigned char *) nul + 1;
+  *p = nul + 1 + GIT_OID_SIZE;
+
+  return TRUE;
+}
+
+/* submodules and symlinks are left out */
+static void collect_tree(struct git_repo *repo, struct git_blob_list *list, const unsigned char *oid, char *path, int path_len) {
+  struct git_tree_entry entry;
+  const char *p;
+  char *buf;
+  size_t len;
+  int type;
+
+  if (!(buf = git_read_object(repo, oid, &type, &len)) || type != GIT_OBJ_TREE) {
+    error(EXIT_FAILURE, "Missing git tree under %s", path);
+  }
+
+  for (p = buf; git_tree_next(&p, buf + len, &entry); ) {
+    if (path_len + entry.name_len + 1 >= PATH_MAX) {
+      fprintf(stderr, "Too long path, skip: %s%.*s\n", path, entry.name_len, entry.name);
+      continue;
+    }
+
+    memcpy(path + path_len, entry.name, entry.name_len);
+    path[path_len + entry.name_len] = '\0';
+
+    if ((entry.mode & S_IFMT) == S_IFDIR) {
+      path[path_len + entry.name_len] = '/';
+      path[path_len + entry.name_len + 1] = '\0';
+      collect_tree(repo, list, entry.oid, path, path_len + entry.name_len + 1);
+    } else if ((entry.mode & S_IFMT) == S_IFREG) {
+      add_blob(repo, list, entry.oid, path);
+    }
+
+    path[path_len] = '\0';
+  }
+
+  free(buf);
+}
+
+static int compare_blob(const void *a, const void *b) {
+  const struct git_blob *x = (const struct git_blob *) a, *y = (const struct git_blob *) b;
+
+  /* loose objects last */
+  if (x->pack != y->pack) {
+    return (unsigned int) x->pack < (unsigned int) y->pack ? -1 : 1;
+  }
+
+  return x->offset < y->offset ? -1 : x->offset > y->offset;
+}
+
+void git_scan_rev(struct git_repo *repo, const char *rev, git_blob_func func, void *arg) {
+  struct git_blob_list list = { NULL, 0, 0 };
+  unsigned char oid[GIT_OID_SIZE];
+  char path[PATH_MAX], name[PATH_MAX], *buf;
+  int i, type, prefix_len;
+  size_t len;
+
+  git_resolve_rev(repo, rev, oid);
+  peel_to_tree(repo, rev, oid);
+
+  path[0] = '\0';
+  collect_tree(repo, &list, oid, path, 0);
+
+  /* in pack order each pack is read through once, bases are still cached */
+  qsort(list.blobs, list.nblobs, sizeof(struct git_blob), compare_blob);
+
+  prefix_len = snprintf(name, PATH_MAX, "%s%c", rev, GIT_REV_SEP);
+
+  for (i = 0; i < list.nblobs; i++) {
+    if (!(buf = git_read_object(repo, list.blobs[i].oid, &type, &len)) || type != GIT_OBJ_BLOB) {
+      error(EXIT_FAILURE, "Missing git blob: %s", list.blobs[i].path);
+    }
+
+    snprintf(name + prefix_len, PATH_MAX - prefix_len, "%s", list.blobs[i].path);
+    if (func(name, list.blobs[i].oid, buf, len, arg)) {
+      free(buf);
+      break;
+    }
+    free(buf);
+  }
+
+  for (i = 0; i < list.nblobs; i++) {
+    free(list.blobs[i].path);
+  }
+  free(list.blobs);
+}
+
+/* Fibonacci hashing, object ids are random enough to take the first bytes */
+#define oid_slot(oid, size) ((size_t) ((*(const unsigned long long *) (oid) * 0x9E3779B97F4A7C15ULL) >> 32) & ((size) - 1))
+
+static boolean same_tag(const char *a, const char *b) {
+  return a == b || (a && b && !strcmp(a, b));
+}
+
+void git_oid_map_init(struct git_oid_map *map) {
+  map->slots = NULL;
+  map->size = 0;
+  map->count = 0;
+}
+
+static struct git_oid_entry *oid_map_find(const struct git_oid_map *map, const unsigned char *oid, const char *tag) {
+  unsigned long long key;
+  size_t i;
+
+  if (!map->size) {
+    return NULL;
+  }
+
+  memcpy(&key, oid, sizeof(key));
+  for (i = oid_slot(&key, map->size); map->slots[i].value; i = (i + 1) & (map->size - 1)) {
+    if (!memcmp(map->slots[i].oid, oid, GIT_OID_SIZE) && same_tag(map->slots[i].tag, tag)) {
+      break;
+    }
+  }
+
+  return &map->slots[i];
+}
+
+static void oid_map_grow(struct git_oid_map *map) {
+  struct git_oid_entry *slots = map->slots, *slot;
+  size_t i, size = map->size;
+
+  map->size = size ? size << 1 : INIT_GIT_OID_MAP_SIZE;
+  if (!(map->slots = calloc(map->size, sizeof(struct git_oid_entry)))) {
+    error(EXIT_FAILURE, "Cannot alloc git object map");
+  }
+
+  for (i = 0; i < size; i++) {
+    if (slots[i].value) {
+      slot = oid_map_find(map, slots[i].oid, slots[i].tag);
+      *slot = slots[i];
+    }
+  }
+
+  free(slots);
+}
+
+void git_oid_map_put(struct git_oid_map *map, const unsigned char *oid, const char *tag, void *value) {
+  struct git_oid_entry *slot;
+
+  /* at most half full */
+  if ((map->count + 1) * 2 > map->size) {
+    oid_map_grow(map);
+  }
+
+  slot = oid_map_find(map, oid, tag);
+  if (!slot->value) {
+    memcpy(slot->oid, oid, GIT_OID_SIZE);
+    if (tag && !(slot->tag = strdup(tag))) {
+      error(EXIT_FAILURE, "Cannot alloc git object map");
+    }
+    map->count++;
+  }
+
+  slot->value = value;
+}
+
+void *git_oid_map_get(const struct git_oid_map *map, const unsigned char *oid, const char *tag) {
+  struct git_oid_entry *slot = oid_map_find(map, oid, tag);
+
+  return slot ? slot->value : NULL;
+}
+
+void git_oid_map_free(struct git_oid_map *map, void (*free_value) (void *value)) {
+  size_t i;
+
+  for (i = 0; i < map->size; i++) {
+    if (map->slots[i].value) {
+      free(map->slots[i].tag);
+      if (free_value) {
+        free_value(map->slots[i].value);
+      }
+    }
+  }
+
+  free(map->slots);
+  git_oid_map_init(map);
+}
+
+/* the headers of a commit the walk needs */
+struct git_commit {
+  unsigned char oid[GIT_OID_SIZE];
+  unsigned char tree[GIT_OID_SIZE];
+  unsigned char *parents;
+  int nparents;
+  long long time;               /* of the committer */
+};
+
+static void read_commit(struct git_repo *repo, const unsigned char *oid, struct git_commit *commit) {
+  char hex[GIT_HEX_SIZE + 1], *buf, *p, *end, *email_end;
+  size_t len;
+  int type;
+
+  git_oid_hex(oid, hex);
+  if (!(buf = git_read_object(repo, oid, &type, &len)) || type != GIT_OBJ_COMMIT) {
+    error(EXIT_FAILURE, "Missing git commit: %s", hex);
+  }
+
+  buf[len] = '\0';
+  if ((end = strstr(buf, "\n\n"))) {
+    *end = '\0';
+  }
+
+  memcpy(commit->oid, oid, GIT_OID_SIZE);
+  commit->parents = NULL;
+  commit->nparents = 0;
+  commit->time = 0;
+
+  if (strncmp(buf, "tree ", 5) || !parse_oid(buf + 5, commit->tree)) {
+    error(EXIT_FAILURE, "Corrupt git commit: %s", hex);
+  }
+
+  for (p = buf; (p = strchr(p, '\n')); ) {
+    p++;
+    if (!strncmp(p, "parent ", 7)) {
+      if (!(commit->parents = realloc(commit->parents, (commit->nparents + 1) * GIT_OID_SIZE))
+          || !parse_oid(p + 7, commit->parents + commit->nparents * GIT_OID_SIZE)) {
+        error(EXIT_FAILURE, "Corrupt git commit: %s", hex);
+      }
+      commit->nparents++;
+    } else if (!strncmp(p, "committer ", 10) && (email_end = strchr(p, '>'))) {
+      commit->time = strtoll(email_end + 1, NULL, 10);
+    }
+  }
+
+  free(buf);
+}
+
+void git_commit_tree(struct git_repo *repo, const unsigned char *commit, unsigned char *tree) {
+  struct git_commit c;
+
+  read_commit(repo, commit, &c);
+  memcpy(tree, c.tree, GIT_OID_SIZE);
+  free(c.parents);
+}
+
+/* the commits of a shallow clone whose parents are not there */
+static void load_shallow(struct git_repo *repo, struct git_oid_map *shallow) {
+  char filename[PATH_MAX], line[GIT_HEX_SIZE + 2];
+  unsigned char oid[GIT_OID_SIZE];
+  FILE *in;
+
+  snprintf(filename, PATH_MAX, "%s/shallow", repo->commondir);
+  if (!(in = fopen(filename, "r"))) {
+    return;
+  }
+
+  while (fgets(line, sizeof(line), in)) {
+    if (parse_oid(line, oid)) {
+      git_oid_map_put(shallow, oid, NULL, repo);
+    }
+  }
+
+  fclose(in);
+}
+
+/* the commits met by the walk, a max heap on committer time */
+struct rev_queue {
+  struct git_commit *commits;
+  int count;
+  int size;
+};
+
+static void rev_queue_push(struct rev_queue *queue, struct git_commit *commit) {
+  struct git_commit tmp;
+  int i, parent;
+
+  if (queue->count == queue->size) {
+    queue->size = queue->size ? queue->size << 1 : INIT_GIT_LIST_SIZE;
+    if (!(queue->commits = realloc(queue->commits, queue->size * sizeof(struct git_commit)))) {
+      error(EXIT_FAILURE, "Cannot alloc git commits");
+    }
+  }
+
+  queue->commits[i = queue->count++] = *commit;
+  for (; i && queue->commits[parent = (i - 1) / 2].time < queue->commits[i].time; i = parent) {
+    tmp = queue->commits[parent];
+    queue->commits[parent] = queue->commits[i];
+    queue->commits[i] = tmp;
+  }
+}
+
+static void rev_queue_pop(struct rev_queue *queue, struct git_commit *commit) {
+  struct git_commit tmp;
+  int i = 0, child;
+
+  *commit = queue->commits[0];
+  queue->commits[0] = queue->commits[--queue->count];
+
+  while ((child = 2 * i + 1) < queue->count) {
+    if (child + 1 < queue->count && queue->commits[child + 1].time > queue->commits[child].time) {
+      child++;
+    }
+    if (queue->commits[i].time >= queue->commits[child].time) {
+      break;
+    }
+    tmp = queue->commits[child];
+    queue->commits[child] = queue->commits[i];
+    queue->commits[i] = tmp;
+    i = child;
+  }
+}
+
+/* queue oid unless the walk met it already */
+static void rev_queue_add(struct git_repo *repo, struct rev_queue *queue, struct git_oid_map *seen, const unsigned char *oid) {
+  struct git_commit commit;
+
+  if (git_oid_map_get(seen, oid, NULL)) {
+    return;
+  }
+
+  git_oid_map_put(seen, oid, NULL, repo);
+  read_commit(repo, oid, &commit);
+  rev_queue_push(queue, &commit);
+}
+
+/* mark every ancestor of oid as seen, so the walk stops there */
+static void hide_history(struct git_repo *repo, struct git_oid_map *seen, struct git_oid_map *shallow, const unsigned char *oid) {
+  struct rev_queue queue = { NULL, 0, 0 };
+  struct git_commit commit;
+  int i;
+
+  rev_queue_add(repo, &queue, seen, oid);
+  while (queue.count) {
+    rev_queue_pop(&queue, &commit);
+    for (i = 0; !git_oid_map_get(shallow, commit.oid, NULL) && i < commit.nparents; i++) {
+      rev_queue_add(repo, &queue, seen, commit.parents + i * GIT_OID_SIZE);
+    }
+    free(commit.parents);
+  }
+
+  free(queue.commits);
+}
+
+int git_rev_list(struct git_repo *repo, const char *range, boolean first_parent, unsigned char **commits) {
+  struct rev_queue queue = { NULL, 0, 0 };
+  struct git_oid_map seen, shallow;
+  unsigned char oid[GIT_OID_SIZE], *list = NULL;
+  struct git_commit commit;
+  const char *dots = strstr(range, "..");
+  char from[PATH_MAX];
+  int i, count = 0, size = 0;
+
+  git_oid_map_init(&seen);
+  git_oid_map_init(&shallow);
+  load_shallow(repo, &shallow);
+
+  if (dots) {
+    snprintf(from, PATH_MAX, "%.*s", (int) (dots - range), range);
+    git_resolve_rev(repo, from, oid);
+    commit_parent(repo, from, oid, 0);
+    hide_history(repo, &seen, &shallow, oid);
+    range = dots + 2;
+  }
+
+  git_resolve_rev(repo, range, oid);
+  commit_parent(repo, range, oid, 0);
+  rev_queue_add(repo, &queue, &seen, oid);
+
+  while (queue.count) {
+    rev_queue_pop(&queue, &commit);
+
+    if (count == size) {
+      size = size ? size << 1 : INIT_GIT_LIST_SIZE;
+      if (!(list = realloc(list, (size_t) size * GIT_OID_SIZE))) {
+        error(EXIT_FAILURE, "Cannot alloc git commits");
+      }
+    }
+    memcpy(list + (size_t) count++ * GIT_OID_SIZE, commit.oid, GIT_OID_SIZE);
+
+    for (i = 0; !git_oid_map_get(&shallow, commit.oid, NULL) && i < (first_parent && commit.nparents ? 1 : commit.nparents); i++) {
+      rev_queue_add(repo, &queue, &seen, commit.parents + i * GIT_OID_SIZE);
+    }
+    free(commit.parents);
+  }
+
+  /* oldest first */
+  for (i = 0; i < count / 2; i++) {
+    memcpy(oid, list + (size_t) i * GIT_OID_SIZE, GIT_OID_SIZE);
+    memcpy(list + (size_t) i * GIT_OID_SIZE, list + (size_t) (count - 1 - i) * GIT_OID_SIZE, GIT_OID_SIZE);
+    memcpy(list + (size_t) (count - 1 - i) * GIT_OID_SIZE, oid, GIT_OID_SIZE);
+  }
+
+  free(queue.commits);
+  git_oid_map_free(&seen, NULL);
+  git_oid_map_free(&shallow, NULL);
+
+  *commits = list;
+
+  return count;
+}
+
+char *git_find_work_tree(const char *path, char **top) {
+  char dir[PATH_MAX], buf[PATH_MAX + sizeof("/.git")], line[PATH_MAX];
+  char *gitdir = NULL, *slash;
+  struct stat sb;
+
+  if (!realpath(path, dir)) {
+    return NULL;
+  }
+
+  /* a file argument is in the work tree of its directory */
+  if (!stat(dir, &sb) && !S_ISDIR(sb.st_mode) && (slash = strrchr(dir, '/'))) {
+    slash[slash == dir] = '\0';
+  }
+
+  for (;;) {
+    snprintf(buf, sizeof(buf), "%s/.git", strcmp(dir, "/") ? dir : "");
+    if (!stat(buf, &sb)) {
+      if (S_ISDIR(sb.st_mode)) {
+        gitdir = join_path(dir, ".git");
+      } else if (S_ISREG(sb.st_mode) && read_line_file(buf, line, PATH_MAX) && !strncmp(line, "gitdir: ", 8)) {
+        gitdir = join_path(dir, line + 8);
+      }
+
+      if (gitdir) {
+        if (!(*top = strdup(dir))) {
+          error(EXIT_FAILURE, "Cannot alloc git path");
+        }
+        return gitdir;
+      }
+    }
+
+    if (!strcmp(dir, "/") || !(slash = strrchr(dir, '/'))) {
+      return NULL;
+    }
+    slash[slash == dir] = '\0';
+  }
+}
+
+/* the offset varint of index version 4, a bias of one per byte */
+static boolean index_varint(const unsigned char **p, const unsigned char *end, size_t *value) {
+  unsigned char c;
+
+  if (*p >= end) {
+    return FALSE;
+  }
+
+  c = *(*p)++;
+  *value = c & 0x7f;
+  while (c & 0x80) {
+    if (*p >= end) {
+      return FALSE;
+    }
+    c = *(*p)++;
+    *value = ((*value + 1) << 7) | (c & 0x7f);
+  }
+
+  return TRUE;
+}
+
+static int compare_index_entry(const void *a, const void *b) {
+  return strcmp(((const struct git_index_entry *) a)->path, ((const struct git_index_entry *) b)->path);
+}
+
+boolean git_read_index(const char *gitdir, struct git_index *index) {
+  const unsigned char *data, *start, *p, *q, *end, *nul;
+  struct git_index_entry *entry;
+  char filename[PATH_MAX], path[PATH_MAX];
+  unsigned int version, count, i, flags, ext, mode;
+  size_t path_len = 0, strip, size = 0;
+  struct stat sb;
+  boolean ok = FALSE;
+  int fd;
+
+  memset(index, 0, sizeof(struct git_index));
+
+  snprintf(filename, PATH_MAX, "%s/index", gitdir);
+  if ((fd = open(filename, O_RDONLY | O_CLOEXEC)) == -1) {
+    return FALSE;
+  }
+  if (fstat(fd, &sb) || sb.st_size < 12 + GIT_OID_SIZE
+      || (data = mmap(NULL, sb.st_size, PROT_READ, MAP_PRIVATE, fd, 0)) == MAP_FAILED) {
+    close(fd);
+    return FALSE;
+  }
+  close(fd);
+
+  index->mtime = sb.st_mtim;
+  version = get_be32(data + 4);
+  count = get_be32(data + 8);
+  if (memcmp(data, "DIRC", 4) || version < 2 || version > 4) {
+    goto out;
+  }
+
+  /* entries end where the extensions and the trailing checksum begin */
+  p = data + 12;
+  end = data + sb.st_size - GIT_OID_SIZE;
+  for (i = 0; i < count; i++) {
+    if (end - p < 62) {
+      goto out;
+    }
+
+    start = p;
+    mode = get_be32(p + 24);
+    flags = p[60] << 8 | p[61];
+    q = p + 62;
+    ext = 0;
+    if (flags & GIT_INDEX_EXTENDED) {
+      if (version < 3 || end - q < 2) {
+        goto out;
+      }
+      ext = q[0] << 8 | q[1];
+      q += 2;
+    }
+
+    /* version 4 drops a part of the previous path and pads nothing */
+    if (version == 4) {
+      if (!index_varint(&q, end, &strip) || strip > path_len) {
+        goto out;
+      }
+      path_len -= strip;
+    } else {
+      path_len = 0;
+    }
+
+    if (!(nul = memchr(q, '\0', end - q)) || path_len + (nul - q) >= PATH_MAX) {
+      goto out;
+    }
+    memcpy(path + path_len, q, nul - q);
+    path_len += nul - q;
+    path[path_len] = '\0';
+
+    if (version == 4) {
+      p = nul + 1;
+    } else {
+      p += ((q - p) + (nul - q) + 8) & ~7;
+    }
+
+    /* conflicts, sparse and intent to add entries have no blob of the file */
+    if ((flags & GIT_INDEX_STAGE) || (ext & (GIT_INDEX_SKIP_WORKTREE | GIT_INDEX_INTENT_TO_ADD)) || (mode & S_IFMT) != S_IFREG) {
+      continue;
+    }
+
+    if ((size_t) index->count == size) {
+      size = size ? size << 1 : INIT_GIT_LIST_SIZE;
+      if (!(index->entries = realloc(index->entries, size * sizeof(struct git_index_entry)))) {
+        error(EXIT_FAILURE, "Cannot alloc git index");
+      }
+    }
+
+    entry = &index->entries[index->count];
+    entry->ctime_sec = get_be32(start);
+    entry->ctime_nsec = get_be32(start + 4);
+    entry->mtime_sec = get_be32(start + 8);
+    entry->mtime_nsec = get_be32(start + 12);
+    entry->ino = get_be32(start + 20);
+    entry->size = get_be32(start + 36);
+    memcpy(entry->oid, start + 40, GIT_OID_SIZE);
+    if (!(entry->path = strdup(path))) {
+      error(EXIT_FAILURE, "Cannot alloc git index");
+    }
+    index->count++;
+  }
+
+  ok = TRUE;
+
+out:
+  munmap((void *) data, sb.st_size);
+  if (!ok) {
+    git_index_free(index);
+  }
+
+  return ok;
+}
+
+const struct git_index_entry *git_index_lookup(const struct git_index *index, const char *path, const struct stat *sb) {
+  const struct git_index_entry *entry;
+  struct git_index_entry key;
+
+  key.path = (char *) path;
+  if (!(entry = bsearch(&key, index->entries, index->count, sizeof(struct git_index_entry), compare_index_entry))) {
+    return NULL;
+  }
+
+  if (entry->mtime_sec != (unsigned int) sb->st_mtim.tv_sec || entry->mtime_nsec != (unsigned int) sb->st_mtim.tv_nsec
+      || entry->ctime_sec != (unsigned int) sb->st_ctim.tv_sec || entry->ctime_nsec != (unsigned int) sb->st_ctim.tv_nsec
+      || entry->ino != (unsigned int) sb->st_ino || entry->size != (unsigned int) sb->st_size) {
+    return NULL;
+  }
+
+  /* changed within the same tick as the index was written, git itself would look at the content */
+  if (entry->mtime_sec > (unsigned int) index->mtime.tv_sec
+      || (entry->mtime_sec == (unsigned int) index->mtime.tv_sec && entry->mtime_nsec >= (unsigned int) index->mtime.tv_nsec)) {
+    return NULL;
+  }
+
+  return entry;
+}
+
+void git_index_free(struct git_index *index) {
+  int i;
+
+  for (i = 0; i < index->count; i++) {
+    free(index->entries[i].path);
+  }
+  free(index->entries);
+  index->entries = NULL;
+  index->count = 0;
+}
@@ -0,0 +1,164 @@
+#ifndef __HCC_GIT_H
+#define __HCC_GIT_H
+
+#include <limits.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "hcc.h"
+
+#define GIT_REV_SEP ':'
+#define GIT_OID_SIZE 20
+#define GIT_HEX_SIZE 40
+#define GIT_MIN_ABBREV 4
+#define GIT_MAX_SYMREF_DEPTH 5
+#define GIT_DELTA_CACHE_SLOTS 1024
+#define GIT_DELTA_CACHE_SIZE (64 * 1024 * 1024)
+#define INIT_GIT_LIST_SIZE 256
+#define INIT_GIT_OID_MAP_SIZE 1024
+
+/* index entry flags, the extended ones in versions 3 and 4 only */
+#define GIT_INDEX_STAGE 0x3000
+#define GIT_INDEX_EXTENDED 0x4000
+#define GIT_INDEX_SKIP_WORKTREE 0x4000
+#define GIT_INDEX_INTENT_TO_ADD 0x2000
+
+enum {
+  GIT_OBJ_COMMIT = 1,
+  GIT_OBJ_TREE = 2,
+  GIT_OBJ_BLOB = 3,
+  GIT_OBJ_TAG = 4,
+  GIT_OBJ_OFS_DELTA = 6,
+  GIT_OBJ_REF_DELTA = 7,
+};
+
+/* a mapped packfile with its index, version 1 or 2 */
+struct git_pack {
+  char *filename;
+  const unsigned char *idx;
+  size_t idx_size;
+  const unsigned char *data;
+  size_t size;
+  const unsigned char *fanout;
+  const unsigned char *names;
+  int name_stride;              /* bytes from one object name to the next */
+  const unsigned char *offsets; /* version 2 only, 4 bytes each */
+  const unsigned char *large_offsets;
+  unsigned int nobjects;
+};
+
+/* an object delta bases were resolved to, the cache owns buf */
+struct git_delta_base {
+  const struct git_pack *pack;
+  off_t offset;
+  int type;
+  char *buf;
+  size_t len;
+};
+
+/*
+ * The object store of a repository, read in place: loose objects are
+ * inflated from their files and packs are mapped, so nothing is checked
+ * out. Delta bases are kept in a bounded cache, as a delta chain is met
+ * again by the next object most of the time.
+ */
+struct git_repo {
+  char *gitdir;
+  char *commondir;              /* refs and objects, the gitdir unless a worktree */
+  char *objects;
+
+  struct git_pack *packs;
+  int npacks;
+
+  struct git_delta_base cache[GIT_DELTA_CACHE_SLOTS];
+  size_t cached;                /* bytes in the cache */
+  int hand;                     /* next slot to evict */
+};
+
+/* an entry of a tree object, name is not NUL terminated */
+struct git_tree_entry {
+  unsigned int mode;
+  const char *name;
+  int name_len;
+  const unsigned char *oid;
+};
+
+struct git_oid_entry {
+  unsigned char oid[GIT_OID_SIZE];
+  char *tag;                    /* owned copy, NULL is a tag too */
+  void *value;
+};
+
+/* open addressing map from an object id and a tag string to a value */
+struct git_oid_map {
+  struct git_oid_entry *slots;  /* a NULL value marks a free slot */
+  size_t size;
+  size_t count;
+};
+
+/* a regular file of the index, stat data is cut to 32 bits as git keeps it */
+struct git_index_entry {
+  char *path;                   /* from the top of the work tree */
+  unsigned char oid[GIT_OID_SIZE];
+  unsigned int ctime_sec;
+  unsigned int ctime_nsec;
+  unsigned int mtime_sec;
+  unsigned int mtime_nsec;
+  unsigned int ino;
+  unsigned int size;
+};
+
+struct git_index {
+  struct git_index_entry *entries; /* stage 0 regular files sorted by path */
+  int count;
+  struct timespec mtime;        /* of the index file, entries as recent are racy */
+};
+
+/*
+ * Called once per regular file of the tree in pack order, name is
+ * "REV:path" and buf its content. A non-zero return stops the scan.
+ */
+typedef int (*git_blob_func) (const char *name, const unsigned char *oid, const char *buf, size_t len, void *arg);
+
+/* path is a work tree, a bare repository or a .git directory */
+void git_open(struct git_repo *repo, const char *path);
+void git_close(struct git_repo *repo);
+void git_oid_hex(const unsigned char *oid, char *hex);
+/* a full or abbreviated object name, or a ref as git would look it up */
+void git_resolve_rev(struct git_repo *repo, const char *rev, unsigned char *oid);
+/* the object content in a new buffer, NULL when it does not exist */
+char *git_read_object(struct git_repo *repo, const unsigned char *oid, int *type, size_t *len);
+/* every blob of the tree of rev, a tag, commit or tree */
+void git_scan_rev(struct git_repo *repo, const char *rev, git_blob_func func, void *arg);
+/* step p through the tree object ending at end, FALSE after the last entry */
+boolean git_tree_next(const char **p, const char *end, struct git_tree_entry *entry);
+void git_commit_tree(struct git_repo *repo, const unsigned char *commit, unsigned char *tree);
+/*
+ * The commits of range, "A..B" for those of B not in A or "B" for all of
+ * its history, oldest first in committer date order. Returns the number of
+ * commits, their ids follow one another in *commits.
+ */
+int git_rev_list(struct git_repo *repo, const char *range, boolean first_parent, unsigned char **commits);
+
+/*
+ * The gitdir of the work tree holding path, NULL when it is in none. *top
+ * is set to the absolute top of the work tree, both strings are malloc'd.
+ */
+char *git_find_work_tree(const char *path, char **top);
+/* FALSE when the index is missing or of an unknown version */
+boolean git_read_index(const char *gitdir, struct git_index *index);
+/*
+ * The entry of path, relative to the top, as long as the stat data of the
+ * file in sb still matches it, so its blob id can be trusted unhashed.
+ */
+const struct git_index_entry *git_index_lookup(const struct git_index *index, const char *path, const struct stat *sb);
+void git_index_free(struct git_index *index);
+
+void git_oid_map_init(struct git_oid_map *map);
+/* value must not be NULL */
+void git_oid_map_put(struct git_oid_map *map, const unsigned char *oid, const char *tag, void *value);
+void *git_oid_map_get(const struct git_oid_map *map, const unsigned char *oid, const char *tag);
+/* free_value is called on every value when not NULL */
+void git_oid_map_free(struct git_oid_map *map, void (*free_value) (void *value));
+
+#endif
@@ -58,7 +58,9 @@ static struct hash_table *rehash(struct hash_table *ht) {
   struct bucket *bktp, *nbktp;
   unsigned int i;
 
-  init_hash_table(&nht, size);
+  if (init_hash_table(&nht, size)) {
+    return NULL;
+  }
 
   for (i = 0; i < ht->size; i++) {
     bktp = &ht->buckets[i];
@@ -76,17 +78,19 @@ static struct hash_table *rehash(struct hash_table *ht) {
   return nht;
 }
 
-void init_hash_table(struct hash_table **ht, unsigned int size) {
+int init_hash_table(struct hash_table **ht, unsigned int size) {
     /* size must be non-zere and power of 2 */
     assert((size != 0) && ((size & (~size + 1)) == size));
 
     *ht = calloc(1, sizeof(struct hash_table) + sizeof(struct bucket) * size);
     if (!*ht) {
-      error(EXIT_FAILURE, "Cannot allocate hash table");
+      return -1;
     }
 
     (*ht)->size = size;
     (*ht)->free = size;
+
+    return 0;
 }
 
 void *hash_table_find_with_add(struct hash_table *ht, const char *key, hash_table_bucket_init init_func) {
@@ -107,7 +111,9 @@ void *hash_table_find_with_add(struct hash_table *ht, const char *key, hash_tabl
 
     /* TODO: rename hash_table_bucket_init to hash_table_init_bucket_value
      * and set bucket key here to avoid redundant codes */
-    init_func(bktp, key);
+    if (init_func(bktp, key)) {
+      return NULL;
+    }
     ht->free--;
 
     return bktp->value;
@@ -124,3 +130,13 @@ void *hash_table_current(struct hash_table *ht) {
 
   return NULL;  
 }
+
+/* the stored copy of key, NULL when key is not in the table */
+const char *hash_table_find_key(struct hash_table *ht, const char *key) {
+  int is_empty;
+  struct bucket *bktp;
+
+  bktp = hash_table_find_bucket(ht, key, &is_empty);
+
+  return bktp && !is_empty ? bktp->key : NULL;
+}
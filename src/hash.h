@@ -3,7 +3,6 @@
 
 #include <stdlib.h>
 #include <assert.h>
-#include "error.h"
 
 struct bucket {
   char *key;
@@ -17,11 +16,13 @@ struct hash_table {
   struct bucket buckets[];
 };
 
-typedef void (*hash_table_bucket_init) (struct bucket *bktp, const char *key);
+/* return 0 on success, -1 when the value cannot be created */
+typedef int (*hash_table_bucket_init) (struct bucket *bktp, const char *key);
 
-void init_hash_table(struct hash_table **ht, unsigned int size);
+int init_hash_table(struct hash_table **ht, unsigned int size);
 void *hash_table_find_with_add(struct hash_table *ht, const char *key, hash_table_bucket_init init_func);
 #define hash_table_find(ht, key) hash_table_find_with_add((ht), (key), NULL)
+const char *hash_table_find_key(struct hash_table *ht, const char *key);
 #define hash_table_reset(ht) do { (ht)->current = 0; } while (0)
 #define hash_table_next(ht) do { (ht)->current++; } while (0)
 void *hash_table_current(struct hash_table *ht);
@@ -1,8 +1,7 @@
-#define _XOPEN_SOURCE 500       /* required by nftw */
-#define _POSIX_C_SOURCE 200112L /* required by posix_fadvise */
+#define _XOPEN_SOURCE 500       /* required by realpath */
+#define _POSIX_C_SOURCE 200809L /* required by AT_FDCWD */
 
 #include <fcntl.h>
-#include <unistd.h>
 #include <ctype.h>
 #include <stdio.h>
 #include <getopt.h>
@@ -10,491 +9,436 @@
 #include <string.h>
 #include <stdlib.h>
 #include <limits.h>
-#include <libgen.h>
-#include <fnmatch.h>
-#include <ftw.h>
-
-#include "ini.h"
+#include <unistd.h>
 
 #include "error.h"
-#include "sq_list.h"
-#include "hash.h"
-#include "hcc.h"
-
-#include "comment_defs_string.c"
+#include "archive.h"
+#include "rollup.h"
+#include "spill.h"
+#include "sched.h"
+#include "estimate.h"
+#include "progress.h"
+#include "snapshot.h"
+#include "checkpoint.h"
+#include "git.h"
+#include "history.h"
+#include "nice_io.h"
+#include "blob_cache.h"
+#include "manifest.h"
+#include "out.h"
+#include "libhcc.h"
 
 static boolean show_comment_defs = FALSE;
 static boolean verbose = FALSE;
-static int exclude_list_size = 0;
-static struct {
-  int lang;
-  int pattern;
-  int comment;
-  int filename;
-} field_width;
+static boolean by_dir = FALSE;
+static int by_dir_depth = ROLLUP_UNLIMITED_DEPTH;
+static int output_format = FORMAT_TABLE;
 
-#ifdef DEBUG
-static boolean debug = FALSE;
-#endif
-
-static struct hash_table *lang_comment_table;
-static struct sq_list lang_pattern_list;
+static struct hcc_context *ctx;
 static struct sq_list line_counter_list;
-static struct sq_list exclude_list;
+static size_t mem_limit = 0;
+static boolean sort_by_path = FALSE;
+static boolean spill_results = FALSE;
+static struct spill file_results;
+static struct hash_table *lang_counter_table;
+static struct sq_list dir_rollup_list;
+static int jobs = 1;
+static boolean largest_first = TRUE;
+static int lookahead = DEFAULT_SCHED_LOOKAHEAD;
+static struct sched scheduler;
+static boolean share_dir_fds = FALSE;
+static struct read_buffers read_buffers; /* of the main thread */
+static boolean dedup_inodes = FALSE;
+static char *trace_file = NULL;
+static double estimate_error = 0;
+static struct estimate estimator;
+static struct trace tracer;
+static struct inode_set seen_inodes;
+static double progress_interval = 0;
+static double time_budget = 0;
+static struct progress progress;
+static char *save_file = NULL;
+static char save_base[PATH_MAX+2];
+static int save_base_len = -1;
+static char *checkpoint_path = NULL;
+static boolean resume = FALSE;
+static double checkpoint_interval = DEFAULT_CHECKPOINT_INTERVAL;
+static struct checkpoint checkpoint;
+static boolean count_stdin = FALSE;
+static char *stdin_name = NULL;
+static char *stdin_lang = NULL;
+static char *git_rev = NULL;
+static char *git_history = NULL;
+static boolean first_parent = FALSE;
+static boolean nice_io = FALSE;
+static char *blob_cache_dir = NULL;
+static struct blob_cache blob_cache;
+static char *manifest_file = NULL;
+static struct manifest manifest;
+static int failed_roots = 0;    /* manifest roots not counted in full */
+static struct throttle byte_rate;
+static struct throttle file_rate;
+/* guards the results above once workers run */
+static pthread_mutex_t result_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* a file handed to a worker, whatever needs the walker's directory is resolved up front */
+struct file_job {
+  char *filename;
+  struct walk_fd *dir;          /* name is opened relative to it, filename itself when NULL */
+  const char *name;
+  off_t size;
+  struct path_node *path;
+  struct dir_rollup *rollup;
+  struct ckpt_node *ckpt;
+};
 
-static struct sq_list *find_comment_list(const char *filename, char **lang) {
-  struct lang_match_pattern *lang_pattern;
+static int create_line_counter(struct bucket *bktp, const char *key) {
+  char *lang_key;
+  struct line_counter *counter;
 
-  list_reset(&lang_pattern_list);
-  while ((lang_pattern = (struct lang_match_pattern *) list_current(&lang_pattern_list))) {
-    if (0 == fnmatch(lang_pattern->pattern, filename, 0)) {
-      struct sq_list *comment_list;
+  if (!(counter = calloc(1, sizeof(struct line_counter)))) {
+    return -1;
+  }
 
-      comment_list = (struct sq_list *) hash_table_find(lang_comment_table, lang_pattern->lang);
-      if (!comment_list) {
-        error(EXIT_FAILURE, "Cannot find language: %s comment list", lang_pattern->lang);
-      }
+  if (!(lang_key = strdup(key))) {
+    free(counter);
+    return -1;
+  }
 
-      *lang = lang_pattern->lang;
+  bktp->key = lang_key;
+  bktp->value = counter;
 
-      return comment_list;
-    }
+  return 0;
+}
 
-    list_next(&lang_pattern_list);
+static void add_line_metrics(struct line_metrics *to, const struct line_metrics *from) {
+  to->bytes += from->bytes;
+  to->line_len_sum += from->line_len_sum;
+  to->trailing_space_lines += from->trailing_space_lines;
+  to->tab_indent_lines += from->tab_indent_lines;
+  if (from->max_line_len > to->max_line_len) {
+    to->max_line_len = from->max_line_len;
   }
-
-  return NULL;
 }
 
-enum {
-  COUNTER_COMMENT,
-  COUNTER_BLANK,
-  COUNTER_CODE,
-};
+/*
+ * Fold a counted file into its language total right away, the per file
+ * result is only kept when it is going to be printed. path may be NULL,
+ * rollup is NULL unless by directory totals are wanted.
+ */
+static void record_line_counter(const struct line_counter *counter, struct path_node *path, const char *filename, struct dir_rollup *rollup) {
+  struct line_counter *lang_counter;
 
-#define update_counter(type, counter)           \
-  do {                                          \
-    switch (type) {                             \
-    case COUNTER_COMMENT:                       \
-      (counter)->comment_lines++;               \
-      break;                                    \
-    case COUNTER_BLANK:                         \
-      (counter)->blank_lines++;                 \
-      break;                                    \
-    case COUNTER_CODE:                          \
-      (counter)->code_lines++;                  \
-      break;                                    \
-    }                                           \
-  } while (0)
-
-static void count_line(int fd, struct sq_list *comment_list, struct line_counter *counter) {
-  char buf[MAX_COMMENT_SIZE + BUFFER_SIZE], *read_buf;
-  ssize_t bytes_read, pos;
-  boolean in_code = FALSE, in_comment = FALSE, end_comment = FALSE;
-  struct comment *cp;
+  pthread_mutex_lock(&result_lock);
 
-#ifdef DEBUG
-  int line_start_pos = 0;
-  int incomplete_line_len = 0;
-  char *incomplete_line_buf = NULL;
-
-#define print_scan_line(C)                                              \
-  do {                                                                  \
-    if (debug) {                                                        \
-      putchar(C);                                                       \
-      if (incomplete_line_len) {                                        \
-        if (!fwrite(incomplete_line_buf, 1, incomplete_line_len, stdout)) { \
-          error(EXIT_FAILURE, "Cannot write incomplete line buffer");   \
-        }                                                               \
-        incomplete_line_len = 0;                                        \
-      }                                                                 \
-      if (!fwrite(read_buf + line_start_pos, 1, pos - line_start_pos + 1, stdout)) { \
-        error(EXIT_FAILURE, "Cannot print debug line");                 \
-      }                                                                 \
-      line_start_pos = pos + 1;                                         \
-    }                                                                   \
-  } while (0)
-#else
-#define print_scan_line(c)
-#endif
+  if (!(lang_counter = (struct line_counter *) hash_table_find_with_add(lang_counter_table, counter->lang, create_line_counter))) {
+    error(EXIT_FAILURE, "Cannot alloc line counter");
+  }
 
-  read_buf = &buf[MAX_COMMENT_SIZE];
-  while ((bytes_read = read(fd, read_buf, BUFFER_SIZE))) {
-    if (bytes_read == -1) {
-      error(EXIT_FAILURE, "Read file %s error", counter->filename);
-    }
+  lang_counter->lang = counter->lang;
+  lang_counter->blank_lines += counter->blank_lines;
+  lang_counter->code_lines += counter->code_lines;
+  lang_counter->comment_lines += counter->comment_lines;
+  add_line_metrics(&lang_counter->metrics, &counter->metrics);
 
-    pos = pos < 0 ? pos : 0;
-    while (pos < bytes_read) {
-      if (in_code) {
-        if (read_buf[pos] == '\n') {
-          update_counter(COUNTER_CODE, counter);
-          /* set in_code to FALSE in order to test next line type */
-          in_code = FALSE;
+  if ((verbose || save_file) && spill_results) {
+    spill_add(&file_results, filename, counter);
+  } else if (verbose) {
+    struct line_counter *file_counter;
 
-          print_scan_line(' ');
-        }
-        pos++;
-      } else if (in_comment) {
-        if (cp->end.len && cp->end.val[0] == read_buf[pos]) { /* comment block and first end comment char is match with current pos */
-          int bytes_left = bytes_read - pos;
-          int len = bytes_left < cp->end.len ? bytes_left : cp->end.len;
-
-          if (!strncmp(cp->end.val, read_buf + pos, len)) {
-            if (bytes_left < cp->end.len) { /* partial match */
-#ifdef DEBUG
-              {
-                char buf[MAX_COMMENT_SIZE];
-                struct comment_str *str = &cp->end;
+    if (!path && !(path = path_node_new(NULL, filename, strlen(filename)))) {
+      error(EXIT_FAILURE, "Cannot alloc path node");
+    }
+
+    if (!(file_counter = malloc(sizeof(struct line_counter)))) {
+      error(EXIT_FAILURE, "Cannot alloc line_counter");
+    }
 
-                strncpy(buf, str->val, str->len);
-                buf[str->len] = '\0';
+    *file_counter = *counter;
+    file_counter->path = path;
 
-                printf("Partial match with %s\n", buf);
-              }
-#endif
-              strncpy(read_buf - len, read_buf + pos, len);
-              pos = -len;
-
-              break;            /* refill buffer */
-            }
-
-            end_comment = TRUE;
-            pos += len;
-          } else {
-            pos++;
-          }
-        } else if (read_buf[pos] == '\n') {
-          update_counter(COUNTER_COMMENT, counter);
-
-          if (end_comment) {
-            in_comment = end_comment = FALSE;
-          } else if (!cp->end.len) {   /* inline comment */
-            in_comment = FALSE;
-          }
-
-          print_scan_line('C');
-
-          pos++;
-        } else if (!isspace(read_buf[pos])) { /* not a space charactor */
-          if (end_comment) {                  /* when non-space charactor follows then end of comment, re-check */
-            in_comment = end_comment = FALSE;
-          } else {
-            pos++;
-          }
-        } else {
-          pos++;
-        }
-      } else {
-        if (read_buf[pos] == '\n') {
-          update_counter(COUNTER_BLANK, counter);
+    if (list_append(&line_counter_list, (void *) file_counter)) {
+      error(EXIT_FAILURE, "Cannot append line counter");
+    }
+  }
 
-          print_scan_line('B');
+  if (rollup) {
+    dir_rollup_add(rollup, counter);
+  }
 
-          pos++;
-        } else if (!isspace(read_buf[pos])) { /* not space charactor */
-          int bytes_left = bytes_read - pos, bytes_match = 0;
+  pthread_mutex_unlock(&result_lock);
+}
 
-          list_reset(comment_list);
-          while ((cp = (struct comment *) list_current(comment_list))) {
-            int len = bytes_left < cp->start.len ? bytes_left : cp->start.len;
+/* the walk only stats files when sizes are asked for, -1 otherwise */
+static off_t entry_size(const struct walk_entry *entry) {
+  return entry && entry->stat_mask & WALK_STAT_SIZE ? entry->size : -1;
+}
 
-            if (!strncmp(cp->start.val, read_buf + pos, len)) {
-              bytes_match = len;
-              if (bytes_left < cp->start.len) { /* partial match */
-#ifdef DEBUG
-                {
-                  char buf[MAX_COMMENT_SIZE];
-                  struct comment_str *str = &cp->start;
+/* the node a verbose result is printed with, NULL when paths are kept flat */
+static struct path_node *entry_path_node(const struct walk_entry *entry) {
+  struct path_node *path;
 
-                  strncpy(buf, str->val, str->len);
-                  buf[str->len] = '\0';
+  if (!verbose || spill_results) {
+    return NULL;
+  }
 
-                  printf("Partial match with %s\n", buf);
-                }
-#endif
-                strncpy(read_buf - len, read_buf + pos, len);
-                pos = -len;
-              } else {
-                in_comment = TRUE;
-              }
-
-              break;
-            }
-            list_next(comment_list);
-          }
-
-          if (!in_comment) {
-            if (pos < 0) {      /* partial match, refill buffer */
-              break;
-            } else {
-              in_code = TRUE;
-            }
-          }
-
-          pos += (bytes_match ? bytes_match : 1);
-        } else {                /* is white space charactor */
-          pos++;
-        }
-      }
-    }
+  if (!(path = path_node_new(walk_entry_dir_node(entry), entry->name, strlen(entry->name)))) {
+    error(EXIT_FAILURE, "Cannot alloc path node");
+  }
 
-#ifdef DEBUG
-    if (debug) {
-      if (read_buf[pos] != '\n') {
-        int len = pos - line_start_pos + 1;
-        char *buf;
-
-        if (incomplete_line_len) {
-          if (!(incomplete_line_buf = realloc(incomplete_line_buf, incomplete_line_len + len))) {
-            error(EXIT_FAILURE, "Cannot realloc incomplete line buffer");
-          }
-
-          buf = incomplete_line_buf + incomplete_line_len;
-        } else {
-          if (incomplete_line_buf && incomplete_line_len < len) {
-            free(incomplete_line_buf);
-            incomplete_line_buf = NULL;
-          }
-
-          if (!incomplete_line_buf) {
-            if(!(incomplete_line_buf = malloc(len))) {
-              error(EXIT_FAILURE, "Cannot alloc incomplete line buffer");
-            }
-          }
-
-          buf = incomplete_line_buf;
-        }
+  return path;
+}
 
-        memcpy(buf, read_buf + line_start_pos, len);
-        incomplete_line_len += len;
-      }
+static struct dir_rollup *entry_dir_rollup(const struct walk_entry *entry) {
+  struct dir_rollup *rollup;
 
-      line_start_pos = 0;
-    }
-#endif
+  if (!by_dir) {
+    return NULL;
   }
 
-#ifdef DEBUG
-  if (incomplete_line_buf) {
-    free(incomplete_line_buf);
-  }
-#endif
-}
+  pthread_mutex_lock(&result_lock);
+  rollup = dir_rollup_get(entry->dir, by_dir_depth, &dir_rollup_list);
+  pthread_mutex_unlock(&result_lock);
 
-static void scan_file(const char *filename) {
-  int fd;
-  char *lang, *pathname, *exclude_pattern;
-  int len;
-  struct sq_list *comment_list;
-  struct line_counter *counter;
+  return rollup;
+}
 
-  list_reset(&exclude_list);
-  while ((exclude_pattern = (char *) list_current(&exclude_list))) {
-    if (!fnmatch(exclude_pattern, filename, 0)) {
-      return;
-    }
-    list_next(&exclude_list);
+static void trace_phase(const char *name, const char *path, long long start) {
+  if (trace_file) {
+    trace_span(&tracer, "phase", name, path, start, trace_now(), -1);
   }
+}
 
-  if (!(comment_list = find_comment_list(filename, &lang))) {
+/* return TRUE when the file is counted, errors are fatal */
+static boolean check_count_status(int status, const char *filename) {
+  switch (status) {
+  case HCC_OK:
+    return TRUE;
+  case HCC_EXCLUDED:
+    return FALSE;
+  case HCC_SKIPPED:
     if (verbose) fprintf(stderr, "No matched language found, skip count file: %s\n", filename);
-    return;
+    return FALSE;
+  case HCC_ERR_OPEN:
+    error(EXIT_FAILURE, "Cannot open file: %s", filename);
+  case HCC_ERR_READ:
+    error(EXIT_FAILURE, "Read file %s error", filename);
+  default:
+    error(EXIT_FAILURE, "%s: %s", hcc_strerror(status), filename);
   }
 
-  if (!(counter = malloc(sizeof(struct line_counter)))) {
-    error(EXIT_FAILURE, "Cannot alloc line_counter");
-  }
+  return FALSE;
+}
 
-  len = strlen(filename);
-  if (!(pathname = malloc(len + 1))) {
-    error(EXIT_FAILURE, "Cannot alloc pathname");
-  }
+static void scan_archive_member(const char *name, stream_reader reader, void *stream, void *unused) {
+  struct line_counter counter;
 
-  if (verbose) {
-    field_width.filename = len;
+  if (!check_count_status(hcc_count_stream(ctx, reader, stream, -1, name, NULL, &counter), name)) {
+    return;
   }
 
-  strncpy(pathname, filename, len);
-  pathname[len] = '\0';
-  counter->filename = pathname;
-  counter->lang = lang;
-  counter->blank_lines = 0;
-  counter->code_lines = 0;
-  counter->comment_lines = 0;
+  if (estimate_error) {
+    estimate_add_exact(&estimator, &counter);
+  } else {
+    progress_add(&progress, 0);
+    record_line_counter(&counter, NULL, name, NULL);
+    /* the archive itself is done once all of its members are */
+    if (checkpoint_path) {
+      checkpoint_file(&checkpoint, NULL, NULL, &counter);
+    }
+  }
+}
 
-  list_append(&line_counter_list, (void *) counter);
+/* stdin may be a pipe, its size is only known when a file is redirected */
+static void count_stdin_stream() {
+  const char *name = stdin_name ? stdin_name : "-";
+  struct line_counter counter;
+  struct stat sb;
+  off_t size = -1, pos;
+  int status;
 
-  fd = open(filename, O_RDONLY);
-  if (fd == -1) {
-    error(EXIT_FAILURE, "Cannot open file: %s", filename);
+  if (!fstat(STDIN_FILENO, &sb) && S_ISREG(sb.st_mode) && (pos = lseek(STDIN_FILENO, 0, SEEK_CUR)) != -1) {
+    size = sb.st_size - pos;
   }
 
-  posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
-
-  count_line(fd, comment_list, counter);
+  status = hcc_count_fd(ctx, STDIN_FILENO, size, name, stdin_lang, &counter);
 
-  close(fd);
-}
+  if (status == HCC_ERR_LANG) {
+    fprintf(stderr, "Error: unknown language: %s\n", stdin_lang);
+    exit(EXIT_FAILURE);
+  } else if (status == HCC_SKIPPED) {
+    fprintf(stderr, "Error: no language matched stdin, give one with --lang: %s\n", name);
+    exit(EXIT_FAILURE);
+  }
 
-static int count_for_file(const char *fpath, const struct stat *sb, int typeflag, struct FTW *ftwbuf) {
-  if (typeflag == FTW_F) {
-    scan_file(fpath);
+  if (check_count_status(status, name)) {
+    record_line_counter(&counter, NULL, name, NULL);
   }
-  return 0;
+  progress_add(&progress, size > 0 ? size : 0);
 }
 
-#define lang_str_cpy(dest, lang_str)                    \
-  do {                                                  \
-    (dest) = malloc(MAX_LANG_SIZE + 1);                 \
-    if (!(dest)) {                                      \
-      error(EXIT_FAILURE, "Cannot alloc lang key");     \
-    }                                                   \
-                                                        \
-    strncpy((dest), (lang_str), MAX_LANG_SIZE + 1);     \
-  } while (0)
-
-static void create_comment_list(struct bucket *bktp, const char *key) {
-  char *lang_key;
-  struct sq_list *comment_list;
+static int count_git_blob(const char *name, const unsigned char *oid, const char *buf, size_t len, void *unused) {
+  struct line_counter counter;
 
-  if (!(comment_list = malloc(sizeof(struct sq_list)))) {
-    error(EXIT_FAILURE, "Cannot alloc comment list");
+  /* a blob stands for a file of the rates */
+  if (ctx->read_opts.file_rate) {
+    throttle_take(ctx->read_opts.file_rate, 1);
+  }
+  if (ctx->read_opts.byte_rate) {
+    throttle_take(ctx->read_opts.byte_rate, len);
   }
 
-  init_sq_list(comment_list, INIT_LANG_COMMENT_LIST_SIZE);
+  if (check_count_status(hcc_count_buffer_rb(ctx, &read_buffers, buf, len, name, NULL, &counter), name)) {
+    record_line_counter(&counter, NULL, name, NULL);
+  }
+  progress_add(&progress, len);
 
-  lang_str_cpy(lang_key, key);
-  bktp->key = lang_key;
-  bktp->value = comment_list;
+  return progress.expired;
 }
 
-static struct comment *create_comment_from_string(const char *str) {
-  struct comment *comment;
-  int str_len;
-  char *cpy, *p;
+/* the blobs of the revision are counted in memory, there is no checkout */
+static void count_git_rev(const char *path) {
+  struct git_repo repo;
 
-  str_len = strlen(str);
-
-  if (!(cpy = malloc(str_len))) {
-    error(EXIT_FAILURE, "Cannot alloc comment string");
+  /* snapshots of two revisions have the same paths */
+  if (save_file) {
+    save_base_len = snprintf(save_base, sizeof(save_base), "%s%c", git_rev, GIT_REV_SEP);
   }
 
-  if (!(comment = malloc(sizeof(struct comment)))) {
-    error(EXIT_FAILURE, "Cannot alloc comment");
-  }
+  git_open(&repo, path);
+  git_scan_rev(&repo, git_rev, count_git_blob, NULL);
+  git_close(&repo);
+}
 
-  strncpy(cpy, str, str_len);
+/* the walk stops once the time budget is spent */
+static int count_for_file(const struct hcc_file *file, void *unused) {
+  const struct walk_entry *entry = file->entry;
+  struct ckpt_node *node = checkpoint_path ? (struct ckpt_node *) entry->dir->data : NULL;
+  boolean counted;
 
-  /* TODO: trim leading & trailing space charactors first */
+  /* counted before the run was resumed */
+  if (checkpoint_path && checkpoint_skip(&checkpoint, node, file->filename)) {
+    return progress.expired;
+  }
 
-  p = strchr(cpy, ' ');
-  if (p) {
-    int start_len = p - cpy;
+  progress_add(&progress, entry_size(entry) > 0 ? entry_size(entry) : 0);
 
-    comment->start.len = start_len;
-    comment->start.val = cpy;
-    comment->end.len = str_len - start_len - 1;
-    comment->end.val = p + 1;
-  } else {
-    comment->start.len = str_len;
-    comment->start.val = cpy;
-    comment->end.len = 0;
-    comment->end.val = NULL;
+  if ((counted = check_count_status(file->status, file->filename))) {
+    record_line_counter(file->counter, entry_path_node(entry), file->filename, entry_dir_rollup(entry));
+  }
+
+  if (checkpoint_path) {
+    checkpoint_file(&checkpoint, node, file->filename, counted ? file->counter : NULL);
+    checkpoint_tick(&checkpoint);
   }
 
-  return comment;
+  return progress.expired;
 }
 
-#define strtolower(str)                         \
-  do {                                          \
-    char *p = str;                              \
-    while ((*p)) {                              \
-      (*p) = tolower((*p));                     \
-      p++;                                      \
-    }                                           \
-  } while (0)
+/* every worker reads with buffers of its own, kept from job to job */
+static void *worker_init(void *unused) {
+  struct read_buffers *rb;
 
-static int build_comment_def(void* unused, const char* lang, const char* name, const char* value) {
-  char clang[MAX_LANG_SIZE + 1];
+  if (!(rb = malloc(sizeof(struct read_buffers)))) {
+    error(EXIT_FAILURE, "Cannot alloc read buffers");
+  }
+  init_read_buffers(rb, &ctx->read_opts);
 
-  strncpy(clang, lang, MAX_LANG_SIZE);
-  clang[MAX_LANG_SIZE] = '\0';
+  return rb;
+}
 
-  strtolower(clang);
+static void worker_fini(void *state, void *unused) {
+  free_read_buffers((struct read_buffers *) state);
+  free(state);
+}
 
-  if (show_comment_defs) {
-    field_width.lang = strlen(clang);
-  }
+static void count_job(void *job, void *state) {
+  struct file_job *file_job = (struct file_job *) job;
+  struct read_buffers *rb = (struct read_buffers *) state;
+  struct line_counter counter;
+  int status;
 
-  if (!strcmp(name, "pattern")) {
-    struct lang_match_pattern *lang_pattern;
-    char *buf, *pattern;
-    int len;
+  /* queued files are dropped once the time budget is spent, they stay pending in a checkpoint */
+  if (!progress.expired) {
+    boolean counted;
 
-    if (!(lang_pattern = malloc(sizeof(struct lang_match_pattern)))) {
-      error(EXIT_FAILURE, "Cannot alloc lang match pattern");
+    status = hcc_count_file_rb(ctx, rb, file_job->dir ? file_job->dir->fd : AT_FDCWD, file_job->name, file_job->size,
+                               file_job->filename, &counter);
+    if ((counted = check_count_status(status, file_job->filename))) {
+      record_line_counter(&counter, file_job->path, file_job->filename, file_job->rollup);
     }
+    progress_add(&progress, file_job->size > 0 ? file_job->size : 0);
 
-    len = strlen(value);
-    if (!(pattern = malloc(sizeof(len + 1)))) {
-      error(EXIT_FAILURE, "Cannot alloc pattern string");
+    if (checkpoint_path) {
+      checkpoint_file(&checkpoint, file_job->ckpt, file_job->filename, counted ? &counter : NULL);
+      checkpoint_release(&checkpoint, file_job->ckpt);
     }
+  }
 
-    lang_str_cpy(buf, clang);
-    strncpy(pattern, value, len);
-    pattern[len] = '\0';
-
-    lang_pattern->lang = buf;
-    lang_pattern->pattern = pattern;
+  if (file_job->dir) {
+    walk_fd_release(file_job->dir);
+  }
+  free(file_job->filename);
+  free(file_job);
+}
 
-    list_append(&lang_pattern_list, lang_pattern);
+/* name is the last part of filename, in dir when it is not NULL */
+static void submit_file(const char *filename, struct walk_fd *dir, const char *name, off_t size,
+                        struct path_node *path, struct dir_rollup *rollup, struct ckpt_node *ckpt) {
+  struct file_job *file_job;
 
-    if (show_comment_defs) {
-      field_width.pattern = len;
-    }
-  } else if (!strcmp(name, "comment")) {
-    struct sq_list *comment_list;
+  if (!(file_job = malloc(sizeof(struct file_job))) || !(file_job->filename = strdup(filename))) {
+    error(EXIT_FAILURE, "Cannot alloc file job");
+  }
 
-    comment_list = (struct sq_list *) hash_table_find_with_add(lang_comment_table, clang, create_comment_list);
-    list_append(comment_list, (void *) create_comment_from_string(value));
+  file_job->dir = dir;
+  file_job->name = dir ? file_job->filename + strlen(filename) - strlen(name) : file_job->filename;
+  file_job->size = size;
+  file_job->path = path;
+  file_job->rollup = rollup;
+  file_job->ckpt = ckpt;
 
-    if (show_comment_defs) {
-      field_width.comment = strlen(value);
-    }
-  } else {
-    error(EXIT_FAILURE, "Unknown comment definition field name");
+  if (checkpoint_path) {
+    checkpoint_expect(&checkpoint, ckpt);
   }
 
-  return 1;
+  progress_expect(&progress, size > 0 ? size : 0);
+  sched_submit(&scheduler, file_job, size);
 }
 
-static void display_comment_defs_detail() {
-  struct lang_match_pattern *lang_pattern;
-  int lang_width, pattern_width, comment_width;
-  char *format;
-
-  lang_width = (sizeof("LANGUAGE") > field_width.lang ? sizeof("LANGUAGE") : field_width.lang) + GAP_WIDTH;
-  pattern_width = (sizeof("PATTERN") > field_width.pattern ? sizeof("PATTERN") : field_width.pattern) + GAP_WIDTH;
-  comment_width = sizeof("COMMENT") > field_width.comment ? sizeof("COMMENT") : field_width.comment;
+/* walk callback with workers, files are only queued here */
+static int dispatch_file(const struct walk_entry *entry, void *unused) {
+  struct ckpt_node *node = checkpoint_path ? (struct ckpt_node *) entry->dir->data : NULL;
 
-  if (!(format = malloc(lang_width + pattern_width + comment_width + 1))) {
-    error(EXIT_FAILURE, "Cannot alloc format string buffer");
+  if (progress.expired) {
+    return 1;
   }
 
-  format[lang_width+pattern_width+comment_width] = '\0';
-  if (0 > sprintf(format, "%%-%ds%%-%ds%%-%ds\n", lang_width, pattern_width, comment_width)) {
-    error(EXIT_FAILURE, "Cannot generat format string");
+  if (checkpoint_path) {
+    if (checkpoint_skip(&checkpoint, node, entry->path)) {
+      return 0;
+    }
+    checkpoint_tick(&checkpoint);
   }
 
-  printf(format, "LANGUAGE", "PATTERN", "COMMENT");
+  /* the directory stays open for the job, or the file is opened by its path */
+  submit_file(entry->path, share_dir_fds ? walk_dir_fd(entry->dir) : NULL, entry->name, entry_size(entry),
+              entry_path_node(entry), entry_dir_rollup(entry), node);
+
+  return 0;
+}
+
+static void display_lang_match_list(struct sq_list *match_list, const char *prefix, const char *format) {
+  struct lang_match_pattern *lang_pattern;
+  char pattern[PATTERN_MAX];
 
-  list_reset(&lang_pattern_list);
-  while ((lang_pattern = (struct lang_match_pattern *) list_current(&lang_pattern_list))) {
+  list_reset(match_list);
+  while ((lang_pattern = (struct lang_match_pattern *) list_current(match_list))) {
     struct sq_list *comment_list;
     struct comment *comment;
 
-    comment_list = (struct sq_list *) hash_table_find(lang_comment_table, lang_pattern->lang);
+    comment_list = hcc_find_comment_list(ctx, lang_pattern->lang);
+    snprintf(pattern, PATTERN_MAX, "%s%s", prefix, lang_pattern->pattern);
 
     list_reset(comment_list);
     while ((comment = (struct comment *) list_current(comment_list))) {
@@ -515,7 +459,7 @@ static void display_comment_defs_detail() {
       buf[len] = '\0';
 
       if (comment_list->current == 0) {
-        printf(format, lang_pattern->lang, lang_pattern->pattern, buf);
+        printf(format, lang_pattern->lang, pattern, buf);
       } else {
         printf(format, "", "", buf);
       }
@@ -523,34 +467,283 @@ static void display_comment_defs_detail() {
       list_next(comment_list);
     }
 
-    list_next(&lang_pattern_list);
+    list_next(match_list);
   }
 }
 
-static void create_line_counter(struct bucket *bktp, const char *key) {
-  char *lang_key;
-  struct line_counter *counter;
+static void display_comment_defs_detail() {
+  int lang_width, pattern_width, comment_width;
+  char *format;
 
-  if (!(counter = calloc(1, sizeof(struct line_counter)))) {
-    error(EXIT_FAILURE, "Cannot alloc line counter");
+  lang_width = (sizeof("LANGUAGE") > ctx->defs_width.lang ? sizeof("LANGUAGE") : ctx->defs_width.lang) + GAP_WIDTH;
+  pattern_width = (sizeof("PATTERN") > ctx->defs_width.pattern ? sizeof("PATTERN") : ctx->defs_width.pattern) + GAP_WIDTH;
+  comment_width = sizeof("COMMENT") > ctx->defs_width.comment ? sizeof("COMMENT") : ctx->defs_width.comment;
+
+  if (!(format = malloc(lang_width + pattern_width + comment_width + 1))) {
+    error(EXIT_FAILURE, "Cannot alloc format string buffer");
   }
 
-  lang_str_cpy(lang_key, key);
-  bktp->key = lang_key;
-  bktp->value = counter;
+  format[lang_width+pattern_width+comment_width] = '\0';
+  if (0 > sprintf(format, "%%-%ds%%-%ds%%-%ds\n", lang_width, pattern_width, comment_width)) {
+    error(EXIT_FAILURE, "Cannot generat format string");
+  }
+
+  printf(format, "LANGUAGE", "PATTERN", "COMMENT");
+
+  display_lang_match_list(&ctx->lang_pattern_list, "", format);
+  display_lang_match_list(&ctx->lang_interpreter_list, "#!", format);
+  display_lang_match_list(&ctx->lang_modeline_list, "mode:", format);
+}
+
+static void print_csv_field(const char *str) {
+  if (strpbrk(str, ",\"\n")) {
+    putchar('"');
+    for (; *str; str++) {
+      if (*str == '"') {
+        putchar('"');
+      }
+      putchar(*str);
+    }
+    putchar('"');
+  } else {
+    fputs(str, stdout);
+  }
+}
+
+/* mean line length without the line end, in code units like MAX LINE */
+static double average_line_len(const struct line_counter *counter) {
+  long lines = counter->code_lines + counter->comment_lines + counter->blank_lines;
+
+  return lines ? (double) counter->metrics.line_len_sum / lines : 0;
+}
+
+#define CSV_HEADER "type,name,language,code,comment,blank"
+#define CSV_METRICS_HEADER ",bytes,max_line,avg_line,trailing_space,tab_indent"
+
+static const char *csv_header() {
+  return ctx->metrics ? CSV_HEADER CSV_METRICS_HEADER : CSV_HEADER;
+}
+
+/* a row of type alone, with as many empty fields as the header has columns */
+static void print_csv_type_row(const char *type) {
+  const char *p;
+
+  fputs(type, stdout);
+  for (p = strchr(csv_header(), ','); p; p = strchr(p + 1, ',')) {
+    putchar(',');
+  }
+  putchar('\n');
+}
+
+/* counter holds the metrics of the row, NULL for rows without them, e.g. directories */
+static void print_csv_row(const char *type, const char *name, const char *lang, long code, long comment, long blank,
+                          const struct line_counter *counter) {
+  printf("%s,", type);
+  print_csv_field(name);
+  putchar(',');
+  print_csv_field(lang);
+  printf(",%ld,%ld,%ld", code, comment, blank);
+
+  if (ctx->metrics && counter) {
+    printf(",%lld,%d,%.1f,%d,%d", counter->metrics.bytes, counter->metrics.max_line_len, average_line_len(counter),
+           counter->metrics.trailing_space_lines, counter->metrics.tab_indent_lines);
+  } else if (ctx->metrics) {
+    fputs(",,,,,", stdout);
+  }
+
+  putchar('\n');
+}
+
+#define BYTES_WIDTH (sizeof("BYTES") + GAP_WIDTH)
+#define MAX_LINE_WIDTH (sizeof("MAX LINE") + GAP_WIDTH)
+#define AVG_LINE_WIDTH (sizeof("AVG LINE") + GAP_WIDTH)
+#define TRAILING_SPACE_WIDTH (sizeof("TRAILING SPACE") + GAP_WIDTH)
+
+/* close a table row, with the metrics columns when they are collected, their header when counter is NULL */
+static void end_table_row(const struct line_counter *counter) {
+  if (ctx->metrics && counter) {
+    printf("%-*lld%-*d%-*.1f%-*d%d", (int) BYTES_WIDTH, counter->metrics.bytes, (int) MAX_LINE_WIDTH, counter->metrics.max_line_len,
+           (int) AVG_LINE_WIDTH, average_line_len(counter), (int) TRAILING_SPACE_WIDTH, counter->metrics.trailing_space_lines,
+           counter->metrics.tab_indent_lines);
+  } else if (ctx->metrics) {
+    printf("%-*s%-*s%-*s%-*s%s", (int) BYTES_WIDTH, "BYTES", (int) MAX_LINE_WIDTH, "MAX LINE", (int) AVG_LINE_WIDTH, "AVG LINE",
+           (int) TRAILING_SPACE_WIDTH, "TRAILING SPACE", "TAB INDENT");
+  }
+
+  putchar('\n');
+}
+
+static int dir_rollup_name_width(struct dir_rollup *rollup) {
+  int width, child_width;
+
+  if (rollup->parent) {
+    width = rollup->depth * 2 + rollup->path->len;
+  } else {
+    width = rollup->path->len;
+  }
+
+  for (rollup = rollup->child; rollup; rollup = rollup->next) {
+    if (!rollup->files) {
+      continue;
+    }
+    child_width = dir_rollup_name_width(rollup);
+    width = width > child_width ? width : child_width;
+  }
+
+  return width;
+}
+
+static void print_dir_rollup(struct dir_rollup *rollup, const char *format) {
+  char pathname[PATH_MAX];
+
+  /* queued files get their rollup before it is known whether they count */
+  if (!rollup->files) {
+    return;
+  }
+
+  if (output_format == FORMAT_CSV) {
+    path_node_format(rollup->path, pathname, PATH_MAX);
+    print_csv_row("dir", pathname, "", rollup->code_lines, rollup->comment_lines, rollup->blank_lines, NULL);
+  } else {
+    /* children are indented by depth and only show their basename */
+    if (rollup->parent) {
+      sprintf(pathname, "%*s%s", rollup->depth * 2, "", rollup->path->name);
+    } else {
+      path_node_format(rollup->path, pathname, PATH_MAX);
+    }
+
+    printf(format, pathname, rollup->files, rollup->code_lines, rollup->comment_lines, rollup->blank_lines);
+  }
+
+  for (rollup = rollup->child; rollup; rollup = rollup->next) {
+    print_dir_rollup(rollup, format);
+  }
+}
+
+static void print_dir_rollup_result() {
+  struct dir_rollup *rollup;
+  int dir_width = 0, files_width, code_width, comment_width, blank_width, width;
+  char *format = NULL;
+
+  if (output_format == FORMAT_TABLE) {
+    list_reset(&dir_rollup_list);
+    while ((rollup = (struct dir_rollup *) list_current(&dir_rollup_list))) {
+      width = dir_rollup_name_width(rollup);
+      dir_width = dir_width > width ? dir_width : width;
+      list_next(&dir_rollup_list);
+    }
+
+    dir_width = (sizeof("DIRECTORY") > dir_width ? sizeof("DIRECTORY") : dir_width) + GAP_WIDTH;
+    files_width = sizeof("FILES") + GAP_WIDTH;
+    code_width = sizeof("CODE LINES") + GAP_WIDTH;
+    comment_width = sizeof("COMMENT LINES") + GAP_WIDTH;
+    blank_width = sizeof("BLANK LINES");
+
+    if (!(format = malloc(dir_width + files_width + code_width + comment_width + blank_width + 1))) {
+      error(EXIT_FAILURE, "Cannot alloc format string buffer");
+    }
+
+    if (0 > sprintf(format, "%%-%ds%%-%ds%%-%ds%%-%ds%%-%ds\n", dir_width, files_width, code_width, comment_width, blank_width)) {
+      error(EXIT_FAILURE, "Cannot generate header format string");
+    }
+
+    puts("");
+    printf(format, "DIRECTORY", "FILES", "CODE LINES", "COMMENT LINES", "BLANK LINES");
+
+    if (0 > sprintf(format, "%%-%ds%%-%dd%%-%dld%%-%dld%%-%dld\n", dir_width, files_width, code_width, comment_width, blank_width)) {
+      error(EXIT_FAILURE, "Cannot generate body format string");
+    }
+  }
+
+  list_reset(&dir_rollup_list);
+  while ((rollup = (struct dir_rollup *) list_current(&dir_rollup_list))) {
+    print_dir_rollup(rollup, format);
+    list_next(&dir_rollup_list);
+  }
+
+  free(format);
+}
+
+static void out_csv_field(struct out_writer *out, const char *str) {
+  if (strpbrk(str, ",\"\n")) {
+    out_char(out, '"');
+    for (; *str; str++) {
+      if (*str == '"') {
+        out_char(out, '"');
+      }
+      out_char(out, *str);
+    }
+    out_char(out, '"');
+  } else {
+    out_str(out, str);
+  }
+}
+
+/* the rows of print_csv_row and end_table_row, byte for byte, without stdio as files may be millions */
+static void print_file_result(const char *pathname, const struct line_counter *counter, void *arg) {
+  struct out_writer *out = (struct out_writer *) arg;
+  char avg[32];
+
+  if (ctx->metrics) {
+    snprintf(avg, sizeof(avg), "%.1f", average_line_len(counter));
+  }
+
+  if (output_format == FORMAT_CSV) {
+    out_str(out, "file,");
+    out_csv_field(out, pathname);
+    out_char(out, ',');
+    out_csv_field(out, counter->lang);
+    out_char(out, ',');
+    out_long(out, counter->code_lines, 0);
+    out_char(out, ',');
+    out_long(out, counter->comment_lines, 0);
+    out_char(out, ',');
+    out_long(out, counter->blank_lines, 0);
+
+    if (ctx->metrics) {
+      out_char(out, ',');
+      out_long(out, counter->metrics.bytes, 0);
+      out_char(out, ',');
+      out_long(out, counter->metrics.max_line_len, 0);
+      out_char(out, ',');
+      out_str(out, avg);
+      out_char(out, ',');
+      out_long(out, counter->metrics.trailing_space_lines, 0);
+      out_char(out, ',');
+      out_long(out, counter->metrics.tab_indent_lines, 0);
+    }
+  } else {
+    out_str(out, pathname);
+    out_char(out, '\n');
+    out_left(out, counter->lang, sizeof("LANGUAGE") + GAP_WIDTH);
+    out_long(out, counter->code_lines, sizeof("CODE LINES") + GAP_WIDTH);
+    out_long(out, counter->comment_lines, sizeof("COMMENT LINES") + GAP_WIDTH);
+    out_long(out, counter->blank_lines, sizeof("BLANK LINES") + (ctx->metrics ? GAP_WIDTH : 0));
+
+    if (ctx->metrics) {
+      out_long(out, counter->metrics.bytes, BYTES_WIDTH);
+      out_long(out, counter->metrics.max_line_len, MAX_LINE_WIDTH);
+      out_left(out, avg, AVG_LINE_WIDTH);
+      out_long(out, counter->metrics.trailing_space_lines, TRAILING_SPACE_WIDTH);
+      out_long(out, counter->metrics.tab_indent_lines, 0);
+    }
+  }
+
+  out_char(out, '\n');
+  out_end_row(out);
 }
 
 static void print_result() {
   struct line_counter *file_counter, *lang_counter;
   struct line_counter total_counter;
-  struct hash_table *line_counter_table;
+  char pathname[PATH_MAX];
   int lang_width, blank_width, code_width, comment_width;
   char *format;
 
-  lang_width = (sizeof("LANGUAGE") > field_width.lang ? sizeof("LANGUAGE") : field_width.lang) + GAP_WIDTH;
+  lang_width = sizeof("LANGUAGE") + GAP_WIDTH;
   code_width = sizeof("CODE LINES") + GAP_WIDTH;
   comment_width = sizeof("COMMENT LINES") + GAP_WIDTH;
-  blank_width = sizeof("BLANK LINES");
+  blank_width = sizeof("BLANK LINES") + (ctx->metrics ? GAP_WIDTH : 0);
 
   if (!(format = malloc(lang_width + code_width + comment_width + blank_width + 1))) {
     error(EXIT_FAILURE, "Cannot alloc format string buffer");
@@ -559,105 +752,775 @@ static void print_result() {
   format[lang_width+code_width+comment_width+blank_width] = '\0';
 
   /* header format string */
-  if (0 > sprintf(format, "%%-%ds%%-%ds%%-%ds%%-%ds\n", lang_width, code_width, comment_width, blank_width)) {
+  if (0 > sprintf(format, "%%-%ds%%-%ds%%-%ds%%-%ds", lang_width, code_width, comment_width, blank_width)) {
     error(EXIT_FAILURE, "Cannot generate header format string");
   }
 
-  printf(format, "LANGUAGE", "CODE LINES", "COMMENT LINES", "BLANK LINES");
+  if (output_format == FORMAT_CSV) {
+    puts(csv_header());
+  } else {
+    printf(format, "LANGUAGE", "CODE LINES", "COMMENT LINES", "BLANK LINES");
+    end_table_row(NULL);
+  }
 
   /* body format string */
-  if (0 > sprintf(format, "%%-%ds%%-%dd%%-%dd%%-%dd\n", lang_width, code_width, comment_width, blank_width)) {
+  if (0 > sprintf(format, "%%-%ds%%-%dd%%-%dd%%-%dd", lang_width, code_width, comment_width, blank_width)) {
     error(EXIT_FAILURE, "Cannot generate body format string");
   }
 
-  init_hash_table(&line_counter_table, 8);
-
-  list_reset(&line_counter_list);
-  while ((file_counter = (struct line_counter *) list_current(&line_counter_list))) {
-    lang_counter = (struct line_counter *) hash_table_find_with_add(line_counter_table, file_counter->lang, create_line_counter);
-    lang_counter->lang = file_counter->lang;
-    lang_counter->blank_lines += file_counter->blank_lines;
-    lang_counter->code_lines += file_counter->code_lines;
-    lang_counter->comment_lines += file_counter->comment_lines;
-
-    if (verbose) {
-      puts(file_counter->filename);
-      printf(format, file_counter->lang, file_counter->code_lines, file_counter->comment_lines, file_counter->blank_lines);
+  if (verbose) {
+    struct out_writer out;
+
+    /* the header is still in the stdio buffer */
+    fflush(stdout);
+    out_init(&out, STDOUT_FILENO);
+
+    if (spill_results) {
+      spill_foreach(&file_results, print_file_result, &out);
+    } else {
+      list_reset(&line_counter_list);
+      while ((file_counter = (struct line_counter *) list_current(&line_counter_list))) {
+        path_node_format(file_counter->path, pathname, PATH_MAX);
+        print_file_result(pathname, file_counter, &out);
+        list_next(&line_counter_list);
+      }
     }
 
-    list_next(&line_counter_list);
+    out_close(&out);
   }
 
-  if (verbose) {
+  if (verbose && output_format == FORMAT_TABLE) {
     puts("");
   }
 
-  total_counter.blank_lines = 0;
-  total_counter.code_lines = 0;
-  total_counter.comment_lines = 0;
-  hash_table_reset(line_counter_table);
-  while ((lang_counter = (struct line_counter *) hash_table_current(line_counter_table))) {
+  memset(&total_counter, 0, sizeof(struct line_counter));
+  hash_table_reset(lang_counter_table);
+  while ((lang_counter = (struct line_counter *) hash_table_current(lang_counter_table))) {
     total_counter.blank_lines += lang_counter->blank_lines;
     total_counter.code_lines += lang_counter->code_lines;
     total_counter.comment_lines += lang_counter->comment_lines;
+    add_line_metrics(&total_counter.metrics, &lang_counter->metrics);
 
-    printf(format, lang_counter->lang, lang_counter->code_lines, lang_counter->comment_lines, lang_counter->blank_lines);
+    if (output_format == FORMAT_CSV) {
+      print_csv_row("language", "", lang_counter->lang, lang_counter->code_lines, lang_counter->comment_lines, lang_counter->blank_lines, lang_counter);
+    } else {
+      printf(format, lang_counter->lang, lang_counter->code_lines, lang_counter->comment_lines, lang_counter->blank_lines);
+      end_table_row(lang_counter);
+    }
 
-    hash_table_next(line_counter_table);
+    hash_table_next(lang_counter_table);
   }
 
-  printf(format, "", total_counter.code_lines, total_counter.comment_lines, total_counter.blank_lines);
-}
+  if (output_format == FORMAT_CSV) {
+    print_csv_row("total", "", "", total_counter.code_lines, total_counter.comment_lines, total_counter.blank_lines, &total_counter);
+  } else {
+    printf(format, "", total_counter.code_lines, total_counter.comment_lines, total_counter.blank_lines);
+    end_table_row(&total_counter);
+  }
 
-static void init_data_struct() {
-  init_sq_list(&lang_pattern_list, INIT_PATTERN_LIST_SIZE);
-  init_sq_list(&line_counter_list, INIT_LINE_COUNTER_LIST_SIZE);
-  init_hash_table(&lang_comment_table, INIT_LANG_COMMENT_TABLE_SIZE);
+  if (by_dir) {
+    print_dir_rollup_result();
+  }
 
-  if (exclude_list_size) {
-    init_sq_list(&exclude_list, exclude_list_size);
+  if (progress.expired) {
+    if (output_format == FORMAT_CSV) {
+      print_csv_type_row("partial");
+    } else {
+      printf("\nPartial result, the time budget ran out after %lld files\n", progress.files);
+    }
   }
 }
 
-#define PATTERN_MAX 128
-static void add_exclude_list_from_file(const char *exclude_file) {
-  FILE *stream;
-  char line[PATTERN_MAX];
-
-  if (!(stream = fopen(exclude_file, "r"))) {
-    error(EXIT_FAILURE, "Cannot open exclude file: %s", exclude_file);
+#define COMMIT_ABBREV 12
+
+/* a row per language of every commit, oldest first, the memo makes unchanged blobs and trees free */
+static void count_git_history(const char *path) {
+  int lang_width = sizeof("LANGUAGE") + GAP_WIDTH, code_width = sizeof("CODE LINES") + GAP_WIDTH;
+  int comment_width = sizeof("COMMENT LINES") + GAP_WIDTH, blank_width = sizeof("BLANK LINES") + (ctx->metrics ? GAP_WIDTH : 0);
+  int commit_width = COMMIT_ABBREV + GAP_WIDTH;
+  const struct history_totals *totals;
+  struct history history;
+  struct git_repo repo;
+  unsigned char *commits;
+  char hex[GIT_HEX_SIZE + 1];
+  int i, j, ncommits;
+
+  git_open(&repo, path);
+  ncommits = git_rev_list(&repo, git_history, first_parent, &commits);
+  history_init(&history, ctx, &repo);
+
+  if (output_format == FORMAT_CSV) {
+    puts(csv_header());
+  } else {
+    printf("%-*s%-*s%-*s%-*s%-*s", commit_width, "COMMIT", lang_width, "LANGUAGE", code_width, "CODE LINES",
+           comment_width, "COMMENT LINES", blank_width, "BLANK LINES");
+    end_table_row(NULL);
   }
 
-  while (fgets(line, PATTERN_MAX, stream)) {
-    int len = strlen(line);
-    char *pos, *buf;
-
-    if (len > PATTERN_MAX - 1) {
-      error(EXIT_FAILURE, "Too lang exclude pattern: %s", line);
-    }
+  for (i = 0; i < ncommits; i++) {
+    totals = history_count(&history, commits + (size_t) i * GIT_OID_SIZE);
+    git_oid_hex(commits + (size_t) i * GIT_OID_SIZE, hex);
 
-    if ((pos = strchr(line, '\n'))) {
-      len = pos - line;
-    }
+    for (j = 0; j < totals->nlangs; j++) {
+      const struct line_counter *counter = &totals->langs[j];
 
-    if (!(buf = malloc(len + 1))) {
-      error(EXIT_FAILURE, "Cannot alloc exclude pattern buffer");
+      if (output_format == FORMAT_CSV) {
+        print_csv_row("commit", hex, counter->lang, counter->code_lines, counter->comment_lines, counter->blank_lines, counter);
+      } else {
+        printf("%-*.*s%-*s%-*d%-*d%-*d", commit_width, COMMIT_ABBREV, hex, lang_width, counter->lang, code_width, counter->code_lines,
+               comment_width, counter->comment_lines, blank_width, counter->blank_lines);
+        end_table_row(counter);
+      }
     }
+  }
 
-    strncpy(buf, line, len);
-    buf[len] = '\0';
-    list_append(&exclude_list, buf);
+  if (output_format == FORMAT_TABLE) {
+    printf("\n%d commits, %lld blobs counted, %lld trees read\n", ncommits, history.blobs_counted, history.trees_read);
   }
+
+  history_free(&history);
+  free(commits);
+  git_close(&repo);
 }
 
-static void usage() {
+/* running totals, printed by the progress thread on SIGUSR1 */
+static void print_snapshot(FILE *out, void *unused) {
+  struct line_counter *lang_counter;
+  int lang_width = sizeof("LANGUAGE") + GAP_WIDTH, code_width = sizeof("CODE LINES") + GAP_WIDTH;
+  int comment_width = sizeof("COMMENT LINES") + GAP_WIDTH;
+  long code = 0, comment = 0, blank = 0;
+
+  pthread_mutex_lock(&result_lock);
+
+  fprintf(out, "%-*s%-*s%-*s%s\n", lang_width, "LANGUAGE", code_width, "CODE LINES", comment_width, "COMMENT LINES", "BLANK LINES");
+
+  hash_table_reset(lang_counter_table);
+  while ((lang_counter = (struct line_counter *) hash_table_current(lang_counter_table))) {
+    code += lang_counter->code_lines;
+    comment += lang_counter->comment_lines;
+    blank += lang_counter->blank_lines;
+
+    fprintf(out, "%-*s%-*d%-*d%d\n", lang_width, lang_counter->lang, code_width, lang_counter->code_lines,
+            comment_width, lang_counter->comment_lines, lang_counter->blank_lines);
+    hash_table_next(lang_counter_table);
+  }
+
+  fprintf(out, "%-*s%-*ld%-*ld%ld\n", lang_width, "", code_width, code, comment_width, comment, blank);
+
+  pthread_mutex_unlock(&result_lock);
+}
+
+#define ESTIMATE_FIELD_SIZE 48
+
+static void print_estimate_row(const char *type, const char *lang, const struct estimate_lang *result, int lang_width, int width) {
+  char field[ESTIMATE_METRICS][ESTIMATE_FIELD_SIZE];
+  int k;
+
+  if (output_format == FORMAT_CSV) {
+    printf("%s,,", type);
+    print_csv_field(lang);
+    printf(",%.0f,%.0f,%.0f,%.0f,%.0f,%.0f\n", result->value[ESTIMATE_CODE], result->value[ESTIMATE_COMMENT], result->value[ESTIMATE_BLANK],
+           result->ci[ESTIMATE_CODE], result->ci[ESTIMATE_COMMENT], result->ci[ESTIMATE_BLANK]);
+    return;
+  }
+
+  for (k = 0; k < ESTIMATE_METRICS; k++) {
+    snprintf(field[k], ESTIMATE_FIELD_SIZE, "%.0f +-%.0f", result->value[k], result->ci[k]);
+  }
+
+  printf("%-*s%-*s%-*s%s\n", lang_width, lang, width, field[ESTIMATE_CODE], width, field[ESTIMATE_COMMENT], field[ESTIMATE_BLANK]);
+}
+
+static void print_estimate_result() {
+  int lang_width = sizeof("LANGUAGE") + GAP_WIDTH, width = sizeof("COMMENT LINES") + 2 * GAP_WIDTH + 4;
+  int i;
+
+  if (output_format == FORMAT_CSV) {
+    puts("type,name,language,code,comment,blank,code_ci,comment_ci,blank_ci");
+  } else {
+    printf("%-*s%-*s%-*s%s\n", lang_width, "LANGUAGE", width, "CODE LINES", width, "COMMENT LINES", "BLANK LINES");
+  }
+
+  for (i = 0; i < estimator.nresults; i++) {
+    print_estimate_row("language", estimator.results[i].lang, &estimator.results[i], lang_width, width);
+  }
+
+  print_estimate_row("total", "", &estimator.total, lang_width, width);
+
+  if (output_format == FORMAT_TABLE) {
+    printf("\nEstimated from %zu of %zu files, %lld of %lld bytes, +- is the 95%% confidence interval\n",
+           estimator.sampled, estimator.files, estimator.sampled_bytes, estimator.bytes);
+  }
+}
+
+static void init_data_struct() {
+  if (init_sq_list(&line_counter_list, INIT_LINE_COUNTER_LIST_SIZE)
+      || init_sq_list(&dir_rollup_list, INIT_DIR_ROLLUP_LIST_SIZE)
+      || init_hash_table(&lang_counter_table, INIT_LANG_COUNTER_TABLE_SIZE)) {
+    error(EXIT_FAILURE, "Cannot alloc result data");
+  }
+}
+
+/*
+ * Snapshot paths are relative to the directory all arguments are in, so
+ * trees checked out in different places compare. Cutting a common prefix
+ * keeps them sorted.
+ */
+static void add_save_base(const char *pathname, boolean is_dir) {
+  char base[PATH_MAX + 2];
+  int len, i;
+
+  /* a directory with its trailing '/', the directory of a file */
+  len = snprintf(base, sizeof(base), "%s%s", pathname, is_dir && pathname[strlen(pathname) - 1] != '/' ? "/" : "");
+  while (len > 0 && base[len - 1] != '/') {
+    len--;
+  }
+  base[len] = '\0';
+
+  if (save_base_len < 0) {
+    strcpy(save_base, base);
+    save_base_len = len;
+    return;
+  }
+
+  for (i = 0; i < save_base_len && save_base[i] == base[i]; i++);
+  while (i > 0 && save_base[i - 1] != '/') {
+    i--;
+  }
+
+  save_base_len = i;
+  save_base[i] = '\0';
+}
+
+static void save_file_result(const char *pathname, const struct line_counter *counter, void *snap) {
+  snapshot_write((struct snapshot *) snap, pathname + save_base_len, counter);
+}
+
+static void save_snapshot() {
+  struct snapshot snap;
+
+  snapshot_create(&snap, save_file);
+  spill_foreach(&file_results, save_file_result, &snap);
+  snapshot_close(&snap);
+}
+
+struct diff_result {
+  char *format;
+  int added;
+  int removed;
+  int changed;
+};
+
+static void diff_lang(const struct line_counter *counter, int sign) {
+  struct line_counter *lang_counter;
+
+  if (!(lang_counter = (struct line_counter *) hash_table_find_with_add(lang_counter_table, counter->lang, create_line_counter))) {
+    error(EXIT_FAILURE, "Cannot alloc line counter");
+  }
+
+  lang_counter->lang = counter->lang;
+  lang_counter->code_lines += sign * counter->code_lines;
+  lang_counter->comment_lines += sign * counter->comment_lines;
+  lang_counter->blank_lines += sign * counter->blank_lines;
+}
+
+static void print_diff_file(const char *type, const char *pathname, const char *lang, int code, int comment, int blank, const char *format) {
+  if (output_format == FORMAT_CSV) {
+    print_csv_row(type, pathname, lang, code, comment, blank, NULL);
+  } else {
+    printf("%c %s\n", toupper(type[0]), pathname);
+    printf(format, lang, code, comment, blank);
+  }
+}
+
+/* a file whose language changed is shown as removed and added again */
+static void diff_file(const char *pathname, const struct line_counter *old, const struct line_counter *new, void *arg) {
+  struct diff_result *result = (struct diff_result *) arg;
+
+  if (old) {
+    diff_lang(old, -1);
+  }
+  if (new) {
+    diff_lang(new, 1);
+  }
+
+  if (old && new && !strcmp(old->lang, new->lang)) {
+    result->changed++;
+    if (verbose) {
+      print_diff_file("changed", pathname, new->lang, new->code_lines - old->code_lines,
+                      new->comment_lines - old->comment_lines, new->blank_lines - old->blank_lines, result->format);
+    }
+    return;
+  }
+
+  if (old) {
+    result->removed++;
+    if (verbose) {
+      print_diff_file("removed", pathname, old->lang, -old->code_lines, -old->comment_lines, -old->blank_lines, result->format);
+    }
+  }
+  if (new) {
+    result->added++;
+    if (verbose) {
+      print_diff_file("added", pathname, new->lang, new->code_lines, new->comment_lines, new->blank_lines, result->format);
+    }
+  }
+}
+
+static void diff_usage() {
+  puts("Usage: hcc diff [OPTION]... OLD NEW");
+  puts("Show the line changes from snapshot OLD to snapshot NEW, saved by --save\n");
+  puts("Options\n\
+    --format=FORMAT               output format: table (default) or csv\n\
+    -v, --verbose                 also show the changed, added and removed files\n\
+    -h, --help                    this help text");
+}
+
+static const struct option diff_long_opts[] = {
+  { "format", required_argument, NULL, 'f' },
+  { "verbose", no_argument, NULL, 'v' },
+  { "help", no_argument, NULL, 'h' },
+  { NULL, 0, NULL, 0 },
+};
+
+/* hcc diff, both snapshots are merged in one pass */
+static int diff_main(int argc, char *argv[]) {
+  struct snapshot old, new;
+  struct diff_result result;
+  struct line_counter *lang_counter, total;
+  int lang_width = sizeof("LANGUAGE") + GAP_WIDTH, code_width = sizeof("CODE LINES") + GAP_WIDTH;
+  int comment_width = sizeof("COMMENT LINES") + GAP_WIDTH, blank_width = sizeof("BLANK LINES");
+  char format[64];
+  int opt;
+
+  while ((opt = getopt_long(argc, argv, "vh?", diff_long_opts, NULL)) != -1) {
+    switch (opt) {
+    case 'f':
+      if (!strcmp(optarg, "table")) {
+        output_format = FORMAT_TABLE;
+      } else if (!strcmp(optarg, "csv")) {
+        output_format = FORMAT_CSV;
+      } else {
+        fprintf(stderr, "Error: unknown output format: %s\n", optarg);
+        exit(EXIT_FAILURE);
+      }
+      break;
+    case 'v':
+      verbose = TRUE;
+      break;
+    case 'h':
+      diff_usage();
+      exit(EXIT_SUCCESS);
+    default:
+      diff_usage();
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  if (argc - optind != 2) {
+    diff_usage();
+    exit(EXIT_FAILURE);
+  }
+
+  init_data_struct();
+  snapshot_open(&old, argv[optind]);
+  snapshot_open(&new, argv[optind + 1]);
+
+  memset(&result, 0, sizeof(struct diff_result));
+  result.format = format;
+
+  if (output_format == FORMAT_CSV) {
+    puts("type,name,language,code,comment,blank");
+  } else {
+    printf("%-*s%-*s%-*s%-*s\n", lang_width, "LANGUAGE", code_width, "CODE LINES", comment_width, "COMMENT LINES", blank_width, "BLANK LINES");
+  }
+
+  sprintf(format, "%%-%ds%%-+%dd%%-+%dd%%-+%dd\n", lang_width, code_width, comment_width, blank_width);
+
+  snapshot_diff(&old, &new, diff_file, &result);
+  snapshot_close(&old);
+  snapshot_close(&new);
+
+  if (verbose && output_format == FORMAT_TABLE) {
+    puts("");
+  }
+
+  memset(&total, 0, sizeof(struct line_counter));
+  hash_table_reset(lang_counter_table);
+  while ((lang_counter = (struct line_counter *) hash_table_current(lang_counter_table))) {
+    total.code_lines += lang_counter->code_lines;
+    total.comment_lines += lang_counter->comment_lines;
+    total.blank_lines += lang_counter->blank_lines;
+
+    if (output_format == FORMAT_CSV) {
+      print_csv_row("language", "", lang_counter->lang, lang_counter->code_lines, lang_counter->comment_lines, lang_counter->blank_lines, NULL);
+    } else {
+      printf(format, lang_counter->lang, lang_counter->code_lines, lang_counter->comment_lines, lang_counter->blank_lines);
+    }
+
+    hash_table_next(lang_counter_table);
+  }
+
+  if (output_format == FORMAT_CSV) {
+    print_csv_row("total", "", "", total.code_lines, total.comment_lines, total.blank_lines, NULL);
+  } else {
+    printf(format, "", total.code_lines, total.comment_lines, total.blank_lines);
+    printf("\n%d files added, %d removed, %d changed\n", result.added, result.removed, result.changed);
+  }
+
+  return EXIT_SUCCESS;
+}
+
+/*
+ * Count a file, archive or directory argument, FALSE when it could not be
+ * counted in full. A missing root or a failed walk ends the run unless
+ * keep_going, as for the roots of a manifest.
+ */
+static boolean count_argument(const char *arg, boolean keep_going) {
+  char pathname[PATH_MAX+1];
+  struct line_counter counter;
+  struct stat sb;
+  long long phase_start;
+  int status, archive;
+  boolean ok = TRUE;
+
+  if (!realpath(arg, pathname)) {
+    fprintf(stderr, "Error: cannot locat file or directory: %s\n", arg);
+    if (!keep_going) {
+      exit(EXIT_FAILURE);
+    }
+    return FALSE;
+  }
+
+  phase_start = trace_now();
+
+  /* reset stat buffer */
+  memset(&sb, 0, sizeof(struct stat));
+  stat(pathname, &sb);
+
+  if (save_file) {
+    add_save_base(pathname, S_ISDIR(sb.st_mode));
+  }
+
+  if (checkpoint_path) {
+    checkpoint_tick(&checkpoint);
+    if (checkpoint_skip(&checkpoint, NULL, pathname)) {
+      return TRUE;
+    }
+  }
+
+  switch (sb.st_mode & S_IFMT) {
+  case S_IFREG:
+    if (dedup_inodes && !inode_set_add(&seen_inodes, sb.st_dev, sb.st_ino)) {
+      break;
+    }
+
+    if ((archive = archive_type(pathname)) != ARCHIVE_NONE) {
+      archive_scan(pathname, archive, scan_archive_member, NULL);
+      if (checkpoint_path) {
+        checkpoint_file(&checkpoint, NULL, pathname, NULL);
+      }
+    } else if (estimate_error) {
+      estimate_add_file(&estimator, pathname, sb.st_size);
+    } else if (jobs > 1) {
+      submit_file(pathname, NULL, NULL, sb.st_size, NULL, NULL, NULL);
+    } else {
+      boolean counted;
+
+      if ((counted = check_count_status(hcc_count_file_rb(ctx, &read_buffers, AT_FDCWD, pathname, sb.st_size, pathname, &counter),
+                                        pathname))) {
+        record_line_counter(&counter, NULL, pathname, NULL);
+      }
+      progress_add(&progress, sb.st_size);
+
+      if (checkpoint_path) {
+        checkpoint_file(&checkpoint, NULL, pathname, counted ? &counter : NULL);
+      }
+    }
+    break;
+  case S_IFDIR:
+#ifdef DEBUG
+    printf("scan from dir: %s\n", pathname);
+#endif
+
+    if (estimate_error) {
+      status = estimate_add_tree(&estimator, pathname);
+    } else if (jobs > 1) {
+      status = walk_tree(pathname, &ctx->walk_opts, dispatch_file, NULL);
+    } else {
+      status = hcc_count_tree(ctx, pathname, count_for_file, NULL);
+    }
+
+    /* a spent time budget stops the walk too */
+    if (status && !progress.expired) {
+      if (!keep_going) {
+        fputs("Fatal: file tree walk failed", stderr);
+        exit(EXIT_FAILURE);
+      }
+      fprintf(stderr, "Error: file tree walk failed: %s\n", pathname);
+      ok = FALSE;
+    }
+    break;
+  default:
+    fprintf(stderr, "Error: unknown file type: %s\n", pathname);
+    ok = FALSE;
+    break;
+  }
+
+  trace_phase(jobs > 1 ? "walk" : "count", pathname, phase_start);
+
+  return ok;
+}
+
+/* the rows of table after a ROOT column, root NULL for the totals of all roots */
+static void print_manifest_rows(const char *root, struct hash_table *table) {
+  int lang_width = sizeof("LANGUAGE") + GAP_WIDTH, code_width = sizeof("CODE LINES") + GAP_WIDTH;
+  int comment_width = sizeof("COMMENT LINES") + GAP_WIDTH, blank_width = sizeof("BLANK LINES") + (ctx->metrics ? GAP_WIDTH : 0);
+  int root_width = (manifest.path_width > (int) sizeof("ROOT") ? manifest.path_width : (int) sizeof("ROOT")) + GAP_WIDTH;
+  struct line_counter *lang_counter, total_counter;
+
+  if (!table) {
+    if (output_format == FORMAT_CSV) {
+      puts(csv_header());
+    } else {
+      printf("%-*s%-*s%-*s%-*s%-*s", root_width, "ROOT", lang_width, "LANGUAGE", code_width, "CODE LINES",
+             comment_width, "COMMENT LINES", blank_width, "BLANK LINES");
+      end_table_row(NULL);
+    }
+    return;
+  }
+
+  memset(&total_counter, 0, sizeof(struct line_counter));
+  hash_table_reset(table);
+  while ((lang_counter = (struct line_counter *) hash_table_current(table))) {
+    total_counter.blank_lines += lang_counter->blank_lines;
+    total_counter.code_lines += lang_counter->code_lines;
+    total_counter.comment_lines += lang_counter->comment_lines;
+    add_line_metrics(&total_counter.metrics, &lang_counter->metrics);
+
+    if (output_format == FORMAT_CSV) {
+      print_csv_row(root ? "root" : "language", root ? root : "", lang_counter->lang, lang_counter->code_lines,
+                    lang_counter->comment_lines, lang_counter->blank_lines, lang_counter);
+    } else {
+      printf("%-*s%-*s%-*d%-*d%-*d", root_width, root ? root : "", lang_width, lang_counter->lang, code_width, lang_counter->code_lines,
+             comment_width, lang_counter->comment_lines, blank_width, lang_counter->blank_lines);
+      end_table_row(lang_counter);
+    }
+
+    hash_table_next(table);
+  }
+
+  if (output_format == FORMAT_CSV) {
+    print_csv_row(root ? "root" : "total", root ? root : "", "", total_counter.code_lines, total_counter.comment_lines,
+                  total_counter.blank_lines, &total_counter);
+  } else {
+    printf("%-*s%-*s%-*d%-*d%-*d", root_width, root ? root : "", lang_width, "", code_width, total_counter.code_lines,
+           comment_width, total_counter.comment_lines, blank_width, total_counter.blank_lines);
+    end_table_row(&total_counter);
+  }
+}
+
+static void free_lang_counter_table(struct hash_table *table) {
+  unsigned int i;
+
+  for (i = 0; i < table->size; i++) {
+    if (table->buckets[i].key) {
+      free(table->buckets[i].key);
+      free(table->buckets[i].value);
+    }
+  }
+  free(table);
+}
+
+/*
+ * The roots one after another on the same context and workers, each with
+ * its own excludes on top of the global ones. Its totals are printed as
+ * soon as the workers ran dry, then added to the totals of all roots.
+ */
+static void count_manifest() {
+  struct hash_table *totals = lang_counter_table, *root_table;
+  struct line_counter *lang_counter;
+  const struct manifest_root *root;
+  int i, j, keep = list_size(&ctx->exclude_list);
+
+  print_manifest_rows(NULL, NULL);
+
+  for (i = 0; i < manifest.nroots && !progress.expired; i++) {
+    root = &manifest.roots[i];
+
+    for (j = 0; j < root->nexcludes; j++) {
+      if (hcc_add_exclude(ctx, root->excludes[j])) {
+        error(EXIT_FAILURE, "Cannot alloc exclude pattern buffer");
+      }
+    }
+
+    if (init_hash_table(&root_table, INIT_LANG_COUNTER_TABLE_SIZE)) {
+      error(EXIT_FAILURE, "Cannot alloc result data");
+    }
+    pthread_mutex_lock(&result_lock);
+    lang_counter_table = root_table;
+    pthread_mutex_unlock(&result_lock);
+
+    /* a root that fails is reported and the next one counted all the same */
+    if (!count_argument(root->path, TRUE)) {
+      failed_roots++;
+    }
+    if (jobs > 1) {
+      sched_wait(&scheduler);
+    }
+
+    print_manifest_rows(root->path, root_table);
+    fflush(stdout);
+
+    pthread_mutex_lock(&result_lock);
+    lang_counter_table = totals;
+    pthread_mutex_unlock(&result_lock);
+
+    hash_table_reset(root_table);
+    while ((lang_counter = (struct line_counter *) hash_table_current(root_table))) {
+      record_line_counter(lang_counter, NULL, NULL, NULL);
+      hash_table_next(root_table);
+    }
+
+    free_lang_counter_table(root_table);
+    hcc_drop_excludes(ctx, keep);
+  }
+}
+
+static void print_manifest_result() {
+  if (output_format == FORMAT_TABLE) {
+    puts("");
+  }
+
+  print_manifest_rows(NULL, lang_counter_table);
+
+  if (output_format == FORMAT_TABLE) {
+    printf("\n%d roots", manifest.nroots);
+    if (failed_roots) {
+      printf(", %d failed", failed_roots);
+    }
+    putchar('\n');
+  }
+}
+
+static void add_exclude_list_from_file(const char *exclude_file) {
+  FILE *stream;
+  char line[PATTERN_MAX];
+
+  if (!(stream = fopen(exclude_file, "r"))) {
+    error(EXIT_FAILURE, "Cannot open exclude file: %s", exclude_file);
+  }
+
+  while (fgets(line, PATTERN_MAX, stream)) {
+    int len = strlen(line);
+    char *pos;
+
+    if (len > PATTERN_MAX - 1) {
+      error(EXIT_FAILURE, "Too lang exclude pattern: %s", line);
+    }
+
+    if ((pos = strchr(line, '\n'))) {
+      *pos = '\0';
+    }
+
+    if (hcc_add_exclude(ctx, line)) {
+      error(EXIT_FAILURE, "Cannot alloc exclude pattern buffer");
+    }
+  }
+}
+
+/* SIZE in bytes with an optional K, M or G suffix */
+static size_t parse_size_option(const char *str, size_t min) {
+  char *end;
+  unsigned long long size;
+
+  size = strtoull(str, &end, 10);
+  switch (*end) {
+  case 'G':
+  case 'g':
+    size <<= 10;
+    /* fall through */
+  case 'M':
+  case 'm':
+    size <<= 10;
+    /* fall through */
+  case 'K':
+  case 'k':
+    size <<= 10;
+    end++;
+    break;
+  }
+
+  if (end == str || *end || size < min || size > SSIZE_MAX) {
+    fprintf(stderr, "Error: invalid size: %s\n", str);
+    exit(EXIT_FAILURE);
+  }
+
+  return size;
+}
+
+static double parse_seconds_option(const char *str) {
+  char *end;
+  double secs = strtod(str, &end);
+
+  if (end == str || *end || !(secs > 0)) {
+    fprintf(stderr, "Error: invalid seconds: %s\n", str);
+    exit(EXIT_FAILURE);
+  }
+
+  return secs;
+}
+
+static void usage() {
   puts("Usage: hcc [OPTION]... [FILE]...");
-  puts("Count the actual code lines in each file\n");
+  puts("  or:  hcc diff [OPTION]... OLD NEW");
+  puts("Count the actual code lines in each file");
+  puts("FILE may be a tar, tar.gz or zip archive, its members are reported as ARCHIVE!MEMBER\n");
   puts("Options\n\
     --custom-comment-defs=FILE    define own comment definition\n\
     --comment-defs-detail         show comment definition detail\n\
     --exclude=PATTERN             skip count files matching PATTERN\n\
     --exclude-from=FILE           skip count files matching any pattern from FILE(separate by new line)\n\
+    --one-file-system             skip directories on different file systems\n\
+    --by-dir[=DEPTH]              also show totals of each directory, down to DEPTH levels\n\
+    --format=FORMAT               output format: table (default) or csv\n\
+    --buffer-size=SIZE            read buffer size, default 16K\n\
+    --small-file-size=SIZE        read files up to SIZE in a single read, default 64K\n\
+    --large-file-size=SIZE        read files from SIZE on with the large buffer, default 1M, 0 to disable\n\
+    --large-buffer-size=SIZE      large read buffer size, default 1M\n\
+    --mem-limit=SIZE              keep verbose results within SIZE of memory, spill the rest to TMPDIR\n\
+    --sort                        sort verbose results by path\n\
+    --trace=FILE                  write Chrome trace events of the run to FILE, list the slowest files\n\
+    --estimate=ERROR              count a random sample and estimate totals within ERROR, e.g. 0.01 or 1%\n\
+    --progress[=SECONDS]          print progress to stderr every SECONDS, default 5\n\
+    --time-budget=SECONDS         stop counting after SECONDS and print the partial result\n\
+    --checkpoint=FILE             save the totals and the walk frontier to FILE now and then\n\
+    --checkpoint-interval=SECONDS seconds between checkpoints, default 60\n\
+    --resume                      continue from the checkpoint, count what it has not\n\
+    --git-rev=REV                 count the files of git revision REV of the repository FILE, default .,\n\
+                                  read from its object store without a checkout\n\
+    --git-history=RANGE           totals of each commit of RANGE, A..B or the history of B, of the repository\n\
+                                  FILE, each blob is counted once\n\
+    --first-parent                follow only the first parent of merges in --git-history\n\
+    --stdin                       also count stdin, pipes included, its language is guessed from the first lines\n\
+    --stdin-name=NAME             match and report stdin as NAME, e.g. foo.c, implies --stdin\n\
+    --lang=LANG                   count stdin as LANG, as listed by --comment-defs-detail\n\
+    --blob-cache=DIR              reuse the counts of git tracked files by blob id from DIR, shared by\n\
+                                  every checkout of the repository\n\
+    --manifest=FILE               count the roots listed in FILE, a line each with its own excludes after\n\
+                                  tabs, and print the totals of each as it is done and of all\n\
+    --save=FILE                   save the result of each file to snapshot FILE, for hcc diff\n\
+    --metrics                     also measure bytes, max and average line length, lines with trailing\n\
+                                  spaces and tab indented lines\n\
+    --dedup-inodes                count hard linked and bind mounted files once\n\
+    --nice-io                     read with the idle I/O priority, only when the disks are otherwise idle\n\
+    --io-rate=SIZE                read at most SIZE bytes a second, e.g. 20M\n\
+    --file-rate=N                 open at most N files a second\n\
+    -j, --jobs=N                  count with N worker threads, default 1, auto for the CPUs of the cgroup quota\n\
+    --walk-order=ORDER            order directory entries are visited in: readdir (default), inode or extent\n\
+    --schedule=ORDER              order files are handed to workers: largest (default) or walk, walk with\n\
+                                  --walk-order\n\
+    --lookahead=N                 files kept pending to pick the largest from, default 4096\n\
     -v, --verbose                 show verbose result\n\
     --version                     version number\n\
     -h, --help                    this help text");
@@ -667,10 +1530,42 @@ enum {
   COMMENT_DEFS_DETAIL_OPTION = CHAR_MAX + 1,
 #ifdef DEBUG
   DEBUG_OPTION,
-  PARTIAL_TEST_BUF_SIZE_OPTION,
 #endif
   EXCLUDE_OPTION,
   EXCLUDE_FROM_OPTION,
+  ONE_FILE_SYSTEM_OPTION,
+  BY_DIR_OPTION,
+  FORMAT_OPTION,
+  BUFFER_SIZE_OPTION,
+  SMALL_FILE_SIZE_OPTION,
+  LARGE_FILE_SIZE_OPTION,
+  LARGE_BUFFER_SIZE_OPTION,
+  MEM_LIMIT_OPTION,
+  SORT_OPTION,
+  SCHEDULE_OPTION,
+  WALK_ORDER_OPTION,
+  DEDUP_INODES_OPTION,
+  TRACE_OPTION,
+  ESTIMATE_OPTION,
+  PROGRESS_OPTION,
+  METRICS_OPTION,
+  SAVE_OPTION,
+  CHECKPOINT_OPTION,
+  CHECKPOINT_INTERVAL_OPTION,
+  RESUME_OPTION,
+  GIT_REV_OPTION,
+  GIT_HISTORY_OPTION,
+  FIRST_PARENT_OPTION,
+  STDIN_OPTION,
+  STDIN_NAME_OPTION,
+  LANG_OPTION,
+  TIME_BUDGET_OPTION,
+  NICE_IO_OPTION,
+  BLOB_CACHE_OPTION,
+  MANIFEST_OPTION,
+  IO_RATE_OPTION,
+  FILE_RATE_OPTION,
+  LOOKAHEAD_OPTION,
   VERSION_OPTION,
 };
 
@@ -682,6 +1577,40 @@ static const struct option long_opts[] = {
 #endif
   { "exclude", required_argument, NULL, EXCLUDE_OPTION },
   { "exclude-from", required_argument, NULL, EXCLUDE_FROM_OPTION },
+  { "one-file-system", no_argument, NULL, ONE_FILE_SYSTEM_OPTION },
+  { "by-dir", optional_argument, NULL, BY_DIR_OPTION },
+  { "format", required_argument, NULL, FORMAT_OPTION },
+  { "buffer-size", required_argument, NULL, BUFFER_SIZE_OPTION },
+  { "small-file-size", required_argument, NULL, SMALL_FILE_SIZE_OPTION },
+  { "large-file-size", required_argument, NULL, LARGE_FILE_SIZE_OPTION },
+  { "large-buffer-size", required_argument, NULL, LARGE_BUFFER_SIZE_OPTION },
+  { "mem-limit", required_argument, NULL, MEM_LIMIT_OPTION },
+  { "sort", no_argument, NULL, SORT_OPTION },
+  { "dedup-inodes", no_argument, NULL, DEDUP_INODES_OPTION },
+  { "trace", required_argument, NULL, TRACE_OPTION },
+  { "estimate", required_argument, NULL, ESTIMATE_OPTION },
+  { "progress", optional_argument, NULL, PROGRESS_OPTION },
+  { "metrics", no_argument, NULL, METRICS_OPTION },
+  { "save", required_argument, NULL, SAVE_OPTION },
+  { "checkpoint", required_argument, NULL, CHECKPOINT_OPTION },
+  { "checkpoint-interval", required_argument, NULL, CHECKPOINT_INTERVAL_OPTION },
+  { "resume", no_argument, NULL, RESUME_OPTION },
+  { "git-rev", required_argument, NULL, GIT_REV_OPTION },
+  { "git-history", required_argument, NULL, GIT_HISTORY_OPTION },
+  { "first-parent", no_argument, NULL, FIRST_PARENT_OPTION },
+  { "stdin", no_argument, NULL, STDIN_OPTION },
+  { "stdin-name", required_argument, NULL, STDIN_NAME_OPTION },
+  { "lang", required_argument, NULL, LANG_OPTION },
+  { "time-budget", required_argument, NULL, TIME_BUDGET_OPTION },
+  { "nice-io", no_argument, NULL, NICE_IO_OPTION },
+  { "blob-cache", required_argument, NULL, BLOB_CACHE_OPTION },
+  { "manifest", required_argument, NULL, MANIFEST_OPTION },
+  { "io-rate", required_argument, NULL, IO_RATE_OPTION },
+  { "file-rate", required_argument, NULL, FILE_RATE_OPTION },
+  { "jobs", required_argument, NULL, 'j' },
+  { "schedule", required_argument, NULL, SCHEDULE_OPTION },
+  { "walk-order", required_argument, NULL, WALK_ORDER_OPTION },
+  { "lookahead", required_argument, NULL, LOOKAHEAD_OPTION },
   { "verbose", no_argument, NULL, 'v' },
   { "version", no_argument, NULL, VERSION_OPTION },
   { "help", no_argument, NULL, 'h' },
@@ -689,15 +1618,27 @@ static const struct option long_opts[] = {
 };
 
 int main(int argc, char *argv[]) {
-  int opt, i, parse_ret;
+  int opt, i, status;
   char pathname[PATH_MAX+1];
   boolean has_custom_comment_defs = FALSE;
+  boolean schedule_set = FALSE;
   char comment_defs_file[PATH_MAX+1];
   char *exclude_pattern = NULL;
-  char exclude_file[PATH_MAX+1];
-  struct stat sb;
+  char *exclude_file = NULL;
+  long long phase_start;
+
+  /* SIGUSR1 is only taken by the progress thread */
+  progress_block_signals();
+
+  if ((status = hcc_context_new(&ctx))) {
+    error(EXIT_FAILURE, "Cannot create context: %s", hcc_strerror(status));
+  }
+
+  if (argc > 1 && !strcmp(argv[1], "diff")) {
+    exit(diff_main(argc - 1, argv + 1));
+  }
 
-  while ((opt = getopt_long(argc, argv, "vh?", long_opts, NULL)) != -1) {
+  while ((opt = getopt_long(argc, argv, "vhj:?", long_opts, NULL)) != -1) {
     switch (opt) {
     case 'c':
       has_custom_comment_defs = TRUE;
@@ -708,20 +1649,180 @@ int main(int argc, char *argv[]) {
       break;
 #ifdef DEBUG
     case DEBUG_OPTION:
-      debug = TRUE;
+      ctx->debug = TRUE;
       break;
 #endif
     case EXCLUDE_OPTION:
-      if (!(exclude_pattern = malloc(strlen(optarg) + 1))) {
-        error(EXIT_FAILURE, "Cannot alloc exclude pattern");
+      exclude_pattern = optarg;
+      break;
+    case EXCLUDE_FROM_OPTION:
+      exclude_file = optarg;
+      break;
+    case ONE_FILE_SYSTEM_OPTION:
+      ctx->walk_opts.one_file_system = TRUE;
+      break;
+    case BY_DIR_OPTION:
+      by_dir = TRUE;
+      if (optarg) {
+        char *end;
+
+        by_dir_depth = strtol(optarg, &end, 10);
+        if (*end || by_dir_depth < 0) {
+          fprintf(stderr, "Error: invalid directory depth: %s\n", optarg);
+          exit(EXIT_FAILURE);
+        }
+      }
+      break;
+    case FORMAT_OPTION:
+      if (!strcmp(optarg, "table")) {
+        output_format = FORMAT_TABLE;
+      } else if (!strcmp(optarg, "csv")) {
+        output_format = FORMAT_CSV;
+      } else {
+        fprintf(stderr, "Error: unknown output format: %s\n", optarg);
+        exit(EXIT_FAILURE);
+      }
+      break;
+    case BUFFER_SIZE_OPTION:
+      ctx->read_opts.buffer_size = parse_size_option(optarg, MAX_COMMENT_SIZE);
+      break;
+    case SMALL_FILE_SIZE_OPTION:
+      ctx->read_opts.small_file_size = parse_size_option(optarg, 0);
+      break;
+    case LARGE_FILE_SIZE_OPTION:
+      ctx->read_opts.large_file_size = parse_size_option(optarg, 0);
+      break;
+    case LARGE_BUFFER_SIZE_OPTION:
+      ctx->read_opts.large_buffer_size = parse_size_option(optarg, MAX_COMMENT_SIZE);
+      break;
+    case MEM_LIMIT_OPTION:
+      mem_limit = parse_size_option(optarg, SPILL_MIN_RUN_BUFFER_SIZE);
+      break;
+    case SORT_OPTION:
+      sort_by_path = TRUE;
+      break;
+    case NICE_IO_OPTION:
+      nice_io = TRUE;
+      break;
+    case BLOB_CACHE_OPTION:
+      blob_cache_dir = optarg;
+      break;
+    case MANIFEST_OPTION:
+      manifest_file = optarg;
+      break;
+    case IO_RATE_OPTION:
+      throttle_init(&byte_rate, parse_size_option(optarg, 1));
+      ctx->read_opts.byte_rate = &byte_rate;
+      break;
+    case 'j':
+      /* a container may have every host core in its mask and a quota of two */
+      if (!strcmp(optarg, "auto")) {
+        jobs = usable_cpus();
+        break;
+      }
+      /* fall through */
+    case FILE_RATE_OPTION:
+    case LOOKAHEAD_OPTION: {
+      char *end;
+      long n = strtol(optarg, &end, 10);
+
+      if (*end || end == optarg || n < 1 || n > INT_MAX) {
+        fprintf(stderr, "Error: invalid number: %s\n", optarg);
+        exit(EXIT_FAILURE);
       }
 
-      strcpy(exclude_pattern, optarg);
-      exclude_list_size = exclude_list_size ? exclude_list_size : 1;
+      if (opt == 'j') {
+        jobs = n;
+      } else if (opt == FILE_RATE_OPTION) {
+        throttle_init(&file_rate, n);
+        ctx->read_opts.file_rate = &file_rate;
+      } else {
+        lookahead = n;
+      }
       break;
-    case EXCLUDE_FROM_OPTION:
-      strcpy(exclude_file, optarg);
-      exclude_list_size = 16;
+    }
+    case ESTIMATE_OPTION: {
+      char *end;
+
+      estimate_error = strtod(optarg, &end);
+      if (*end == '%' && end[1] == '\0') {
+        estimate_error /= 100;
+        end++;
+      }
+
+      if (*end || end == optarg || !(estimate_error > 0 && estimate_error < 1)) {
+        fprintf(stderr, "Error: invalid estimate error: %s\n", optarg);
+        exit(EXIT_FAILURE);
+      }
+      break;
+    }
+    case PROGRESS_OPTION:
+      progress_interval = optarg ? parse_seconds_option(optarg) : DEFAULT_PROGRESS_INTERVAL;
+      break;
+    case CHECKPOINT_OPTION:
+      checkpoint_path = optarg;
+      break;
+    case CHECKPOINT_INTERVAL_OPTION:
+      checkpoint_interval = parse_seconds_option(optarg);
+      break;
+    case RESUME_OPTION:
+      resume = TRUE;
+      break;
+    case GIT_REV_OPTION:
+      git_rev = optarg;
+      break;
+    case GIT_HISTORY_OPTION:
+      git_history = optarg;
+      break;
+    case FIRST_PARENT_OPTION:
+      first_parent = TRUE;
+      break;
+    case STDIN_NAME_OPTION:
+      stdin_name = optarg;
+      /* fall through */
+    case STDIN_OPTION:
+      count_stdin = TRUE;
+      break;
+    case LANG_OPTION:
+      stdin_lang = optarg;
+      break;
+    case SAVE_OPTION:
+      save_file = optarg;
+      break;
+    case METRICS_OPTION:
+      ctx->metrics = TRUE;
+      break;
+    case TIME_BUDGET_OPTION:
+      time_budget = parse_seconds_option(optarg);
+      break;
+    case TRACE_OPTION:
+      trace_file = optarg;
+      break;
+    case DEDUP_INODES_OPTION:
+      dedup_inodes = TRUE;
+      break;
+    case WALK_ORDER_OPTION:
+      if (!strcmp(optarg, "readdir")) {
+        ctx->walk_opts.order = WALK_ORDER_READDIR;
+      } else if (!strcmp(optarg, "inode")) {
+        ctx->walk_opts.order = WALK_ORDER_INODE;
+      } else if (!strcmp(optarg, "extent")) {
+        ctx->walk_opts.order = WALK_ORDER_EXTENT;
+      } else {
+        fprintf(stderr, "Error: unknown walk order: %s\n", optarg);
+        exit(EXIT_FAILURE);
+      }
+      break;
+    case SCHEDULE_OPTION:
+      schedule_set = TRUE;
+      if (!strcmp(optarg, "largest")) {
+        largest_first = TRUE;
+      } else if (!strcmp(optarg, "walk")) {
+        largest_first = FALSE;
+      } else {
+        fprintf(stderr, "Error: unknown schedule: %s\n", optarg);
+        exit(EXIT_FAILURE);
+      }
       break;
     case 'v':
       verbose = TRUE;
@@ -743,70 +1844,248 @@ int main(int argc, char *argv[]) {
 
   init_data_struct();
 
+  /* workers take the files in the order the disk holds them */
+  if (ctx->walk_opts.order != WALK_ORDER_READDIR && !schedule_set) {
+    largest_first = FALSE;
+  }
+
+  /* threads started from here on inherit it */
+  if (nice_io && set_idle_io_priority()) {
+    error(EXIT_FAILURE, "Cannot set the idle I/O priority");
+  }
+
+  if (trace_file) {
+    if (trace_open(&tracer, trace_file)) {
+      error(EXIT_FAILURE, "Cannot open trace file: %s", trace_file);
+    }
+    ctx->trace = &tracer;
+    ctx->walk_opts.trace = &tracer;
+  }
+
+  phase_start = trace_now();
+
   /* set custom comment def first */
   if (has_custom_comment_defs) {
-    if ((parse_ret = ini_parse(comment_defs_file, build_comment_def, NULL))) {
-      error(EXIT_FAILURE, "parse ini file error: %d\nini file: %s\n", parse_ret, comment_defs_file);
+    if (hcc_load_defs_file(ctx, comment_defs_file)) {
+      error(EXIT_FAILURE, "parse ini file error: %d\nini file: %s\n", ctx->defs_error_line, comment_defs_file);
     }
   }
 
   /* default comment defs */
-  if ((parse_ret = ini_parse_string(comment_defs_string, build_comment_def, NULL))) {
-    error(EXIT_FAILURE, "parse ini string error: %d\nini string:\n%s\n", parse_ret, comment_defs_string);
+  if ((status = hcc_load_default_defs(ctx))) {
+    if (ctx->defs_error_line) {
+      error(EXIT_FAILURE, "parse ini string error: %d\n", ctx->defs_error_line);
+    }
+    error(EXIT_FAILURE, "%s", hcc_strerror(status));
   }
 
+  trace_phase("load defs", NULL, phase_start);
+
   if (show_comment_defs) {
     display_comment_defs_detail();
     exit(EXIT_SUCCESS);
   }
 
-  if (exclude_list_size) {
-    if (exclude_pattern) {
-      list_append(&exclude_list, (void *) exclude_pattern);
-    }
+  if (exclude_pattern && hcc_add_exclude(ctx, exclude_pattern)) {
+    error(EXIT_FAILURE, "Cannot alloc exclude pattern");
+  }
+
+  if (exclude_file) {
+    add_exclude_list_from_file(exclude_file);
+  }
+
+  /* flat records can be sorted and spilled, unlike the shared path nodes, a snapshot is sorted */
+  if (mem_limit || sort_by_path || save_file) {
+    spill_results = TRUE;
+    spill_init(&file_results, mem_limit, sort_by_path || save_file);
+  }
 
-    if (exclude_list_size > 1) {
-      add_exclude_list_from_file(exclude_file);
+  /* per root totals only, the roots take the place of the arguments */
+  if (manifest_file) {
+    if (argv[optind] || verbose || by_dir || save_file || checkpoint_path || estimate_error || count_stdin || git_rev
+        || git_history || time_budget) {
+      fputs("Error: --manifest cannot be combined with FILE arguments, --verbose, --by-dir, --save, --checkpoint,"
+            " --estimate, --stdin, --git-rev, --git-history or --time-budget\n", stderr);
+      exit(EXIT_FAILURE);
     }
+
+    manifest_load(&manifest, manifest_file);
   }
 
-  if (!argv[optind]) {
+  if (!argv[optind] && !count_stdin && !git_rev && !git_history && !manifest_file) {
     puts("File or directory argument is required");
     usage();
     exit(EXIT_FAILURE);
   }
 
-  for (i = optind; argv[i]; i++) {
-    if (!realpath(argv[i], pathname)) {
-      fprintf(stderr, "Error: cannot locat file or directory: %s\n", argv[i]);
+  /* a history has its own rows, no per file results or a single total */
+  if (git_history && (git_rev || verbose || by_dir || estimate_error || checkpoint_path || count_stdin || save_file
+                      || progress_interval || time_budget)) {
+    fputs("Error: --git-history cannot be combined with --git-rev, --verbose, --by-dir, --estimate, --checkpoint,"
+          " --stdin, --save, --progress or --time-budget\n", stderr);
+    exit(EXIT_FAILURE);
+  } else if (first_parent && !git_history) {
+    fputs("Error: --first-parent needs --git-history\n", stderr);
+    exit(EXIT_FAILURE);
+  }
+
+  /* the blobs of a revision are no files on disk to walk or come back to */
+  if ((git_rev || git_history) && (argv[optind] && argv[optind + 1])) {
+    fputs("Error: --git-rev and --git-history take one repository\n", stderr);
+    exit(EXIT_FAILURE);
+  } else if (git_rev && (by_dir || estimate_error || checkpoint_path || count_stdin)) {
+    fputs("Error: --git-rev cannot be combined with --by-dir, --estimate, --checkpoint or --stdin\n", stderr);
+    exit(EXIT_FAILURE);
+  }
+
+  /* stdin is read once, it has no path to save or come back to */
+  if (count_stdin && (estimate_error || checkpoint_path || save_file)) {
+    fputs("Error: --stdin cannot be combined with --estimate, --checkpoint or --save\n", stderr);
+    exit(EXIT_FAILURE);
+  } else if (stdin_lang && !count_stdin) {
+    fputs("Error: --lang needs --stdin\n", stderr);
+    exit(EXIT_FAILURE);
+  }
+
+  /* the sample is counted in order, per file output has no meaning */
+  if (estimate_error) {
+    if (verbose || by_dir || progress_interval || time_budget || ctx->metrics || save_file) {
+      fputs("Error: --estimate cannot be combined with --verbose, --by-dir, --progress, --time-budget, --metrics or --save\n", stderr);
       exit(EXIT_FAILURE);
     }
 
-    /* reset stat buffer */
-    memset(&sb, 0, sizeof(struct stat));
-    stat(pathname, &sb);
+    jobs = 1;
+    init_estimate(&estimator, ctx, estimate_error);
+  }
 
-    switch (sb.st_mode & S_IFMT) {
-    case S_IFREG:
-      scan_file(pathname);
-      break;
-    case S_IFDIR:
-#ifdef DEBUG
-      printf("scan from dir: %s\n", pathname);
-#endif
+  /* only the per language totals are kept in a checkpoint */
+  if (checkpoint_path) {
+    if (verbose || by_dir || save_file || dedup_inodes || estimate_error) {
+      fputs("Error: --checkpoint cannot be combined with --verbose, --by-dir, --save, --dedup-inodes or --estimate\n", stderr);
+      exit(EXIT_FAILURE);
+    }
 
-      if (nftw(pathname, count_for_file, MAX_FTW_FD, 0)) {
-        fputs("Fatal: file tree walk failed", stderr);
-        exit(EXIT_FAILURE);
+    checkpoint_init(&checkpoint, checkpoint_path, checkpoint_interval * 1e9);
+    if (resume && checkpoint_load(&checkpoint)) {
+      for (i = 0; i < checkpoint.nlangs; i++) {
+        record_line_counter(&checkpoint.langs[i], NULL, NULL, NULL);
+      }
+    }
+
+    ctx->walk_opts.dir_enter = checkpoint_dir_enter;
+    ctx->walk_opts.dir_leave = checkpoint_dir_leave;
+    ctx->walk_opts.dir_arg = &checkpoint;
+  } else if (resume) {
+    fputs("Error: --resume needs --checkpoint\n", stderr);
+    exit(EXIT_FAILURE);
+  }
+
+  /* files are only stat'ed by the walk for the largest first order, progress and estimates */
+  if ((jobs > 1 && largest_first) || progress_interval || estimate_error) {
+    ctx->walk_opts.stat_mask |= WALK_STAT_SIZE;
+  }
+
+  if (dedup_inodes) {
+    init_inode_set(&seen_inodes);
+    ctx->walk_opts.seen = &seen_inodes;
+  }
+
+  /* the roots are known before any worker looks a file up */
+  if (blob_cache_dir) {
+    blob_cache_init(&blob_cache, ctx, blob_cache_dir);
+    for (i = optind; !git_rev && !git_history && argv[i]; i++) {
+      if (realpath(argv[i], pathname)) {
+        blob_cache_add_root(&blob_cache, pathname);
       }
-      break;
-    default:
-      fprintf(stderr, "Error: unknown file type: %s\n", pathname);
-      break;
     }
+    for (i = 0; i < manifest.nroots; i++) {
+      if (realpath(manifest.roots[i].path, pathname)) {
+        blob_cache_add_root(&blob_cache, pathname);
+      }
+    }
+    ctx->cache = &blob_cache.hook;
+  }
+
+  if (!estimate_error) {
+    progress_start(&progress, progress_interval * 1e9, time_budget * 1e9, print_snapshot, NULL);
   }
 
-  print_result();
+  init_read_buffers(&read_buffers, &ctx->read_opts);
+
+  if (jobs > 1) {
+    /* every pending job may hold the fd of its directory */
+    share_dir_fds = raise_fd_limit(lookahead + jobs + SHARED_FD_RESERVE);
+    sched_start(&scheduler, jobs, lookahead, largest_first, count_job, worker_init, worker_fini, NULL);
+  }
+
+  if (count_stdin) {
+    phase_start = trace_now();
+    count_stdin_stream();
+    trace_phase("count", stdin_name ? stdin_name : "-", phase_start);
+  }
+
+  if (git_rev) {
+    phase_start = trace_now();
+    count_git_rev(argv[optind] ? argv[optind] : ".");
+    trace_phase("count", git_rev, phase_start);
+  }
+
+  if (manifest_file) {
+    count_manifest();
+  }
+
+  /* the arguments name a repository then */
+  for (i = optind; !git_rev && !git_history && argv[i] && !progress.expired; i++) {
+    count_argument(argv[i], FALSE);
+  }
+
+  if (jobs > 1) {
+    progress_enumerated(&progress);
+    phase_start = trace_now();
+    sched_finish(&scheduler);
+    trace_phase("drain", NULL, phase_start);
+  }
+
+  if (!estimate_error) {
+    progress_stop(&progress);
+  }
+  free_read_buffers(&read_buffers);
+
+  /* a stopped run is picked up again by --resume */
+  if (checkpoint_path && progress.expired) {
+    checkpoint_write(&checkpoint);
+  } else if (checkpoint_path) {
+    checkpoint_remove(&checkpoint);
+  }
+
+  if (estimate_error) {
+    phase_start = trace_now();
+    estimate_run(&estimator);
+    trace_phase("sample", NULL, phase_start);
+  }
+
+  phase_start = trace_now();
+  if (git_history) {
+    count_git_history(argv[optind] ? argv[optind] : ".");
+  } else if (manifest_file) {
+    print_manifest_result();
+  } else if (estimate_error) {
+    print_estimate_result();
+  } else {
+    print_result();
+  }
+  trace_phase(git_history ? "history" : "print", git_history, phase_start);
+
+  if (save_file) {
+    phase_start = trace_now();
+    save_snapshot();
+    trace_phase("save", NULL, phase_start);
+  }
+
+  if (trace_file) {
+    trace_print_top(&tracer, stderr);
+    trace_close(&tracer);
+  }
 
-  exit(EXIT_SUCCESS);
+  exit(failed_roots ? EXIT_FAILURE : EXIT_SUCCESS);
 }
@@ -1,34 +1,59 @@
 #ifndef __HCC_H
 #define __HCC_H
 
+#include <sys/types.h>
+
 #include "sq_list.h"
+#include "path.h"
 
 #define HCC_VERSION "1.0.0"
 
-#define MAX_FTW_FD 10
-
 #define MAX_LANG_SIZE 10
 #define MAX_COMMENT_SIZE 20
+#define MAX_SNIFF_NAME_SIZE 32
 
-#ifndef BUFFER_SIZE
-#define BUFFER_SIZE (16 * 1024)
-#endif
+#define PATTERN_MAX 128
+
+#define SNIFF_LINES 2
 
 #define INIT_PATTERN_LIST_SIZE 32
 #define INIT_LINE_COUNTER_LIST_SIZE 32
 #define INIT_LANG_COMMENT_TABLE_SIZE 32
 #define INIT_LANG_COMMENT_LIST_SIZE 8
+#define INIT_LANG_COUNTER_TABLE_SIZE 8
+#define INIT_DIR_ROLLUP_LIST_SIZE 8
+#define INIT_EXCLUDE_LIST_SIZE 16
 
 #define GAP_WIDTH 4
 
+/* fds kept for the walk and the rest when queued files hold their directory */
+#define SHARED_FD_RESERVE 256
+
+enum {
+  FORMAT_TABLE,
+  FORMAT_CSV,
+};
+
 #define TRUE 1
 #define FALSE 0
 
 typedef int boolean;
 
+/* read(2) alike: fill buf with up to size bytes, 0 on end, -1 on error */
+typedef ssize_t (*stream_reader) (void *stream, char *buf, size_t size);
+
+/* code unit widths a delimiter is widened to for UTF-16 and UTF-32 files */
+enum {
+  WIDE_UTF16,
+  WIDE_UTF32,
+  WIDE_KINDS,
+};
+
 struct comment_str {
   int len;
   char *val;
+  int wide_len[WIDE_KINDS];
+  unsigned int *wide_val[WIDE_KINDS]; /* val decoded once into code units */
 };
 
 struct comment {
@@ -41,12 +66,22 @@ struct lang_match_pattern {
   char *lang;
 };
 
+/* shape of the lines, only collected when asked for */
+struct line_metrics {
+  long long bytes;
+  int max_line_len;             /* without the line end */
+  long long line_len_sum;       /* of all lines, in code units like max_line_len */
+  int trailing_space_lines;     /* ending with a space or tab */
+  int tab_indent_lines;         /* starting with a tab */
+};
+
 struct line_counter {
-  char *filename;
+  struct path_node *path;
   char *lang;
   int comment_lines;
   int blank_lines;
   int code_lines;
+  struct line_metrics metrics;
 };
 
 #endif
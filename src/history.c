@@ -0,0 +1,167 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <sys/stat.h>
+
+#include "error.h"
+#include "history.h"
+
+void history_init(struct history *history, const struct hcc_context *ctx, struct git_repo *repo) {
+  memset(history, 0, sizeof(struct history));
+  history->ctx = ctx;
+  history->repo = repo;
+  init_read_buffers(&history->rb, &ctx->read_opts);
+  git_oid_map_init(&history->blobs);
+  git_oid_map_init(&history->trees);
+}
+
+static void free_totals(void *value) {
+  struct history_totals *totals = (struct history_totals *) value;
+
+  free(totals->langs);
+  free(totals);
+}
+
+void history_free(struct history *history) {
+  git_oid_map_free(&history->blobs, free);
+  git_oid_map_free(&history->trees, free_totals);
+  free_read_buffers(&history->rb);
+}
+
+static void add_counter(struct line_counter *to, const struct line_counter *counter) {
+  to->code_lines += counter->code_lines;
+  to->comment_lines += counter->comment_lines;
+  to->blank_lines += counter->blank_lines;
+  to->metrics.bytes += counter->metrics.bytes;
+  to->metrics.line_len_sum += counter->metrics.line_len_sum;
+  to->metrics.trailing_space_lines += counter->metrics.trailing_space_lines;
+  to->metrics.tab_indent_lines += counter->metrics.tab_indent_lines;
+  if (counter->metrics.max_line_len > to->metrics.max_line_len) {
+    to->metrics.max_line_len = counter->metrics.max_line_len;
+  }
+}
+
+/* languages are few in a tree, a sorted array is enough */
+static void add_totals(struct history_totals *totals, const struct line_counter *counter) {
+  int i, cmp = 1;
+
+  for (i = 0; i < totals->nlangs && (cmp = strcmp(totals->langs[i].lang, counter->lang)) < 0; i++);
+
+  if (cmp) {
+    if (!(totals->langs = realloc(totals->langs, (totals->nlangs + 1) * sizeof(struct line_counter)))) {
+      error(EXIT_FAILURE, "Cannot alloc history totals");
+    }
+    memmove(&totals->langs[i + 1], &totals->langs[i], (totals->nlangs - i) * sizeof(struct line_counter));
+    memset(&totals->langs[i], 0, sizeof(struct line_counter));
+    totals->langs[i].lang = counter->lang;
+    totals->nlangs++;
+  }
+
+  add_counter(&totals->langs[i], counter);
+}
+
+/* the counts of the blob at path, NULL when it is not counted */
+static const struct line_counter *blob_counter(struct history *history, const unsigned char *oid, const char *path) {
+  struct line_counter *counter;
+  const char *lang;
+  char *buf;
+  size_t len;
+  int status, type;
+
+  if (hcc_match_file(history->ctx, path, &lang) != HCC_OK) {
+    return NULL;
+  }
+
+  /* a language only known from the content is the same for the same blob */
+  if ((counter = (struct line_counter *) git_oid_map_get(&history->blobs, oid, lang))) {
+    return counter->lang ? counter : NULL;
+  }
+
+  if (!(buf = git_read_object(history->repo, oid, &type, &len)) || type != GIT_OBJ_BLOB) {
+    error(EXIT_FAILURE, "Missing git blob: %s", path);
+  }
+
+  if (history->ctx->read_opts.file_rate) {
+    throttle_take(history->ctx->read_opts.file_rate, 1);
+  }
+  if (history->ctx->read_opts.byte_rate) {
+    throttle_take(history->ctx->read_opts.byte_rate, len);
+  }
+
+  if (!(counter = malloc(sizeof(struct line_counter)))) {
+    error(EXIT_FAILURE, "Cannot alloc history counter");
+  }
+
+  if ((status = hcc_count_buffer_rb(history->ctx, &history->rb, buf, len, path, lang, counter)) == HCC_SKIPPED) {
+    counter->lang = NULL;
+  } else if (status) {
+    error(EXIT_FAILURE, "%s: %s", hcc_strerror(status), path);
+  }
+  free(buf);
+
+  git_oid_map_put(&history->blobs, oid, lang, counter);
+  history->blobs_counted++;
+
+  return counter->lang ? counter : NULL;
+}
+
+static const struct history_totals *tree_totals(struct history *history, const unsigned char *oid, char *path, int path_len) {
+  struct history_totals *totals, *sub;
+  const struct line_counter *counter;
+  struct git_tree_entry entry;
+  const char *p;
+  char *buf;
+  size_t len;
+  int i, type;
+
+  if ((totals = (struct history_totals *) git_oid_map_get(&history->trees, oid, path))) {
+    return totals;
+  }
+
+  if (!(buf = git_read_object(history->repo, oid, &type, &len)) || type != GIT_OBJ_TREE) {
+    error(EXIT_FAILURE, "Missing git tree under %s", path);
+  }
+
+  if (!(totals = calloc(1, sizeof(struct history_totals)))) {
+    error(EXIT_FAILURE, "Cannot alloc history totals");
+  }
+
+  for (p = buf; git_tree_next(&p, buf + len, &entry); ) {
+    if (path_len + entry.name_len + 1 >= PATH_MAX) {
+      continue;
+    }
+
+    memcpy(path + path_len, entry.name, entry.name_len);
+    path[path_len + entry.name_len] = '\0';
+
+    if ((entry.mode & S_IFMT) == S_IFDIR) {
+      path[path_len + entry.name_len] = '/';
+      path[path_len + entry.name_len + 1] = '\0';
+      sub = (struct history_totals *) tree_totals(history, entry.oid, path, path_len + entry.name_len + 1);
+      for (i = 0; i < sub->nlangs; i++) {
+        add_totals(totals, &sub->langs[i]);
+      }
+    } else if ((entry.mode & S_IFMT) == S_IFREG && (counter = blob_counter(history, entry.oid, path))) {
+      add_totals(totals, counter);
+    }
+
+    path[path_len] = '\0';
+  }
+
+  free(buf);
+  history->trees_read++;
+  git_oid_map_put(&history->trees, oid, path, totals);
+
+  return totals;
+}
+
+const struct history_totals *history_count(struct history *history, const unsigned char *commit) {
+  unsigned char tree[GIT_OID_SIZE];
+  char path[PATH_MAX];
+
+  git_commit_tree(history->repo, commit, tree);
+  path[0] = '\0';
+
+  return tree_totals(history, tree, path, 0);
+}
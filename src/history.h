@@ -0,0 +1,35 @@
+#ifndef __HCC_HISTORY_H
+#define __HCC_HISTORY_H
+
+#include "hcc.h"
+#include "git.h"
+#include "libhcc.h"
+
+/* per language totals of a tree, sorted by language */
+struct history_totals {
+  struct line_counter *langs;
+  int nlangs;
+};
+
+/*
+ * Line counts of many commits of one repository. A blob is counted once
+ * per language it is met as, and a tree once per path it is met at, after
+ * that both come from the memo tables. Following the history then costs
+ * the blobs and trees that changed, not the files of every commit.
+ */
+struct history {
+  const struct hcc_context *ctx;
+  struct git_repo *repo;
+  struct read_buffers rb;       /* blobs are counted with */
+  struct git_oid_map blobs;     /* (blob, language) to its line_counter, lang NULL when skipped */
+  struct git_oid_map trees;     /* (tree, path) to its history_totals */
+  long long blobs_counted;
+  long long trees_read;
+};
+
+void history_init(struct history *history, const struct hcc_context *ctx, struct git_repo *repo);
+void history_free(struct history *history);
+/* totals of the tree of commit, owned by history */
+const struct history_totals *history_count(struct history *history, const unsigned char *commit);
+
+#endif
@@ -0,0 +1,103 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "inode_set.h"
+
+/* Fibonacci hashing, size is a power of 2 */
+#define inode_slot(ino, size) ((size_t) (((unsigned long long) (ino) * 0x9E3779B97F4A7C15ULL) >> 32) & ((size) - 1))
+
+void init_inode_set(struct inode_set *set) {
+  set->tables = NULL;
+  set->ntables = 0;
+}
+
+void free_inode_set(struct inode_set *set) {
+  int i;
+
+  for (i = 0; i < set->ntables; i++) {
+    free(set->tables[i].slots);
+  }
+
+  free(set->tables);
+  init_inode_set(set);
+}
+
+static struct inode_table *inode_set_table(struct inode_set *set, dev_t dev) {
+  struct inode_table *tables, *table;
+  int i;
+
+  for (i = 0; i < set->ntables; i++) {
+    if (set->tables[i].dev == dev) {
+      return &set->tables[i];
+    }
+  }
+
+  if (!(tables = realloc(set->tables, (set->ntables + 1) * sizeof(struct inode_table)))) {
+    return NULL;
+  }
+  set->tables = tables;
+
+  table = &tables[set->ntables];
+  if (!(table->slots = calloc(INODE_SET_INIT_SIZE, sizeof(ino_t)))) {
+    return NULL;
+  }
+
+  table->dev = dev;
+  table->size = INODE_SET_INIT_SIZE;
+  table->count = 0;
+  set->ntables++;
+
+  return table;
+}
+
+static int inode_table_grow(struct inode_table *table) {
+  ino_t *slots;
+  size_t i, j, size = table->size << 1;
+
+  if (!(slots = calloc(size, sizeof(ino_t)))) {
+    return -1;
+  }
+
+  for (i = 0; i < table->size; i++) {
+    if (table->slots[i]) {
+      for (j = inode_slot(table->slots[i], size); slots[j]; j = (j + 1) & (size - 1));
+      slots[j] = table->slots[i];
+    }
+  }
+
+  free(table->slots);
+  table->slots = slots;
+  table->size = size;
+
+  return 0;
+}
+
+int inode_set_add(struct inode_set *set, dev_t dev, ino_t ino) {
+  struct inode_table *table;
+  size_t i;
+
+  /* no real file has inode 0, never call it a duplicate */
+  if (!ino) {
+    return 1;
+  }
+
+  if (!(table = inode_set_table(set, dev))) {
+    return -1;
+  }
+
+  /* keep the load under 3/4 for short probes */
+  if ((table->count + 1) * 4 > table->size * 3 && inode_table_grow(table)) {
+    return -1;
+  }
+
+  for (i = inode_slot(ino, table->size); table->slots[i]; i = (i + 1) & (table->size - 1)) {
+    if (table->slots[i] == ino) {
+      return 0;
+    }
+  }
+
+  table->slots[i] = ino;
+  table->count++;
+
+  return 1;
+}
@@ -0,0 +1,30 @@
+#ifndef __HCC_INODE_SET_H
+#define __HCC_INODE_SET_H
+
+#include <sys/types.h>
+
+#define INODE_SET_INIT_SIZE 1024
+
+/* one open addressing table of inode numbers per device */
+struct inode_table {
+  dev_t dev;
+  ino_t *slots;                 /* 0 marks a free slot */
+  size_t size;
+  size_t count;
+};
+
+/*
+ * Set of (device, inode) pairs, 8 bytes a slot as devices are few. Not
+ * thread safe.
+ */
+struct inode_set {
+  struct inode_table *tables;
+  int ntables;
+};
+
+void init_inode_set(struct inode_set *set);
+void free_inode_set(struct inode_set *set);
+/* 1 when newly added, 0 when already there, -1 when out of memory */
+int inode_set_add(struct inode_set *set, dev_t dev, ino_t ino);
+
+#endif
@@ -0,0 +1,1522 @@
+#define _GNU_SOURCE             /* required by memmem & openat */
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <ctype.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <fnmatch.h>
+#include <sys/stat.h>
+
+#include "ini.h"
+
+#include "libhcc.h"
+
+#include "comment_defs_string.c"
+
+static struct sq_list *find_lang_comment_list(const struct hcc_context *ctx, const struct sq_list *match_list, const char *str, char **lang) {
+  struct lang_match_pattern *lang_pattern;
+  int i;
+
+  for (i = 0; i < list_size(match_list); i++) {
+    lang_pattern = (struct lang_match_pattern *) list_get(match_list, i);
+
+    if (0 == fnmatch(lang_pattern->pattern, str, 0)) {
+      struct sq_list *comment_list;
+
+      /* definitions are checked at load time, a pattern always has comments */
+      comment_list = (struct sq_list *) hash_table_find(ctx->lang_comment_table, lang_pattern->lang);
+
+      *lang = lang_pattern->lang;
+
+      return comment_list;
+    }
+  }
+
+  return NULL;
+}
+
+#define find_comment_list(ctx, filename, lang) find_lang_comment_list((ctx), &(ctx)->lang_pattern_list, (filename), (lang))
+
+/* copy the word at p (up to a space, ';', ':' or end) lowered into name */
+static int sniff_word(const char *p, const char *end, char *name) {
+  int len = 0;
+
+  while (p < end && (*p == ' ' || *p == '\t')) {
+    p++;
+  }
+
+  while (p < end && len < MAX_SNIFF_NAME_SIZE && !isspace(*p) && *p != ';' && *p != ':') {
+    name[len++] = tolower(*p++);
+  }
+  name[len] = '\0';
+
+  return len;
+}
+
+/* "#!/usr/bin/env -S python3 -u" gives "python3" */
+static struct sq_list *sniff_shebang(const struct hcc_context *ctx, const char *line, const char *end, char **lang) {
+  char name[MAX_SNIFF_NAME_SIZE + 1];
+  const char *p, *base;
+
+  for (p = base = line + 2; p < end && !isspace(*p); p++) {
+    if (*p == '/') {
+      base = p + 1;
+    }
+  }
+
+  if (!sniff_word(base, p, name)) {
+    return NULL;
+  }
+
+  if (!strcmp(name, "env")) {
+    for (;;) {
+      while (p < end && (*p == ' ' || *p == '\t')) {
+        p++;
+      }
+      if (p < end && *p == '-') {   /* env options */
+        while (p < end && !isspace(*p)) {
+          p++;
+        }
+        continue;
+      }
+      break;
+    }
+
+    for (base = p; p < end && !isspace(*p); p++) {
+      if (*p == '/') {
+        base = p + 1;
+      }
+    }
+
+    if (!sniff_word(base, p, name)) {
+      return NULL;
+    }
+  }
+
+  return find_lang_comment_list(ctx, &ctx->lang_interpreter_list, name, lang);
+}
+
+/* emacs "-*- mode: NAME -*-" or "-*- NAME -*-", vim "vim: set ft=NAME:" */
+static struct sq_list *sniff_modeline(const struct hcc_context *ctx, const char *line, const char *end, char **lang) {
+  char name[MAX_SNIFF_NAME_SIZE + 1];
+  const char *p;
+  int len = end - line;
+
+  if ((p = memmem(line, len, "-*-", 3))) {
+    const char *mode = memmem(p + 3, end - p - 3, "mode:", 5);
+
+    if (mode && sniff_word(mode + 5, end, name)) {
+      return find_lang_comment_list(ctx, &ctx->lang_modeline_list, name, lang);
+    } else if (!mode && sniff_word(p + 3, end, name)) {
+      return find_lang_comment_list(ctx, &ctx->lang_modeline_list, name, lang);
+    }
+  }
+
+  if (memmem(line, len, "vim:", 4) || memmem(line, len, "vi:", 3) || memmem(line, len, "ex:", 3)) {
+    static const char *keys[] = { "filetype=", "ft=", "syntax=", "syn=", NULL };
+    const char **key;
+
+    for (key = keys; *key; key++) {
+      if ((p = memmem(line, len, *key, strlen(*key))) && sniff_word(p + strlen(*key), end, name)) {
+        return find_lang_comment_list(ctx, &ctx->lang_modeline_list, name, lang);
+      }
+    }
+  }
+
+  return NULL;
+}
+
+/*
+ * Guess the language of a file from the head of its first read buffer,
+ * looking for a shebang in the first line and a modeline in the first two.
+ */
+static struct sq_list *sniff_comment_list(const struct hcc_context *ctx, const char *buf, ssize_t len, char **lang) {
+  const char *line = buf, *end = buf + len, *eol;
+  struct sq_list *comment_list;
+  int i;
+
+  for (i = 0; i < SNIFF_LINES && line < end; i++, line = eol + 1) {
+    if (!(eol = memchr(line, '\n', end - line))) {
+      eol = end;
+    }
+
+    if (i == 0 && eol - line > 2 && line[0] == '#' && line[1] == '!') {
+      if ((comment_list = sniff_shebang(ctx, line, eol, lang))) {
+        return comment_list;
+      }
+    }
+
+    if ((comment_list = sniff_modeline(ctx, line, eol, lang))) {
+      return comment_list;
+    }
+  }
+
+  return NULL;
+}
+
+enum {
+  COUNTER_COMMENT,
+  COUNTER_BLANK,
+  COUNTER_CODE,
+};
+
+#define update_counter(type, counter)           \
+  do {                                          \
+    switch (type) {                             \
+    case COUNTER_COMMENT:                       \
+      (counter)->comment_lines++;               \
+      break;                                    \
+    case COUNTER_BLANK:                         \
+      (counter)->blank_lines++;                 \
+      break;                                    \
+    case COUNTER_CODE:                          \
+      (counter)->code_lines++;                  \
+      break;                                    \
+    }                                           \
+  } while (0)
+
+/* a line being measured, it may span buffers */
+struct metrics_state {
+  int line_len;
+  char last[2];                 /* last two chars of the line so far */
+};
+
+/* a last line without a line end is measured, but not counted nor averaged */
+static void end_metrics_line(struct metrics_state *ms, struct line_metrics *metrics, boolean ended) {
+  int len = ms->line_len;
+  char c = ms->last[1];
+
+  if (c == '\r' && len) {
+    c = ms->last[0];
+    len--;
+  }
+
+  if (ended) {
+    metrics->line_len_sum += len;
+  }
+  if (len > metrics->max_line_len) {
+    metrics->max_line_len = len;
+  }
+  if (len && (c == ' ' || c == '\t')) {
+    metrics->trailing_space_lines++;
+  }
+
+  ms->line_len = 0;
+  ms->last[0] = ms->last[1] = '\0';
+}
+
+/* measure the lines of a buffer, each byte read is measured once */
+static void scan_metrics(struct metrics_state *ms, const char *buf, ssize_t len, struct line_metrics *metrics) {
+  const char *p = buf, *end = buf + len, *eol;
+
+  metrics->bytes += len;
+
+  while (p < end) {
+    if (!ms->line_len && *p == '\t') {
+      metrics->tab_indent_lines++;
+    }
+
+    eol = memchr(p, '\n', end - p);
+    if (!eol) {
+      eol = end;
+    }
+
+    if (eol - p >= 2) {
+      ms->last[0] = eol[-2];
+      ms->last[1] = eol[-1];
+    } else if (eol - p == 1) {
+      ms->last[0] = ms->last[1];
+      ms->last[1] = eol[-1];
+    }
+    ms->line_len += eol - p;
+
+    if (eol == end) {
+      break;
+    }
+
+    end_metrics_line(ms, metrics, TRUE);
+    p = eol + 1;
+  }
+}
+
+/*
+ * read_buf must have READ_BUFFER_FRONT bytes room in front of it and hold
+ * buf_size bytes, the first bytes_read bytes of it are already filled.
+ */
+static int count_line(const struct hcc_context *ctx, stream_reader reader, void *stream, struct sq_list *comment_list, struct line_counter *counter,
+                      char *read_buf, size_t buf_size, ssize_t bytes_read) {
+  ssize_t pos = 0;
+  boolean in_code = FALSE, in_comment = FALSE, end_comment = FALSE;
+  struct comment *cp = NULL;
+  struct metrics_state ms = { 0 };
+  int i, status = HCC_OK;
+
+#ifdef DEBUG
+  int line_start_pos = 0;
+  int incomplete_line_len = 0;
+  char *incomplete_line_buf = NULL;
+
+#define print_scan_line(C)                                              \
+  do {                                                                  \
+    if (ctx->debug) {                                                   \
+      putchar(C);                                                       \
+      if (incomplete_line_len) {                                        \
+        fwrite(incomplete_line_buf, 1, incomplete_line_len, stdout);    \
+        incomplete_line_len = 0;                                        \
+      }                                                                 \
+      fwrite(read_buf + line_start_pos, 1, pos - line_start_pos + 1, stdout); \
+      line_start_pos = pos + 1;                                         \
+    }                                                                   \
+  } while (0)
+#else
+#define print_scan_line(c)
+#endif
+
+  for (; bytes_read || (bytes_read = reader(stream, read_buf, buf_size)); bytes_read = 0) {
+    if (bytes_read == -1) {
+      status = HCC_ERR_READ;
+      break;
+    }
+
+    /* apart from the scan below, so it stays as it is without metrics */
+    if (ctx->metrics) {
+      scan_metrics(&ms, read_buf, bytes_read, &counter->metrics);
+    }
+
+    pos = pos < 0 ? pos : 0;
+    while (pos < bytes_read) {
+      if (in_code) {
+        if (read_buf[pos] == '\n') {
+          update_counter(COUNTER_CODE, counter);
+          /* set in_code to FALSE in order to test next line type */
+          in_code = FALSE;
+
+          print_scan_line(' ');
+        }
+        pos++;
+      } else if (in_comment) {
+        if (cp->end.len && cp->end.val[0] == read_buf[pos]) { /* comment block and first end comment char is match with current pos */
+          int bytes_left = bytes_read - pos;
+          int len = bytes_left < cp->end.len ? bytes_left : cp->end.len;
+
+          if (!strncmp(cp->end.val, read_buf + pos, len)) {
+            if (bytes_left < cp->end.len) { /* partial match */
+#ifdef DEBUG
+              {
+                char buf[MAX_COMMENT_SIZE];
+                struct comment_str *str = &cp->end;
+
+                strncpy(buf, str->val, str->len);
+                buf[str->len] = '\0';
+
+                printf("Partial match with %s\n", buf);
+              }
+#endif
+              strncpy(read_buf - len, read_buf + pos, len);
+              pos = -len;
+
+              break;            /* refill buffer */
+            }
+
+            end_comment = TRUE;
+            pos += len;
+          } else {
+            pos++;
+          }
+        } else if (read_buf[pos] == '\n') {
+          update_counter(COUNTER_COMMENT, counter);
+
+          if (end_comment) {
+            in_comment = end_comment = FALSE;
+          } else if (!cp->end.len) {   /* inline comment */
+            in_comment = FALSE;
+          }
+
+          print_scan_line('C');
+
+          pos++;
+        } else if (!isspace(read_buf[pos])) { /* not a space charactor */
+          if (end_comment) {                  /* when non-space charactor follows then end of comment, re-check */
+            in_comment = end_comment = FALSE;
+          } else {
+            pos++;
+          }
+        } else {
+          pos++;
+        }
+      } else {
+        if (read_buf[pos] == '\n') {
+          update_counter(COUNTER_BLANK, counter);
+
+          print_scan_line('B');
+
+          pos++;
+        } else if (!isspace(read_buf[pos])) { /* not space charactor */
+          int bytes_left = bytes_read - pos, bytes_match = 0;
+
+          for (i = 0; i < list_size(comment_list); i++) {
+            int len;
+
+            cp = (struct comment *) list_get(comment_list, i);
+            len = bytes_left < cp->start.len ? bytes_left : cp->start.len;
+
+            if (!strncmp(cp->start.val, read_buf + pos, len)) {
+              bytes_match = len;
+              if (bytes_left < cp->start.len) { /* partial match */
+#ifdef DEBUG
+                {
+                  char buf[MAX_COMMENT_SIZE];
+                  struct comment_str *str = &cp->start;
+
+                  strncpy(buf, str->val, str->len);
+                  buf[str->len] = '\0';
+
+                  printf("Partial match with %s\n", buf);
+                }
+#endif
+                strncpy(read_buf - len, read_buf + pos, len);
+                pos = -len;
+              } else {
+                in_comment = TRUE;
+              }
+
+              break;
+            }
+          }
+
+          if (!in_comment) {
+            if (pos < 0) {      /* partial match, refill buffer */
+              break;
+            } else {
+              in_code = TRUE;
+            }
+          }
+
+          pos += (bytes_match ? bytes_match : 1);
+        } else {                /* is white space charactor */
+          pos++;
+        }
+      }
+    }
+
+#ifdef DEBUG
+    if (ctx->debug) {
+      if (read_buf[pos] != '\n') {
+        int len = pos - line_start_pos + 1;
+        char *buf;
+
+        if (incomplete_line_len) {
+          if (!(buf = realloc(incomplete_line_buf, incomplete_line_len + len))) {
+            status = HCC_ERR_NOMEM;
+            break;
+          }
+          incomplete_line_buf = buf;
+
+          buf += incomplete_line_len;
+        } else {
+          if (incomplete_line_buf && incomplete_line_len < len) {
+            free(incomplete_line_buf);
+            incomplete_line_buf = NULL;
+          }
+
+          if (!incomplete_line_buf) {
+            if(!(incomplete_line_buf = malloc(len))) {
+              status = HCC_ERR_NOMEM;
+              break;
+            }
+          }
+
+          buf = incomplete_line_buf;
+        }
+
+        memcpy(buf, read_buf + line_start_pos, len);
+        incomplete_line_len += len;
+      }
+
+      line_start_pos = 0;
+    }
+#endif
+  }
+
+#ifdef DEBUG
+  if (incomplete_line_buf) {
+    free(incomplete_line_buf);
+  }
+#endif
+
+  /* a last line without line end */
+  if (ms.line_len) {
+    end_metrics_line(&ms, &counter->metrics, FALSE);
+  }
+
+  return status;
+}
+
+/* how the content of a file is encoded, from its byte order mark */
+enum {
+  ENCODING_BYTES,               /* ASCII compatible, counted byte by byte */
+  ENCODING_UTF16LE,
+  ENCODING_UTF16BE,
+  ENCODING_UTF32LE,
+  ENCODING_UTF32BE,
+};
+
+#define encoding_unit(enc) ((enc) >= ENCODING_UTF32LE ? 4 : 2)
+#define encoding_big_endian(enc) ((enc) == ENCODING_UTF16BE || (enc) == ENCODING_UTF32BE)
+
+static int detect_encoding(const char *buf, ssize_t len) {
+  const unsigned char *p = (const unsigned char *) buf;
+
+  if (len >= 4 && p[0] == 0xff && p[1] == 0xfe && !p[2] && !p[3]) {
+    return ENCODING_UTF32LE;
+  }
+  if (len >= 4 && !p[0] && !p[1] && p[2] == 0xfe && p[3] == 0xff) {
+    return ENCODING_UTF32BE;
+  }
+  if (len >= 2 && p[0] == 0xff && p[1] == 0xfe) {
+    return ENCODING_UTF16LE;
+  }
+  if (len >= 2 && p[0] == 0xfe && p[1] == 0xff) {
+    return ENCODING_UTF16BE;
+  }
+
+  return ENCODING_BYTES;
+}
+
+/* the code unit at p, which may be unaligned */
+static unsigned int wide_unit(const char *p, int enc) {
+  const unsigned char *u = (const unsigned char *) p;
+
+  switch (enc) {
+  case ENCODING_UTF16LE:
+    return u[0] | u[1] << 8;
+  case ENCODING_UTF16BE:
+    return u[0] << 8 | u[1];
+  case ENCODING_UTF32LE:
+    return u[0] | u[1] << 8 | u[2] << 16 | (unsigned int) u[3] << 24;
+  default:
+    return (unsigned int) u[0] << 24 | u[1] << 16 | u[2] << 8 | u[3];
+  }
+}
+
+#define wide_space(c) ((c) < 0x80 && isspace(c))
+
+/*
+ * The first line end unit from p on, end is on a unit boundary. memchr
+ * finds the '\n' byte with its vector loop, a hit that is not the low
+ * byte of a unit of its own is only part of another character.
+ */
+static const char *wide_newline(const char *p, const char *end, int enc) {
+  int unit = encoding_unit(enc), low = encoding_big_endian(enc) ? unit - 1 : 0;
+  const char *q;
+
+  for (q = p + low; q < end && (q = memchr(q, '\n', end - q)); q++) {
+    if (!((q - p - low) & (unit - 1)) && wide_unit(q - low, enc) == '\n') {
+      return q - low;
+    }
+  }
+
+  return NULL;
+}
+
+/* compare n units at p with the widened delimiter val */
+static boolean wide_match(const char *p, const unsigned int *val, int n, int enc) {
+  int i, unit = encoding_unit(enc);
+
+  for (i = 0; i < n; i++, p += unit) {
+    if (wide_unit(p, enc) != val[i]) {
+      return FALSE;
+    }
+  }
+
+  return TRUE;
+}
+
+/* scan_metrics over whole units from p to end, lengths are in units */
+static void scan_wide_metrics(struct metrics_state *ms, const char *p, const char *end, int enc, struct line_metrics *metrics) {
+  int unit = encoding_unit(enc);
+  const char *eol;
+  unsigned int c;
+
+  while (p < end) {
+    if (!ms->line_len && wide_unit(p, enc) == '\t') {
+      metrics->tab_indent_lines++;
+    }
+
+    if (!(eol = wide_newline(p, end, enc))) {
+      eol = end;
+    }
+
+    /* only spaces, tabs and carriage returns matter at the end of a line */
+    if (eol - p >= 2 * unit) {
+      c = wide_unit(eol - 2 * unit, enc);
+      ms->last[0] = c < 0x80 ? c : 'x';
+    } else if (eol - p == unit) {
+      ms->last[0] = ms->last[1];
+    }
+    if (eol > p) {
+      c = wide_unit(eol - unit, enc);
+      ms->last[1] = c < 0x80 ? c : 'x';
+    }
+    ms->line_len += (eol - p) / unit;
+
+    if (eol == end) {
+      break;
+    }
+
+    end_metrics_line(ms, metrics, TRUE);
+    p = eol + unit;
+  }
+}
+
+/*
+ * count_line for UTF-16 and UTF-32 files, read_buf starts with the byte
+ * order mark. Units are compared in place with the delimiters widened at
+ * load time, nothing is converted. A unit or delimiter cut by the end of
+ * a buffer is carried in front of the next one.
+ */
+static int count_wide_line(const struct hcc_context *ctx, stream_reader reader, void *stream, struct sq_list *comment_list, struct line_counter *counter,
+                           char *read_buf, size_t buf_size, ssize_t bytes_read, int enc) {
+  int unit = encoding_unit(enc), wide = unit == 4 ? WIDE_UTF32 : WIDE_UTF16;
+  ssize_t pos = unit, end, stray = 0, carry;
+  boolean in_code = FALSE, in_comment = FALSE, end_comment = FALSE, partial;
+  struct comment *cp = NULL;
+  struct metrics_state ms = { 0 };
+  const char *eol;
+  unsigned int c;
+  int i, n, len, status = HCC_OK;
+
+  for (; bytes_read || (bytes_read = reader(stream, read_buf, buf_size)); bytes_read = 0) {
+    if (bytes_read == -1) {
+      status = HCC_ERR_READ;
+      break;
+    }
+
+    /* bytes of a unit cut at the end are left for the next buffer */
+    end = bytes_read - (bytes_read - pos) % unit;
+    partial = FALSE;
+
+    if (ctx->metrics) {
+      counter->metrics.bytes += bytes_read;
+      /* units carried with a partial delimiter were measured already */
+      scan_wide_metrics(&ms, read_buf + (pos > 0 ? pos : -stray), read_buf + end, enc, &counter->metrics);
+    }
+
+    while (pos < end) {
+      c = wide_unit(read_buf + pos, enc);
+
+      if (in_code) {
+        if ((eol = wide_newline(read_buf + pos, read_buf + end, enc))) {
+          update_counter(COUNTER_CODE, counter);
+          in_code = FALSE;
+          pos = eol - read_buf + unit;
+        } else {
+          pos = end;
+        }
+      } else if (in_comment) {
+        if (cp->end.len && cp->end.wide_val[wide][0] == c) {
+          n = (end - pos) / unit;
+          len = n < cp->end.wide_len[wide] ? n : cp->end.wide_len[wide];
+
+          if (wide_match(read_buf + pos, cp->end.wide_val[wide], len, enc)) {
+            if (n < cp->end.wide_len[wide]) {
+              partial = TRUE;
+              break;            /* refill buffer */
+            }
+
+            end_comment = TRUE;
+            pos += len * unit;
+          } else {
+            pos += unit;
+          }
+        } else if (c == '\n') {
+          update_counter(COUNTER_COMMENT, counter);
+
+          if (end_comment) {
+            in_comment = end_comment = FALSE;
+          } else if (!cp->end.len) {
+            in_comment = FALSE;
+          }
+
+          pos += unit;
+        } else if (!wide_space(c)) {
+          if (end_comment) {
+            in_comment = end_comment = FALSE;
+          } else {
+            pos += unit;
+          }
+        } else {
+          pos += unit;
+        }
+      } else {
+        if (c == '\n') {
+          update_counter(COUNTER_BLANK, counter);
+          pos += unit;
+        } else if (!wide_space(c)) {
+          n = (end - pos) / unit;
+          len = 0;
+
+          for (i = 0; i < list_size(comment_list); i++) {
+            cp = (struct comment *) list_get(comment_list, i);
+            len = n < cp->start.wide_len[wide] ? n : cp->start.wide_len[wide];
+
+            if (wide_match(read_buf + pos, cp->start.wide_val[wide], len, enc)) {
+              if (n < cp->start.wide_len[wide]) {
+                partial = TRUE;
+              } else {
+                in_comment = TRUE;
+              }
+              break;
+            }
+            len = 0;
+          }
+
+          if (partial) {
+            break;              /* refill buffer */
+          }
+          if (!in_comment) {
+            in_code = TRUE;
+          }
+
+          pos += len ? len * unit : unit;
+        } else {
+          pos += unit;
+        }
+      }
+    }
+
+    /* the units of a partial delimiter go with the cut unit, if any */
+    stray = bytes_read - end;
+    carry = partial ? bytes_read - pos : stray;
+    memmove(read_buf - carry, read_buf + bytes_read - carry, carry);
+    pos = -carry;
+  }
+
+  if (ms.line_len) {
+    end_metrics_line(&ms, &counter->metrics, FALSE);
+  }
+
+  return status;
+}
+
+#define init_line_counter(counter, lang_str)   \
+  do {                                          \
+    (counter)->path = NULL;                     \
+    (counter)->lang = (lang_str);               \
+    (counter)->blank_lines = 0;                 \
+    (counter)->code_lines = 0;                  \
+    (counter)->comment_lines = 0;               \
+    memset(&(counter)->metrics, 0, sizeof(struct line_metrics)); \
+  } while (0)
+
+/*
+ * Find the comment list of filename. Return HCC_EXCLUDED, or HCC_SKIPPED
+ * when no language matched and it is not worth to guess the language from
+ * the content. The comment list is left NULL when it is to be guessed.
+ */
+static int match_file(const struct hcc_context *ctx, const char *filename, struct sq_list **comment_list, char **lang) {
+  const char *base;
+  int i;
+
+  for (i = 0; i < list_size(&ctx->exclude_list); i++) {
+    if (!fnmatch((char *) list_get(&ctx->exclude_list, i), filename, 0)) {
+      return HCC_EXCLUDED;
+    }
+  }
+
+  if (!(*comment_list = find_comment_list(ctx, filename, lang))) {
+    /* only extensionless files are worth opening to look inside */
+    base = strrchr(filename, '/');
+    base = base ? base + 1 : filename;
+    if (strchr(base, '.') || !(list_size(&ctx->lang_interpreter_list) || list_size(&ctx->lang_modeline_list))) {
+      return HCC_SKIPPED;
+    }
+  }
+
+  return HCC_OK;
+}
+
+/* case insensitive language lookup, lang is set to the context's own copy */
+static struct sq_list *lookup_lang(const struct hcc_context *ctx, const char *name, char **lang) {
+  char clang[MAX_LANG_SIZE + 1];
+  int i;
+
+  for (i = 0; i < MAX_LANG_SIZE && name[i]; i++) {
+    clang[i] = tolower(name[i]);
+  }
+  clang[i] = '\0';
+
+  if (!(*lang = (char *) hash_table_find_key(ctx->lang_comment_table, clang))) {
+    return NULL;
+  }
+
+  return (struct sq_list *) hash_table_find(ctx->lang_comment_table, clang);
+}
+
+/*
+ * Count the stream with buffers from rb. The first buffer tells the
+ * encoding and, when comment_list is NULL, the language, it is then
+ * counted without reading it again. fs is the fd stream under reader, or
+ * NULL, when the size is not known and the first read fills its buffer
+ * the read strategy is picked from fstat.
+ */
+static int scan_stream(const struct hcc_context *ctx, struct read_buffers *rb, stream_reader reader, void *stream, struct fd_stream *fs,
+                       off_t size, struct sq_list *comment_list, char *lang, struct line_counter *counter) {
+  char *read_buf, *buf;
+  size_t buf_size, new_size;
+  ssize_t bytes_read;
+  struct stat sb;
+  int enc;
+
+  if (!(read_buf = read_buffers_get(rb, size, &buf_size))) {
+    return HCC_ERR_NOMEM;
+  }
+
+  if ((bytes_read = reader(stream, read_buf, buf_size)) == -1) {
+    return HCC_ERR_READ;
+  }
+
+  /* most files end within the first read and are never stat'ed */
+  if (fs && size <= 0 && (size_t) bytes_read == buf_size && !fstat(fs->fd, &sb) && sb.st_size > bytes_read) {
+    fd_stream_advise(fs, sb.st_size, &ctx->read_opts);
+
+    /* the buffer of a large file takes over with what is read so far */
+    if ((buf = read_buffers_get(rb, sb.st_size, &new_size)) && new_size >= buf_size) {
+      if (buf != read_buf) {
+        memcpy(buf, read_buf, bytes_read);
+      }
+      read_buf = buf;
+      buf_size = new_size;
+    }
+  }
+
+  enc = detect_encoding(read_buf, bytes_read);
+
+  /* shebangs and modelines are only looked for in byte encoded files */
+  if (!comment_list) {
+    if (enc != ENCODING_BYTES || !(comment_list = sniff_comment_list(ctx, read_buf, bytes_read, &lang))) {
+      return HCC_SKIPPED;
+    }
+  }
+
+  init_line_counter(counter, lang);
+
+  if (!bytes_read) {
+    return HCC_OK;
+  }
+
+  if (enc != ENCODING_BYTES) {
+    return count_wide_line(ctx, reader, stream, comment_list, counter, read_buf, buf_size, bytes_read, enc);
+  }
+
+  return count_line(ctx, reader, stream, comment_list, counter, read_buf, buf_size, bytes_read);
+}
+
+static int count_stream(const struct hcc_context *ctx, struct read_buffers *rb, stream_reader reader, void *stream, off_t size,
+                        const char *filename, const char *lang, struct line_counter *counter) {
+  struct sq_list *comment_list = NULL;
+  char *clang = NULL;
+  int status;
+
+  if (lang) {
+    if (!(comment_list = lookup_lang(ctx, lang, &clang))) {
+      return HCC_ERR_LANG;
+    }
+  } else if ((status = match_file(ctx, filename, &comment_list, &clang)) != HCC_OK) {
+    return status;
+  }
+
+  return scan_stream(ctx, rb, reader, stream, NULL, size, comment_list, clang, counter);
+}
+
+int hcc_match_file(const struct hcc_context *ctx, const char *filename, const char **lang) {
+  struct sq_list *comment_list;
+  char *clang = NULL;
+  int status;
+
+  status = match_file(ctx, filename, &comment_list, &clang);
+  *lang = clang;
+
+  return status;
+}
+
+int hcc_count_stream(const struct hcc_context *ctx, stream_reader reader, void *stream, off_t size,
+                     const char *filename, const char *lang, struct line_counter *counter) {
+  struct read_buffers rb;
+  int status;
+
+  init_read_buffers(&rb, &ctx->read_opts);
+  status = count_stream(ctx, &rb, reader, stream, size, filename, lang, counter);
+  free_read_buffers(&rb);
+
+  return status;
+}
+
+struct buffer_stream {
+  const char *pos;
+  size_t left;
+};
+
+static ssize_t buffer_stream_read(void *stream, char *buf, size_t size) {
+  struct buffer_stream *bs = (struct buffer_stream *) stream;
+
+  if (size > bs->left) {
+    size = bs->left;
+  }
+
+  memcpy(buf, bs->pos, size);
+  bs->pos += size;
+  bs->left -= size;
+
+  return size;
+}
+
+int hcc_count_buffer_rb(const struct hcc_context *ctx, struct read_buffers *rb, const char *buf, size_t len,
+                        const char *filename, const char *lang, struct line_counter *counter) {
+  struct buffer_stream bs;
+
+  bs.pos = buf;
+  bs.left = len;
+
+  return count_stream(ctx, rb, buffer_stream_read, &bs, len, filename, lang, counter);
+}
+
+int hcc_count_buffer(const struct hcc_context *ctx, const char *buf, size_t len,
+                     const char *filename, const char *lang, struct line_counter *counter) {
+  struct read_buffers rb;
+  int status;
+
+  init_read_buffers(&rb, &ctx->read_opts);
+  status = hcc_count_buffer_rb(ctx, &rb, buf, len, filename, lang, counter);
+  free_read_buffers(&rb);
+
+  return status;
+}
+
+int hcc_count_fd(const struct hcc_context *ctx, int fd, off_t size,
+                 const char *filename, const char *lang, struct line_counter *counter) {
+  struct fd_stream fs;
+
+  fd_stream_init(&fs, fd, size, FALSE, &ctx->read_opts);
+
+  return hcc_count_stream(ctx, fd_stream_read, &fs, size, filename, lang, counter);
+}
+
+/* fd stream reporting every read as a span */
+struct traced_stream {
+  struct fd_stream fs;
+  struct trace *trace;
+  off_t bytes;
+};
+
+static ssize_t traced_read(void *stream, char *buf, size_t size) {
+  struct traced_stream *ts = (struct traced_stream *) stream;
+  long long start;
+  ssize_t bytes_read;
+
+  /* the end of a file of known size is no read() */
+  if (ts->fs.size != -1 && ts->fs.pos >= ts->fs.size) {
+    return 0;
+  }
+
+  start = trace_now();
+  bytes_read = fd_stream_read(&ts->fs, buf, size);
+  trace_span(ts->trace, "file", "read", NULL, start, trace_now(), bytes_read);
+
+  if (bytes_read > 0) {
+    ts->bytes += bytes_read;
+  }
+
+  return bytes_read;
+}
+
+/*
+ * filename is the full path used for pattern matching, the file itself, a
+ * regular file, is opened by name relative to dirfd, which may be AT_FDCWD.
+ */
+static int count_file(const struct hcc_context *ctx, struct read_buffers *rb, int dirfd, const char *name, off_t size,
+                      const char *filename, struct line_counter *counter) {
+  struct sq_list *comment_list;
+  struct traced_stream ts;
+  struct stat sb, now;
+  char *lang = NULL;
+  int fd, status, saved_errno;
+  boolean cacheable = FALSE, unchanged = FALSE;
+  long long start = 0, opened, end;
+
+  if ((status = match_file(ctx, filename, &comment_list, &lang)) != HCC_OK) {
+    return status;
+  }
+
+  /* one stat relative to the directory serves the lookup and the store */
+  if (ctx->cache && !fstatat(dirfd, name, &sb, AT_SYMLINK_NOFOLLOW)) {
+    if (ctx->cache->lookup(filename, lang, &sb, counter, ctx->cache->arg)) {
+      counter->path = NULL;
+      return HCC_OK;
+    }
+    cacheable = TRUE;
+  }
+
+  if (ctx->read_opts.file_rate) {
+    throttle_take(ctx->read_opts.file_rate, 1);
+  }
+
+  if (ctx->trace) {
+    start = trace_now();
+  }
+
+  fd = openat(dirfd, name, O_RDONLY | O_CLOEXEC);
+  if (fd == -1) {
+    return HCC_ERR_OPEN;
+  }
+
+  fd_stream_init(&ts.fs, fd, size, TRUE, &ctx->read_opts);
+
+  if (!ctx->trace) {
+    status = scan_stream(ctx, rb, fd_stream_read, &ts.fs, &ts.fs, size, comment_list, lang, counter);
+  } else {
+    opened = trace_now();
+    ts.trace = ctx->trace;
+    ts.bytes = 0;
+
+    status = scan_stream(ctx, rb, traced_read, &ts, &ts.fs, size, comment_list, lang, counter);
+
+    end = trace_now();
+    trace_span(ctx->trace, "file", "open", NULL, start, opened, -1);
+    trace_span(ctx->trace, "file", "count", NULL, opened, end, ts.bytes);
+    trace_span(ctx->trace, "file", "file", filename, start, end, ts.bytes);
+    trace_file_time(ctx->trace, filename, end - start);
+  }
+
+  /* keep errno of a failed read for the caller */
+  saved_errno = errno;
+
+  /* a file changed while it was read is not stored */
+  if (cacheable && status == HCC_OK && !fstat(fd, &now)) {
+    unchanged = sb.st_dev == now.st_dev && sb.st_ino == now.st_ino && sb.st_size == now.st_size
+      && sb.st_mtim.tv_sec == now.st_mtim.tv_sec && sb.st_mtim.tv_nsec == now.st_mtim.tv_nsec
+      && sb.st_ctim.tv_sec == now.st_ctim.tv_sec && sb.st_ctim.tv_nsec == now.st_ctim.tv_nsec;
+  }
+
+  close(fd);
+  errno = saved_errno;
+
+  if (unchanged) {
+    ctx->cache->store(filename, lang, &sb, counter, ctx->cache->arg);
+  }
+
+  return status;
+}
+
+int hcc_count_file_rb(const struct hcc_context *ctx, struct read_buffers *rb, int dirfd, const char *name, off_t size,
+                      const char *filename, struct line_counter *counter) {
+  return count_file(ctx, rb, dirfd, name, size, filename, counter);
+}
+
+int hcc_count_file(const struct hcc_context *ctx, int dirfd, const char *name, off_t size,
+                   const char *filename, struct line_counter *counter) {
+  struct read_buffers rb;
+  int status;
+
+  init_read_buffers(&rb, &ctx->read_opts);
+  status = count_file(ctx, &rb, dirfd, name, size, filename, counter);
+  free_read_buffers(&rb);
+
+  return status;
+}
+
+struct count_tree_state {
+  const struct hcc_context *ctx;
+  struct read_buffers rb;
+  hcc_file_func func;
+  void *arg;
+};
+
+static int count_tree_file(const struct walk_entry *entry, void *arg) {
+  struct count_tree_state *state = (struct count_tree_state *) arg;
+  struct line_counter counter;
+  struct hcc_file file;
+  off_t size = entry->stat_mask & WALK_STAT_SIZE ? entry->size : -1;
+
+  file.status = count_file(state->ctx, &state->rb, entry->dirfd, entry->name, size, entry->path, &counter);
+  /* excluded files are not worth a callback */
+  if (file.status == HCC_EXCLUDED) {
+    return 0;
+  }
+
+  file.filename = entry->path;
+  file.entry = entry;
+  file.counter = &counter;
+
+  return state->func(&file, state->arg);
+}
+
+/*
+ * Return HCC_OK when the whole tree is counted, HCC_ERR_WALK when it
+ * cannot be walked, or the non-zero value func stopped the walk with.
+ */
+int hcc_count_tree(const struct hcc_context *ctx, const char *root, hcc_file_func func, void *arg) {
+  struct count_tree_state state;
+  int ret;
+
+  state.ctx = ctx;
+  state.func = func;
+  state.arg = arg;
+  init_read_buffers(&state.rb, &ctx->read_opts);
+
+  ret = walk_tree(root, &ctx->walk_opts, count_tree_file, &state);
+
+  free_read_buffers(&state.rb);
+
+  return ret == -1 ? HCC_ERR_WALK : ret;
+}
+
+static int create_comment_list(struct bucket *bktp, const char *key) {
+  char *lang_key;
+  struct sq_list *comment_list;
+
+  if (!(comment_list = malloc(sizeof(struct sq_list)))) {
+    return -1;
+  }
+
+  if (init_sq_list(comment_list, INIT_LANG_COMMENT_LIST_SIZE) || !(lang_key = strdup(key))) {
+    free(comment_list);
+    return -1;
+  }
+
+  bktp->key = lang_key;
+  bktp->value = comment_list;
+
+  return 0;
+}
+
+/*
+ * Decode the UTF-8 delimiter str into the UTF-16 and UTF-32 code units
+ * wide files are matched with, once for all files. A byte that is not
+ * part of a UTF-8 sequence stands for itself.
+ */
+static int widen_comment_str(struct comment_str *str) {
+  const unsigned char *p = (const unsigned char *) str->val, *end = p + str->len;
+  unsigned int *utf16, *utf32, c;
+  int n16 = 0, n32 = 0, n;
+
+  /* a character takes at most as many units as it has bytes */
+  if (!(utf16 = malloc(2 * (str->len + 1) * sizeof(unsigned int)))) {
+    return -1;
+  }
+  utf32 = utf16 + str->len + 1;
+
+  while (p < end) {
+    c = *p;
+    n = 1;
+
+    if (c >= 0xf0 && c < 0xf8 && end - p >= 4) {
+      c = (c & 0x07) << 18 | (p[1] & 0x3f) << 12 | (p[2] & 0x3f) << 6 | (p[3] & 0x3f);
+      n = 4;
+    } else if (c >= 0xe0 && c < 0xf0 && end - p >= 3) {
+      c = (c & 0x0f) << 12 | (p[1] & 0x3f) << 6 | (p[2] & 0x3f);
+      n = 3;
+    } else if (c >= 0xc0 && c < 0xe0 && end - p >= 2) {
+      c = (c & 0x1f) << 6 | (p[1] & 0x3f);
+      n = 2;
+    }
+
+    utf32[n32++] = c;
+    if (c >= 0x10000) {
+      utf16[n16++] = 0xd800 + ((c - 0x10000) >> 10);
+      utf16[n16++] = 0xdc00 + ((c - 0x10000) & 0x3ff);
+    } else {
+      utf16[n16++] = c;
+    }
+
+    p += n;
+  }
+
+  str->wide_val[WIDE_UTF16] = utf16;
+  str->wide_len[WIDE_UTF16] = n16;
+  str->wide_val[WIDE_UTF32] = utf32;
+  str->wide_len[WIDE_UTF32] = n32;
+
+  return 0;
+}
+
+static struct comment *create_comment_from_string(const char *str) {
+  struct comment *comment;
+  int str_len;
+  char *cpy, *p;
+
+  str_len = strlen(str);
+
+  if (!(cpy = malloc(str_len + 1))) {
+    return NULL;
+  }
+
+  if (!(comment = malloc(sizeof(struct comment)))) {
+    free(cpy);
+    return NULL;
+  }
+
+  memcpy(cpy, str, str_len + 1);
+
+  /* TODO: trim leading & trailing space charactors first */
+
+  p = strchr(cpy, ' ');
+  if (p) {
+    int start_len = p - cpy;
+
+    comment->start.len = start_len;
+    comment->start.val = cpy;
+    comment->end.len = str_len - start_len - 1;
+    comment->end.val = p + 1;
+  } else {
+    comment->start.len = str_len;
+    comment->start.val = cpy;
+    comment->end.len = 0;
+    comment->end.val = NULL;
+  }
+
+  if (widen_comment_str(&comment->start)) {
+    free(cpy);
+    free(comment);
+    return NULL;
+  }
+  if (widen_comment_str(&comment->end)) {
+    free(comment->start.wide_val[WIDE_UTF16]);
+    free(cpy);
+    free(comment);
+    return NULL;
+  }
+
+  return comment;
+}
+
+#define strtolower(str)                         \
+  do {                                          \
+    char *p = str;                              \
+    while ((*p)) {                              \
+      (*p) = tolower((*p));                     \
+      p++;                                      \
+    }                                           \
+  } while (0)
+
+#define update_field_width(field, width)        \
+  do {                                          \
+    int w = (width);                            \
+    if (w > (field)) {                          \
+      (field) = w;                              \
+    }                                           \
+  } while (0)
+
+static int add_lang_match_pattern(struct sq_list *list, const char *lang, const char *value) {
+  struct lang_match_pattern *lang_pattern;
+
+  if (!(lang_pattern = malloc(sizeof(struct lang_match_pattern)))) {
+    return -1;
+  }
+
+  lang_pattern->lang = strdup(lang);
+  lang_pattern->pattern = strdup(value);
+
+  if (!lang_pattern->lang || !lang_pattern->pattern || list_append(list, lang_pattern)) {
+    free(lang_pattern->lang);
+    free(lang_pattern->pattern);
+    free(lang_pattern);
+    return -1;
+  }
+
+  return 0;
+}
+
+/* ini handler, a 0 return makes ini_parse report the line */
+static int build_comment_def(void *user, const char *lang, const char *name, const char *value) {
+  struct hcc_context *ctx = (struct hcc_context *) user;
+  char clang[MAX_LANG_SIZE + 1];
+  int ret = 0;
+
+  strncpy(clang, lang, MAX_LANG_SIZE);
+  clang[MAX_LANG_SIZE] = '\0';
+
+  strtolower(clang);
+
+  update_field_width(ctx->defs_width.lang, strlen(clang));
+
+  if (!strcmp(name, "pattern")) {
+    ret = add_lang_match_pattern(&ctx->lang_pattern_list, clang, value);
+    update_field_width(ctx->defs_width.pattern, strlen(value));
+  } else if (!strcmp(name, "interpreter")) {
+    ret = add_lang_match_pattern(&ctx->lang_interpreter_list, clang, value);
+    update_field_width(ctx->defs_width.pattern, strlen(value) + 2);
+  } else if (!strcmp(name, "modeline")) {
+    ret = add_lang_match_pattern(&ctx->lang_modeline_list, clang, value);
+    update_field_width(ctx->defs_width.pattern, strlen(value) + 5);
+  } else if (!strcmp(name, "comment")) {
+    struct sq_list *comment_list;
+    struct comment *comment;
+
+    if (!(comment_list = (struct sq_list *) hash_table_find_with_add(ctx->lang_comment_table, clang, create_comment_list))
+        || !(comment = create_comment_from_string(value))
+        || list_append(comment_list, (void *) comment)) {
+      ret = -1;
+    }
+    update_field_width(ctx->defs_width.comment, strlen(value));
+  } else {
+    /* unknown comment definition field name */
+    if (!ctx->defs_status) {
+      ctx->defs_status = HCC_ERR_DEFS;
+    }
+    return 0;
+  }
+
+  if (ret) {
+    if (!ctx->defs_status) {
+      ctx->defs_status = HCC_ERR_NOMEM;
+    }
+    return 0;
+  }
+
+  return 1;
+}
+
+/* every pattern must name a language which has comments */
+static int check_lang_match_list(struct hcc_context *ctx, const struct sq_list *match_list) {
+  int i;
+
+  for (i = 0; i < list_size(match_list); i++) {
+    struct lang_match_pattern *lang_pattern = (struct lang_match_pattern *) list_get(match_list, i);
+
+    if (!hash_table_find(ctx->lang_comment_table, lang_pattern->lang)) {
+      return HCC_ERR_DEFS;
+    }
+  }
+
+  return HCC_OK;
+}
+
+static int finish_defs(struct hcc_context *ctx, int parse_ret) {
+  if (parse_ret) {
+    ctx->defs_error_line = parse_ret;
+    if (!ctx->defs_status) {
+      ctx->defs_status = parse_ret == -2 ? HCC_ERR_NOMEM : HCC_ERR_DEFS;
+    }
+    return ctx->defs_status;
+  }
+
+  return HCC_OK;
+}
+
+int hcc_load_defs_file(struct hcc_context *ctx, const char *filename) {
+  return finish_defs(ctx, ini_parse(filename, build_comment_def, ctx));
+}
+
+int hcc_load_defs_string(struct hcc_context *ctx, const char *string) {
+  return finish_defs(ctx, ini_parse_string(string, build_comment_def, ctx));
+}
+
+/*
+ * Load the built in definitions, load custom ones first as the first match
+ * wins. The patterns are checked against the comments once all are loaded.
+ */
+int hcc_load_default_defs(struct hcc_context *ctx) {
+  int status;
+
+  if ((status = hcc_load_defs_string(ctx, comment_defs_string))) {
+    return status;
+  }
+
+  if ((status = check_lang_match_list(ctx, &ctx->lang_pattern_list))
+      || (status = check_lang_match_list(ctx, &ctx->lang_interpreter_list))
+      || (status = check_lang_match_list(ctx, &ctx->lang_modeline_list))) {
+    ctx->defs_status = status;
+  }
+
+  return status;
+}
+
+int hcc_add_exclude(struct hcc_context *ctx, const char *pattern) {
+  char *buf;
+
+  if (!(buf = strdup(pattern))) {
+    return HCC_ERR_NOMEM;
+  }
+
+  if (list_append(&ctx->exclude_list, buf)) {
+    free(buf);
+    return HCC_ERR_NOMEM;
+  }
+
+  return HCC_OK;
+}
+
+void hcc_drop_excludes(struct hcc_context *ctx, int keep) {
+  while (list_size(&ctx->exclude_list) > keep) {
+    free(list_get(&ctx->exclude_list, --ctx->exclude_list.next_free));
+  }
+}
+
+struct sq_list *hcc_find_comment_list(const struct hcc_context *ctx, const char *lang) {
+  char *clang;
+
+  return lookup_lang(ctx, lang, &clang);
+}
+
+const char *hcc_find_lang(const struct hcc_context *ctx, const char *lang) {
+  char *clang;
+
+  return lookup_lang(ctx, lang, &clang) ? clang : NULL;
+}
+
+/* FNV-1a, the string terminator included so fields cannot run together */
+static unsigned long long fingerprint_add(unsigned long long hash, const char *str, int len) {
+  int i;
+
+  for (i = 0; i < len; i++) {
+    hash = (hash ^ (unsigned char) str[i]) * 0x100000001b3ULL;
+  }
+
+  return (hash ^ 0xff) * 0x100000001b3ULL;
+}
+
+static unsigned long long fingerprint_list(const struct hcc_context *ctx, unsigned long long hash, const struct sq_list *match_list) {
+  struct lang_match_pattern *lang_pattern;
+  struct sq_list *comment_list;
+  struct comment *comment;
+  char *clang;
+  int i, j;
+
+  for (i = 0; i < list_size(match_list); i++) {
+    lang_pattern = (struct lang_match_pattern *) list_get(match_list, i);
+    hash = fingerprint_add(hash, lang_pattern->pattern, strlen(lang_pattern->pattern));
+    hash = fingerprint_add(hash, lang_pattern->lang, strlen(lang_pattern->lang));
+
+    if ((comment_list = lookup_lang(ctx, lang_pattern->lang, &clang))) {
+      for (j = 0; j < list_size(comment_list); j++) {
+        comment = (struct comment *) list_get(comment_list, j);
+        hash = fingerprint_add(hash, comment->start.val, comment->start.len);
+        hash = fingerprint_add(hash, comment->end.val, comment->end.len);
+      }
+    }
+  }
+
+  return fingerprint_add(hash, "", 0);
+}
+
+unsigned long long hcc_defs_fingerprint(const struct hcc_context *ctx) {
+  unsigned long long hash = 0xcbf29ce484222325ULL;
+
+  hash = fingerprint_add(hash, HCC_VERSION, strlen(HCC_VERSION));
+  hash = fingerprint_add(hash, ctx->metrics ? "metrics" : "", ctx->metrics ? 7 : 0);
+  hash = fingerprint_list(ctx, hash, &ctx->lang_pattern_list);
+  hash = fingerprint_list(ctx, hash, &ctx->lang_interpreter_list);
+
+  return fingerprint_list(ctx, hash, &ctx->lang_modeline_list);
+}
+
+int hcc_context_new(struct hcc_context **ctx) {
+  struct hcc_context *c;
+
+  if (!(c = calloc(1, sizeof(struct hcc_context)))) {
+    return HCC_ERR_NOMEM;
+  }
+
+  if (init_sq_list(&c->lang_pattern_list, INIT_PATTERN_LIST_SIZE)
+      || init_sq_list(&c->lang_interpreter_list, INIT_PATTERN_LIST_SIZE)
+      || init_sq_list(&c->lang_modeline_list, INIT_PATTERN_LIST_SIZE)
+      || init_sq_list(&c->exclude_list, INIT_EXCLUDE_LIST_SIZE)
+      || init_hash_table(&c->lang_comment_table, INIT_LANG_COMMENT_TABLE_SIZE)) {
+    hcc_context_free(c);
+    return HCC_ERR_NOMEM;
+  }
+
+  init_read_options(&c->read_opts);
+
+  *ctx = c;
+
+  return HCC_OK;
+}
+
+static void free_lang_match_list(struct sq_list *list) {
+  int i;
+
+  for (i = 0; i < list_size(list); i++) {
+    struct lang_match_pattern *lang_pattern = (struct lang_match_pattern *) list_get(list, i);
+
+    free(lang_pattern->lang);
+    free(lang_pattern->pattern);
+    free(lang_pattern);
+  }
+
+  free(list->data);
+}
+
+void hcc_context_free(struct hcc_context *ctx) {
+  struct sq_list *comment_list;
+  unsigned int i;
+  int j;
+
+  if (!ctx) {
+    return;
+  }
+
+  free_lang_match_list(&ctx->lang_pattern_list);
+  free_lang_match_list(&ctx->lang_interpreter_list);
+  free_lang_match_list(&ctx->lang_modeline_list);
+
+  for (j = 0; j < list_size(&ctx->exclude_list); j++) {
+    free(list_get(&ctx->exclude_list, j));
+  }
+  free(ctx->exclude_list.data);
+
+  if (ctx->lang_comment_table) {
+    for (i = 0; i < ctx->lang_comment_table->size; i++) {
+      struct bucket *bktp = &ctx->lang_comment_table->buckets[i];
+
+      if (!bktp->key) {
+        continue;
+      }
+
+      comment_list = (struct sq_list *) bktp->value;
+      for (j = 0; j < list_size(comment_list); j++) {
+        struct comment *comment = (struct comment *) list_get(comment_list, j);
+
+        free(comment->start.val);
+        free(comment->start.wide_val[WIDE_UTF16]);
+        free(comment->end.wide_val[WIDE_UTF16]);
+        free(comment);
+      }
+      free(comment_list->data);
+      free(comment_list);
+      free(bktp->key);
+    }
+    free(ctx->lang_comment_table);
+  }
+
+  free(ctx);
+}
+
+const char *hcc_strerror(int status) {
+  switch (status) {
+  case HCC_OK:
+    return "Success";
+  case HCC_SKIPPED:
+    return "No matched language found";
+  case HCC_EXCLUDED:
+    return "Excluded";
+  case HCC_ERR_NOMEM:
+    return "Out of memory";
+  case HCC_ERR_DEFS:
+    return "Invalid comment definitions";
+  case HCC_ERR_LANG:
+    return "Unknown language";
+  case HCC_ERR_OPEN:
+    return "Cannot open file";
+  case HCC_ERR_READ:
+    return "Read file error";
+  case HCC_ERR_WALK:
+    return "File tree walk failed";
+  default:
+    return "Unknown error";
+  }
+}
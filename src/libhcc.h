@@ -0,0 +1,144 @@
+#ifndef __HCC_LIBHCC_H
+#define __HCC_LIBHCC_H
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "sq_list.h"
+#include "hash.h"
+#include "walk.h"
+#include "reader.h"
+#include "trace.h"
+#include "hcc.h"
+
+/*
+ * libhcc, the counting engine behind hcc.
+ *
+ * A context holds the comment definitions, excludes and options. Load and
+ * configure it once, after that it is only read, so one context can count
+ * from any number of threads at the same time. Every call returns one of
+ * the status codes below, the library never prints or exits.
+ */
+
+enum {
+  HCC_OK = 0,
+  HCC_SKIPPED = 1,              /* no language matched */
+  HCC_EXCLUDED = 2,             /* matched an exclude pattern */
+  HCC_ERR_NOMEM = -1,
+  HCC_ERR_DEFS = -2,            /* invalid comment definitions */
+  HCC_ERR_LANG = -3,            /* unknown language */
+  HCC_ERR_OPEN = -4,
+  HCC_ERR_READ = -5,
+  HCC_ERR_WALK = -6,
+};
+
+/*
+ * Results of files kept from an earlier count, asked before a file is
+ * opened. lookup fills counter and returns TRUE on a hit, lang is the
+ * language the name matched or NULL when it is to be guessed from the
+ * content, counter->lang must then be set with hcc_find_lang. sb is the
+ * lstat data of the file, taken once before it is looked up. store is
+ * given every file counted that still matched sb once read. Both are
+ * called from any counting thread.
+ */
+struct hcc_cache {
+  boolean (*lookup) (const char *filename, const char *lang, const struct stat *sb, struct line_counter *counter, void *arg);
+  void (*store) (const char *filename, const char *lang, const struct stat *sb, const struct line_counter *counter, void *arg);
+  void *arg;
+};
+
+struct hcc_context {
+  struct hash_table *lang_comment_table;
+  struct sq_list lang_pattern_list;
+  struct sq_list lang_interpreter_list;
+  struct sq_list lang_modeline_list;
+  struct sq_list exclude_list;
+
+  struct read_options read_opts;
+  struct walk_options walk_opts;
+  struct trace *trace;          /* spans of every counted file when set */
+  boolean metrics;              /* fill the line metrics of counters */
+  const struct hcc_cache *cache; /* for hcc_count_file and hcc_count_tree when set */
+
+  /* widest language, pattern and comment seen in the definitions */
+  struct {
+    int lang;
+    int pattern;
+    int comment;
+  } defs_width;
+
+  int defs_status;              /* first error met while loading definitions */
+  int defs_error_line;          /* ini line of a definition error */
+
+#ifdef DEBUG
+  boolean debug;
+#endif
+};
+
+struct hcc_file {
+  int status;                   /* HCC_OK, HCC_SKIPPED or an error */
+  const char *filename;         /* full path, only valid during callback */
+  const struct walk_entry *entry; /* NULL when not found by a walk */
+  struct line_counter *counter; /* result when status is HCC_OK */
+};
+
+/*
+ * Called for every counted file of a tree, for files with no language
+ * (HCC_SKIPPED, excluded files are not reported) and for files that could
+ * not be counted. A non-zero return stops the walk.
+ */
+typedef int (*hcc_file_func) (const struct hcc_file *file, void *arg);
+
+int hcc_context_new(struct hcc_context **ctx);
+void hcc_context_free(struct hcc_context *ctx);
+
+int hcc_load_defs_file(struct hcc_context *ctx, const char *filename);
+int hcc_load_defs_string(struct hcc_context *ctx, const char *string);
+int hcc_load_default_defs(struct hcc_context *ctx);
+int hcc_add_exclude(struct hcc_context *ctx, const char *pattern);
+/* keep the first keep excludes only, not while the context is counting */
+void hcc_drop_excludes(struct hcc_context *ctx, int keep);
+
+struct sq_list *hcc_find_comment_list(const struct hcc_context *ctx, const char *lang);
+/* the context's own name of language lang, NULL when it is unknown */
+const char *hcc_find_lang(const struct hcc_context *ctx, const char *lang);
+/*
+ * A hash of everything the counts of a given content depend on: the
+ * definitions, the patterns the language is guessed with and whether
+ * metrics are measured. Equal fingerprints count a file the same.
+ */
+unsigned long long hcc_defs_fingerprint(const struct hcc_context *ctx);
+
+/*
+ * The language filename is counted as without reading it. lang is NULL when
+ * it is only known from the content.
+ */
+int hcc_match_file(const struct hcc_context *ctx, const char *filename, const char **lang);
+
+/*
+ * Count functions fill counter. filename picks the language unless lang is
+ * given, size is the byte size when known or -1.
+ */
+int hcc_count_stream(const struct hcc_context *ctx, stream_reader reader, void *stream, off_t size,
+                     const char *filename, const char *lang, struct line_counter *counter);
+int hcc_count_buffer(const struct hcc_context *ctx, const char *buf, size_t len,
+                     const char *filename, const char *lang, struct line_counter *counter);
+int hcc_count_fd(const struct hcc_context *ctx, int fd, off_t size,
+                 const char *filename, const char *lang, struct line_counter *counter);
+int hcc_count_file(const struct hcc_context *ctx, int dirfd, const char *name, off_t size,
+                   const char *filename, struct line_counter *counter);
+int hcc_count_tree(const struct hcc_context *ctx, const char *root, hcc_file_func func, void *arg);
+
+/*
+ * As above with the read buffers of the calling thread, set up with
+ * init_read_buffers on ctx->read_opts and kept from file to file, where
+ * the others allocate theirs on every call.
+ */
+int hcc_count_buffer_rb(const struct hcc_context *ctx, struct read_buffers *rb, const char *buf, size_t len,
+                        const char *filename, const char *lang, struct line_counter *counter);
+int hcc_count_file_rb(const struct hcc_context *ctx, struct read_buffers *rb, int dirfd, const char *name, off_t size,
+                      const char *filename, struct line_counter *counter);
+
+const char *hcc_strerror(int status);
+
+#endif
@@ -0,0 +1,100 @@
+#define _POSIX_C_SOURCE 200809L /* required by getline & strdup */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "error.h"
+#include "manifest.h"
+
+static char *manifest_strdup(const char *str) {
+  char *copy;
+
+  if (!(copy = strdup(str))) {
+    error(EXIT_FAILURE, "Cannot alloc manifest");
+  }
+
+  return copy;
+}
+
+static void add_root(struct manifest *manifest, char *line, int *size) {
+  struct manifest_root *root;
+  char *field, *sep;
+  int len;
+
+  if (manifest->nroots == *size) {
+    *size = *size ? *size << 1 : INIT_MANIFEST_LIST_SIZE;
+    if (!(manifest->roots = realloc(manifest->roots, *size * sizeof(struct manifest_root)))) {
+      error(EXIT_FAILURE, "Cannot alloc manifest");
+    }
+  }
+
+  root = &manifest->roots[manifest->nroots++];
+  memset(root, 0, sizeof(struct manifest_root));
+
+  if ((sep = strchr(line, MANIFEST_SEP))) {
+    *sep = '\0';
+  }
+  root->path = manifest_strdup(line);
+  if ((len = strlen(line)) > manifest->path_width) {
+    manifest->path_width = len;
+  }
+
+  for (field = sep ? sep + 1 : NULL; field; field = sep ? sep + 1 : NULL) {
+    if ((sep = strchr(field, MANIFEST_SEP))) {
+      *sep = '\0';
+    }
+    if (!*field) {
+      continue;
+    }
+
+    if (!(root->excludes = realloc(root->excludes, (root->nexcludes + 1) * sizeof(char *)))) {
+      error(EXIT_FAILURE, "Cannot alloc manifest");
+    }
+    root->excludes[root->nexcludes++] = manifest_strdup(field);
+  }
+}
+
+void manifest_load(struct manifest *manifest, const char *filename) {
+  char *line = NULL;
+  size_t line_size = 0;
+  ssize_t len;
+  int size = 0;
+  FILE *in;
+
+  memset(manifest, 0, sizeof(struct manifest));
+
+  if (!(in = fopen(filename, "r"))) {
+    error(EXIT_FAILURE, "Cannot open manifest: %s", filename);
+  }
+
+  while ((len = getline(&line, &line_size, in)) != -1) {
+    while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r')) {
+      line[--len] = '\0';
+    }
+
+    if (len && line[0] != '#') {
+      add_root(manifest, line, &size);
+    }
+  }
+
+  if (ferror(in)) {
+    error(EXIT_FAILURE, "Cannot read manifest: %s", filename);
+  }
+
+  free(line);
+  fclose(in);
+}
+
+void manifest_free(struct manifest *manifest) {
+  int i, j;
+
+  for (i = 0; i < manifest->nroots; i++) {
+    for (j = 0; j < manifest->roots[i].nexcludes; j++) {
+      free(manifest->roots[i].excludes[j]);
+    }
+    free(manifest->roots[i].excludes);
+    free(manifest->roots[i].path);
+  }
+  free(manifest->roots);
+}
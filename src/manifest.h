@@ -0,0 +1,30 @@
+#ifndef __HCC_MANIFEST_H
+#define __HCC_MANIFEST_H
+
+#include "hcc.h"
+
+#define MANIFEST_SEP '\t'
+#define INIT_MANIFEST_LIST_SIZE 64
+
+/* a root to count and the exclude patterns of its own */
+struct manifest_root {
+  char *path;
+  char **excludes;
+  int nexcludes;
+};
+
+/*
+ * The roots of a manifest file, a line each: the path then its exclude
+ * patterns, separated by tabs. Blank lines and lines starting with '#' are
+ * skipped.
+ */
+struct manifest {
+  struct manifest_root *roots;
+  int nroots;
+  int path_width;               /* longest root path */
+};
+
+void manifest_load(struct manifest *manifest, const char *filename);
+void manifest_free(struct manifest *manifest);
+
+#endif
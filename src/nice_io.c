@@ -0,0 +1,180 @@
+#define _GNU_SOURCE             /* required by syscall & sched_getaffinity */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <math.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <sys/resource.h>
+
+#include "hcc.h"
+#include "nice_io.h"
+
+/* from linux/ioprio.h, which not every libc ships */
+#define IOPRIO_CLASS_SHIFT 13
+#define IOPRIO_CLASS_IDLE 3
+#define IOPRIO_WHO_PROCESS 1
+
+int set_idle_io_priority() {
+#ifdef SYS_ioprio_set
+  return syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0, IOPRIO_CLASS_IDLE << IOPRIO_CLASS_SHIFT);
+#else
+  return -1;
+#endif
+}
+
+static long long read_number(const char *dir, const char *name) {
+  char filename[PATH_MAX];
+  long long n;
+  FILE *in;
+
+  snprintf(filename, PATH_MAX, "%s/%s", dir, name);
+  if (!(in = fopen(filename, "r"))) {
+    return -1;
+  }
+  if (fscanf(in, "%lld", &n) != 1) {
+    n = -1;
+  }
+  fclose(in);
+
+  return n;
+}
+
+/* CPUs the quota of the cgroup directory dir allows, 0 when it sets none */
+static double dir_quota(const char *dir, boolean v2) {
+  char filename[PATH_MAX], max[32];
+  long long quota, period;
+  FILE *in;
+  int n;
+
+  if (v2) {
+    /* "max 100000" or "50000 100000" */
+    snprintf(filename, PATH_MAX, "%s/cpu.max", dir);
+    if (!(in = fopen(filename, "r"))) {
+      return 0;
+    }
+    n = fscanf(in, "%31s %lld", max, &period);
+    fclose(in);
+
+    if (n != 2 || !strcmp(max, "max")) {
+      return 0;
+    }
+    quota = atoll(max);
+  } else {
+    quota = read_number(dir, "cpu.cfs_quota_us");
+    period = read_number(dir, "cpu.cfs_period_us");
+  }
+
+  return quota > 0 && period > 0 ? (double) quota / period : 0;
+}
+
+/* the tightest quota from the cgroup path up to the root of mount, limits nest */
+static double cgroup_quota(const char *mount, const char *path, boolean v2) {
+  char dir[PATH_MAX];
+  size_t mount_len = strlen(mount);
+  double cpus, min = 0;
+
+  if (snprintf(dir, PATH_MAX, "%s%s", mount, strcmp(path, "/") ? path : "") >= PATH_MAX) {
+    return 0;
+  }
+
+  for (;;) {
+    if ((cpus = dir_quota(dir, v2)) && (!min || cpus < min)) {
+      min = cpus;
+    }
+    if (strlen(dir) <= mount_len) {
+      break;
+    }
+    *strrchr(dir + mount_len, '/') = '\0';
+  }
+
+  return min;
+}
+
+static boolean has_controller(char *controllers, const char *name) {
+  char *p, *save;
+
+  for (p = strtok_r(controllers, ",", &save); p; p = strtok_r(NULL, ",", &save)) {
+    if (!strcmp(p, name)) {
+      return TRUE;
+    }
+  }
+
+  return FALSE;
+}
+
+/* CPUs the cgroups of the process allow, 0 when they set no quota */
+static double cgroup_cpus() {
+  char line[PATH_MAX + 256], *controllers, *path;
+  double quota, cpus = 0;
+  FILE *in;
+
+  if (!(in = fopen("/proc/self/cgroup", "r"))) {
+    return 0;
+  }
+
+  /* "0::/path" for v2, "N:cpu,cpuacct:/path" for the v1 cpu hierarchy */
+  while (fgets(line, sizeof(line), in)) {
+    line[strcspn(line, "\n")] = '\0';
+    if (!(controllers = strchr(line, ':')) || !(path = strchr(++controllers, ':'))) {
+      continue;
+    }
+    *path++ = '\0';
+
+    if (!*controllers) {
+      quota = cgroup_quota(CGROUP_ROOT, path, TRUE);
+    } else if (has_controller(controllers, "cpu")) {
+      quota = cgroup_quota(CGROUP_ROOT "/cpu", path, FALSE);
+    } else {
+      continue;
+    }
+
+    if (quota && (!cpus || quota < cpus)) {
+      cpus = quota;
+    }
+  }
+
+  fclose(in);
+
+  return cpus;
+}
+
+int usable_cpus() {
+  cpu_set_t set;
+  double quota;
+  long n;
+  int cpus = 0;
+
+  if (!sched_getaffinity(0, sizeof(cpu_set_t), &set)) {
+    cpus = CPU_COUNT(&set);
+  }
+  if (cpus < 1) {
+    cpus = (n = sysconf(_SC_NPROCESSORS_ONLN)) > 0 ? n : 1;
+  }
+
+  if ((quota = cgroup_cpus()) && ceil(quota) < cpus) {
+    cpus = ceil(quota);
+  }
+
+  return cpus;
+}
+
+boolean raise_fd_limit(long want) {
+  struct rlimit rl;
+
+  if (getrlimit(RLIMIT_NOFILE, &rl)) {
+    return FALSE;
+  }
+
+  if (rl.rlim_cur != RLIM_INFINITY && rl.rlim_cur < (rlim_t) want) {
+    rl.rlim_cur = rl.rlim_max == RLIM_INFINITY || rl.rlim_max > (rlim_t) want ? (rlim_t) want : rl.rlim_max;
+    if (setrlimit(RLIMIT_NOFILE, &rl)) {
+      return FALSE;
+    }
+  }
+
+  return rl.rlim_cur == RLIM_INFINITY || rl.rlim_cur >= (rlim_t) want;
+}
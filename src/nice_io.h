@@ -0,0 +1,18 @@
+#ifndef __HCC_NICE_IO_H
+#define __HCC_NICE_IO_H
+
+#include "hcc.h"
+
+#define CGROUP_ROOT "/sys/fs/cgroup"
+
+/* idle I/O class for the process and the threads it starts after, -1 on error */
+int set_idle_io_priority();
+/*
+ * CPUs this process may use: its affinity mask, capped by the CPU quota of
+ * its cgroup, v2 or v1, rounded up. At least 1.
+ */
+int usable_cpus();
+/* raise the soft limit of open files up to want, FALSE when it stays below */
+boolean raise_fd_limit(long want);
+
+#endif
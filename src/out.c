@@ -0,0 +1,123 @@
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/uio.h>
+
+#include "error.h"
+#include "out.h"
+
+void out_init(struct out_writer *out, int fd) {
+  out->fd = fd;
+  out->len = 0;
+  out->size = OUT_BUFFER_SIZE;
+
+  if (!(out->buf = malloc(out->size))) {
+    error(EXIT_FAILURE, "Cannot alloc output buffer");
+  }
+}
+
+/* the buffer then str in one call, str is not copied */
+static void out_writev(struct out_writer *out, const char *str, size_t len) {
+  struct iovec iov[2];
+  int i = 0, n = 0;
+  ssize_t written;
+
+  if (out->len) {
+    iov[n].iov_base = out->buf;
+    iov[n++].iov_len = out->len;
+  }
+  if (len) {
+    iov[n].iov_base = (void *) str;
+    iov[n++].iov_len = len;
+  }
+
+  while (i < n) {
+    if ((written = writev(out->fd, iov + i, n - i)) == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+      error(EXIT_FAILURE, "Cannot write output");
+    }
+
+    /* a short write leaves the rest of the vectors for the next call */
+    for (; i < n && (size_t) written >= iov[i].iov_len; i++) {
+      written -= iov[i].iov_len;
+    }
+    if (i < n) {
+      iov[i].iov_base = (char *) iov[i].iov_base + written;
+      iov[i].iov_len -= written;
+    }
+  }
+
+  out->len = 0;
+}
+
+void out_flush(struct out_writer *out) {
+  if (out->len) {
+    out_writev(out, NULL, 0);
+  }
+}
+
+void out_close(struct out_writer *out) {
+  out_flush(out);
+  free(out->buf);
+  out->buf = NULL;
+}
+
+void out_write(struct out_writer *out, const char *str, size_t len) {
+  if (out->size - out->len < len) {
+    out_writev(out, str, len);
+    return;
+  }
+
+  memcpy(out->buf + out->len, str, len);
+  out->len += len;
+}
+
+void out_str(struct out_writer *out, const char *str) {
+  out_write(out, str, strlen(str));
+}
+
+void out_char(struct out_writer *out, char c) {
+  if (out->len == out->size) {
+    out_flush(out);
+  }
+  out->buf[out->len++] = c;
+}
+
+static void out_pad(struct out_writer *out, int n) {
+  while (n-- > 0) {
+    out_char(out, ' ');
+  }
+}
+
+void out_left(struct out_writer *out, const char *str, int width) {
+  size_t len = strlen(str);
+
+  out_write(out, str, len);
+  out_pad(out, width - (int) len);
+}
+
+void out_long(struct out_writer *out, long long n, int width) {
+  char digits[24], *p = digits + sizeof(digits);
+  unsigned long long u = n < 0 ? -(unsigned long long) n : (unsigned long long) n;
+
+  do {
+    *--p = '0' + u % 10;
+    u /= 10;
+  } while (u);
+
+  if (n < 0) {
+    *--p = '-';
+  }
+
+  out_write(out, p, digits + sizeof(digits) - p);
+  out_pad(out, width - (int) (digits + sizeof(digits) - p));
+}
+
+void out_end_row(struct out_writer *out) {
+  if (out->size - out->len < OUT_ROW_MAX) {
+    out_flush(out);
+  }
+}
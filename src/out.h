@@ -0,0 +1,38 @@
+#ifndef __HCC_OUT_H
+#define __HCC_OUT_H
+
+#include <stddef.h>
+#include <limits.h>
+
+#define OUT_BUFFER_SIZE (1024 * 1024)
+#define OUT_ROW_MAX (PATH_MAX + 256) /* room kept for a row, so flushes fall between rows */
+
+/*
+ * Buffered writer for result rows, formatting integers and padding by hand
+ * where printf would parse a format for every row. Each writer is owned by
+ * one thread, so workers may write their own rows without a shared lock,
+ * and its writes only cut rows longer than OUT_ROW_MAX. Stdio buffers of
+ * the same fd must be flushed before the writer is used.
+ */
+struct out_writer {
+  int fd;
+  char *buf;
+  size_t len;
+  size_t size;
+};
+
+void out_init(struct out_writer *out, int fd);
+void out_flush(struct out_writer *out);
+/* flush and release the buffer */
+void out_close(struct out_writer *out);
+void out_write(struct out_writer *out, const char *str, size_t len);
+void out_str(struct out_writer *out, const char *str);
+void out_char(struct out_writer *out, char c);
+/* str padded with spaces to width, as %-*s */
+void out_left(struct out_writer *out, const char *str, int width);
+/* n padded with spaces to width, as %-*lld */
+void out_long(struct out_writer *out, long long n, int width);
+/* a row is complete, flush when the next may not fit */
+void out_end_row(struct out_writer *out);
+
+#endif
@@ -0,0 +1,83 @@
+#include <string.h>
+#include <stdlib.h>
+#include <stddef.h>
+
+#include "path.h"
+
+/*
+ * Nodes live until exit, so they are bump allocated from big blocks
+ * instead of paying malloc overhead per file. One arena per thread keeps
+ * allocation lock free.
+ */
+static __thread struct {
+  char *pos;
+  size_t left;
+} arena;
+
+#define PATH_NODE_ALIGN sizeof(void *)
+
+static void *path_arena_alloc(size_t size) {
+  void *p;
+
+  size = (size + PATH_NODE_ALIGN - 1) & ~(PATH_NODE_ALIGN - 1);
+
+  if (size > arena.left) {
+    size_t block_size = size > PATH_ARENA_BLOCK_SIZE ? size : PATH_ARENA_BLOCK_SIZE;
+
+    if (!(arena.pos = malloc(block_size))) {
+      arena.left = 0;
+      return NULL;
+    }
+    arena.left = block_size;
+  }
+
+  p = arena.pos;
+  arena.pos += size;
+  arena.left -= size;
+
+  return p;
+}
+
+struct path_node *path_node_new(struct path_node *parent, const char *name, int len) {
+  struct path_node *node;
+
+  if (!(node = path_arena_alloc(offsetof(struct path_node, name) + len + 1))) {
+    return NULL;
+  }
+
+  node->parent = parent;
+  node->len = len;
+  memcpy(node->name, name, len);
+  node->name[len] = '\0';
+
+  return node;
+}
+
+/*
+ * Write the full path of node into buf, return its length or -1 when buf
+ * is too small.
+ */
+int path_node_format(const struct path_node *node, char *buf, int size) {
+  const struct path_node *p;
+  int len = 0, pos;
+
+  for (p = node; p; p = p->parent) {
+    len += p->len + (p->parent ? 1 : 0);
+  }
+
+  if (len >= size) {
+    return -1;
+  }
+
+  buf[len] = '\0';
+  pos = len;
+  for (p = node; p; p = p->parent) {
+    pos -= p->len;
+    memcpy(buf + pos, p->name, p->len);
+    if (p->parent) {
+      buf[--pos] = '/';
+    }
+  }
+
+  return len;
+}
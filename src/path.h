@@ -0,0 +1,21 @@
+#ifndef __HCC_PATH_H
+#define __HCC_PATH_H
+
+#define PATH_ARENA_BLOCK_SIZE (64 * 1024)
+
+/*
+ * Paths are kept as a prefix tree: a file node only stores its basename and
+ * points to the shared node of its directory. The root node of a tree holds
+ * the whole root path.
+ */
+struct path_node {
+  struct path_node *parent;
+  unsigned short len;
+  char name[];
+};
+
+/* NULL when out of memory */
+struct path_node *path_node_new(struct path_node *parent, const char *name, int len);
+int path_node_format(const struct path_node *node, char *buf, int size);
+
+#endif
@@ -0,0 +1,148 @@
+#define _POSIX_C_SOURCE 200809L /* required by sigtimedwait */
+
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <time.h>
+
+#include "error.h"
+#include "trace.h"
+#include "progress.h"
+
+#define NS_PER_SEC 1000000000LL
+#define MIB (1024.0 * 1024.0)
+
+void progress_block_signals() {
+  sigset_t set;
+
+  sigemptyset(&set);
+  sigaddset(&set, SIGUSR1);
+  pthread_sigmask(SIG_BLOCK, &set, NULL);
+}
+
+static void progress_print(struct progress *p, long long now) {
+  long long files, bytes, expected_bytes;
+  boolean enumerated;
+  double secs = (double) (now - p->start) / NS_PER_SEC, rate;
+
+  pthread_mutex_lock(&p->lock);
+  files = p->files;
+  bytes = p->bytes;
+  expected_bytes = p->expected_bytes;
+  enumerated = p->enumerated;
+  pthread_mutex_unlock(&p->lock);
+
+  if (secs <= 0) {
+    secs = 1e-9;
+  }
+  rate = bytes / secs;
+
+  fprintf(stderr, "hcc: %lld files, %.1f MiB in %.1fs, %.0f files/s, %.1f MiB/s",
+          files, bytes / MIB, secs, files / secs, rate / MIB);
+
+  /* only the files found are known, while walking the total is not */
+  if (enumerated && rate > 0) {
+    fprintf(stderr, ", ETA %.0fs", (expected_bytes - bytes) / rate);
+  }
+
+  fputc('\n', stderr);
+}
+
+static void *progress_main(void *arg) {
+  struct progress *p = (struct progress *) arg;
+  struct timespec ts;
+  sigset_t set;
+  long long now, next = 0, wait;
+  int sig;
+
+  sigemptyset(&set);
+  sigaddset(&set, SIGUSR1);
+
+  /* only cancelled while waiting, never in the middle of a print */
+  pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
+
+  if (p->interval) {
+    next = p->start + p->interval;
+  }
+
+  for (;;) {
+    now = trace_now();
+
+    if (p->budget && !p->expired && now - p->start >= p->budget) {
+      p->expired = TRUE;
+      fprintf(stderr, "hcc: time budget of %.0fs spent, stopping\n", (double) p->budget / NS_PER_SEC);
+    }
+
+    if (next && now >= next) {
+      progress_print(p, now);
+      while (next <= now) {
+        next += p->interval;
+      }
+    }
+
+    wait = next ? next - now : -1;
+    if (p->budget && !p->expired && (wait < 0 || p->start + p->budget - now < wait)) {
+      wait = p->start + p->budget - now;
+    }
+
+    pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, NULL);
+    if (wait < 0) {
+      sig = sigwaitinfo(&set, NULL);
+    } else {
+      ts.tv_sec = wait / NS_PER_SEC;
+      ts.tv_nsec = wait % NS_PER_SEC;
+      sig = sigtimedwait(&set, NULL, &ts);
+    }
+    pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
+
+    if (sig == SIGUSR1) {
+      progress_print(p, trace_now());
+      p->snapshot(stderr, p->arg);
+    }
+  }
+
+  return NULL;
+}
+
+void progress_start(struct progress *p, long long interval, long long budget, progress_snapshot_func snapshot, void *arg) {
+  memset(p, 0, sizeof(struct progress));
+  pthread_mutex_init(&p->lock, NULL);
+  p->start = trace_now();
+  p->interval = interval;
+  p->budget = budget;
+  p->snapshot = snapshot;
+  p->arg = arg;
+
+  if (pthread_create(&p->thread, NULL, progress_main, p)) {
+    error(EXIT_FAILURE, "Cannot create progress thread");
+  }
+}
+
+void progress_add(struct progress *p, off_t bytes) {
+  pthread_mutex_lock(&p->lock);
+  p->files++;
+  p->bytes += bytes;
+  pthread_mutex_unlock(&p->lock);
+}
+
+void progress_expect(struct progress *p, off_t bytes) {
+  pthread_mutex_lock(&p->lock);
+  p->expected_bytes += bytes;
+  pthread_mutex_unlock(&p->lock);
+}
+
+void progress_enumerated(struct progress *p) {
+  pthread_mutex_lock(&p->lock);
+  p->enumerated = TRUE;
+  pthread_mutex_unlock(&p->lock);
+}
+
+/* the last progress line is printed when there were any */
+void progress_stop(struct progress *p) {
+  pthread_cancel(p->thread);
+  pthread_join(p->thread, NULL);
+
+  if (p->interval) {
+    progress_print(p, trace_now());
+  }
+}
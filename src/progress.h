@@ -0,0 +1,45 @@
+#ifndef __HCC_PROGRESS_H
+#define __HCC_PROGRESS_H
+
+#include <stdio.h>
+#include <pthread.h>
+#include <sys/types.h>
+
+#include "hcc.h"
+
+#define DEFAULT_PROGRESS_INTERVAL 5
+
+typedef void (*progress_snapshot_func) (FILE *out, void *arg);
+
+/*
+ * Watches a run from its own thread: a progress line on stderr every
+ * interval, a snapshot of the totals on SIGUSR1 and expired raised once the
+ * time budget is spent. SIGUSR1 must be blocked in every thread, call
+ * progress_block_signals before any other thread is started. Times are in
+ * nanoseconds.
+ */
+struct progress {
+  pthread_mutex_t lock;
+  long long start;
+  long long files;
+  long long bytes;
+  long long expected_bytes;     /* bytes of the files found so far */
+  boolean enumerated;           /* every file is found, an ETA can be given */
+  long long interval;           /* 0 for no progress lines */
+  long long budget;             /* 0 for no time budget */
+  volatile boolean expired;
+  progress_snapshot_func snapshot;
+  void *arg;
+  pthread_t thread;
+};
+
+void progress_block_signals();
+void progress_start(struct progress *p, long long interval, long long budget, progress_snapshot_func snapshot, void *arg);
+/* a file done, bytes is 0 when the size is unknown */
+void progress_add(struct progress *p, off_t bytes);
+/* a file found that is going to be counted later */
+void progress_expect(struct progress *p, off_t bytes);
+void progress_enumerated(struct progress *p);
+void progress_stop(struct progress *p);
+
+#endif
@@ -0,0 +1,126 @@
+#define _POSIX_C_SOURCE 200112L /* required by posix_fadvise & posix_memalign */
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdlib.h>
+
+#include "reader.h"
+
+void init_read_options(struct read_options *opts) {
+  opts->buffer_size = DEFAULT_BUFFER_SIZE;
+  opts->small_file_size = DEFAULT_SMALL_FILE_SIZE;
+  opts->large_file_size = DEFAULT_LARGE_FILE_SIZE;
+  opts->large_buffer_size = DEFAULT_LARGE_BUFFER_SIZE;
+  opts->byte_rate = NULL;
+  opts->file_rate = NULL;
+}
+
+void init_read_buffers(struct read_buffers *rb, const struct read_options *opts) {
+  rb->opts = opts;
+  rb->buf = NULL;
+  rb->large_buf = NULL;
+}
+
+void free_read_buffers(struct read_buffers *rb) {
+  free(rb->buf);
+  free(rb->large_buf);
+  rb->buf = rb->large_buf = NULL;
+}
+
+/*
+ * Pick the buffer for a file of size bytes (-1 when unknown, 0 is taken
+ * as unknown too as procfs and sysfs files tell so), buffers are
+ * allocated on first use and kept for the following files. NULL when out
+ * of memory.
+ */
+char *read_buffers_get(struct read_buffers *rb, off_t size, size_t *buf_size) {
+  const struct read_options *opts = rb->opts;
+  size_t len = opts->small_file_size > opts->buffer_size ? opts->small_file_size : opts->buffer_size;
+
+  if (size > 0 && opts->large_file_size && (size_t) size >= opts->large_file_size) {
+    if (!rb->large_buf) {
+      /* keep the read area itself page aligned */
+      if (posix_memalign((void **) &rb->large_buf, READ_BUFFER_ALIGN, READ_BUFFER_ALIGN + opts->large_buffer_size)) {
+        rb->large_buf = NULL;
+        return NULL;
+      }
+    }
+
+    *buf_size = opts->large_buffer_size;
+    return rb->large_buf + READ_BUFFER_ALIGN;
+  }
+
+  if (!rb->buf && !(rb->buf = malloc(READ_BUFFER_FRONT + len))) {
+    return NULL;
+  }
+
+  if (size <= 0 || (size_t) size <= opts->small_file_size) {
+    *buf_size = len;
+  } else {
+    *buf_size = opts->buffer_size;
+  }
+
+  return rb->buf + READ_BUFFER_FRONT;
+}
+
+void fd_stream_init(struct fd_stream *fs, int fd, off_t size, boolean regular, const struct read_options *opts) {
+  fs->fd = fd;
+  fs->pos = 0;
+  fs->size = -1;
+  fs->regular = regular;
+  fs->hint = 0;
+  fs->throttle = opts->byte_rate;
+
+  fd_stream_advise(fs, size, opts);
+}
+
+void fd_stream_advise(struct fd_stream *fs, off_t size, const struct read_options *opts) {
+  /* 0 is no size, procfs and sysfs files tell so */
+  if (size > 0) {
+    fs->size = size;
+  }
+
+  /* a small file is one read, hints would only cost a syscall */
+  if (size <= 0 || (size_t) size <= opts->small_file_size) {
+    return;
+  }
+
+  posix_fadvise(fs->fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+  if (opts->large_file_size && (size_t) size >= opts->large_file_size) {
+    fs->hint = opts->large_buffer_size;
+    posix_fadvise(fs->fd, fs->pos, fs->hint * 2, POSIX_FADV_WILLNEED);
+  }
+}
+
+/* stream_reader over a fd */
+ssize_t fd_stream_read(void *stream, char *buf, size_t size) {
+  struct fd_stream *fs = (struct fd_stream *) stream;
+  ssize_t bytes_read;
+
+  /* no read() only to be told the end */
+  if (fs->size != -1 && fs->pos >= fs->size) {
+    return 0;
+  }
+
+  if ((bytes_read = read(fs->fd, buf, size)) <= 0) {
+    return bytes_read;
+  }
+
+  fs->pos += bytes_read;
+
+  if (fs->regular && (size_t) bytes_read < size) {
+    fs->size = fs->pos;
+  }
+
+  if (fs->throttle) {
+    throttle_take(fs->throttle, bytes_read);
+  }
+
+  /* keep the window after the next buffer in flight while this one is counted */
+  if (fs->hint) {
+    posix_fadvise(fs->fd, fs->pos + fs->hint, fs->hint, POSIX_FADV_WILLNEED);
+  }
+
+  return bytes_read;
+}
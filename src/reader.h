@@ -0,0 +1,61 @@
+#ifndef __HCC_READER_H
+#define __HCC_READER_H
+
+#include <sys/types.h>
+
+#include "hcc.h"
+#include "throttle.h"
+
+#define DEFAULT_BUFFER_SIZE (16 * 1024)
+#define DEFAULT_SMALL_FILE_SIZE (64 * 1024)
+#define DEFAULT_LARGE_FILE_SIZE (1024 * 1024)
+#define DEFAULT_LARGE_BUFFER_SIZE (1024 * 1024)
+
+#define READ_BUFFER_ALIGN 4096
+/* room for a partial delimiter carried over, of up to 4 bytes a code unit */
+#define READ_BUFFER_FRONT (MAX_COMMENT_SIZE * 4)
+
+/*
+ * Sizes are hints for the buffer, a file is read until its known size is
+ * reached, or a regular file comes back short, or read() returns 0. Files up to
+ * small_file_size, and those of unknown size at first, are tried with one
+ * read of a buffer that holds a small file whole. Files from
+ * large_file_size on go through a page aligned buffer of
+ * large_buffer_size with readahead hints, others use buffer_size.
+ */
+struct read_options {
+  size_t buffer_size;
+  size_t small_file_size;
+  size_t large_file_size;
+  size_t large_buffer_size;
+  struct throttle *byte_rate;   /* bytes read a second, NULL for no limit */
+  struct throttle *file_rate;   /* files opened a second, NULL for no limit */
+};
+
+/* reused from file to file, every buffer has READ_BUFFER_FRONT bytes in front */
+struct read_buffers {
+  const struct read_options *opts;
+  char *buf;
+  char *large_buf;
+};
+
+struct fd_stream {
+  int fd;
+  off_t pos;                    /* bytes read so far */
+  off_t size;                   /* bytes to read, -1 until known */
+  boolean regular;              /* a short read is the end of the file */
+  size_t hint;                  /* readahead window, 0 for none */
+  struct throttle *throttle;
+};
+
+void init_read_options(struct read_options *opts);
+void init_read_buffers(struct read_buffers *rb, const struct read_options *opts);
+void free_read_buffers(struct read_buffers *rb);
+char *read_buffers_get(struct read_buffers *rb, off_t size, size_t *buf_size);
+
+void fd_stream_init(struct fd_stream *fs, int fd, off_t size, boolean regular, const struct read_options *opts);
+/* the size of the file and its readahead hints, once it is known */
+void fd_stream_advise(struct fd_stream *fs, off_t size, const struct read_options *opts);
+ssize_t fd_stream_read(void *stream, char *buf, size_t size);
+
+#endif
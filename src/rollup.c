@@ -0,0 +1,59 @@
+#include <stdlib.h>
+
+#include "error.h"
+#include "rollup.h"
+
+/*
+ * Rollups hang off the walker's directories, roots are appended to roots
+ * when a new walk root is met.
+ */
+struct dir_rollup *dir_rollup_get(struct walk_dir *dir, int max_depth, struct sq_list *roots) {
+  struct dir_rollup *rollup, *parent = NULL;
+
+  /* deeper files are folded into their ancestor at max_depth */
+  if (max_depth != ROLLUP_UNLIMITED_DEPTH) {
+    while (dir->depth > max_depth) {
+      dir = dir->parent;
+    }
+  }
+
+  if (dir->data) {
+    return (struct dir_rollup *) dir->data;
+  }
+
+  if (dir->parent) {
+    parent = dir_rollup_get(dir->parent, max_depth, roots);
+  }
+
+  if (!(rollup = calloc(1, sizeof(struct dir_rollup)))) {
+    error(EXIT_FAILURE, "Cannot alloc directory rollup");
+  }
+
+  rollup->path = walk_dir_path_node(dir);
+  rollup->depth = dir->depth;
+  rollup->parent = parent;
+
+  if (parent) {
+    if (parent->last_child) {
+      parent->last_child->next = rollup;
+    } else {
+      parent->child = rollup;
+    }
+    parent->last_child = rollup;
+  } else {
+    list_append(roots, rollup);
+  }
+
+  dir->data = rollup;
+
+  return rollup;
+}
+
+void dir_rollup_add(struct dir_rollup *rollup, const struct line_counter *counter) {
+  for (; rollup; rollup = rollup->parent) {
+    rollup->files++;
+    rollup->code_lines += counter->code_lines;
+    rollup->comment_lines += counter->comment_lines;
+    rollup->blank_lines += counter->blank_lines;
+  }
+}
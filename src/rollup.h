@@ -0,0 +1,29 @@
+#ifndef __HCC_ROLLUP_H
+#define __HCC_ROLLUP_H
+
+#include "hcc.h"
+#include "walk.h"
+
+#define ROLLUP_UNLIMITED_DEPTH -1
+
+/*
+ * Line counts of a directory including all of its sub directories, there
+ * is one per walked directory up to the depth limit, not one per file.
+ */
+struct dir_rollup {
+  struct path_node *path;
+  int depth;
+  int files;
+  long code_lines;
+  long comment_lines;
+  long blank_lines;
+  struct dir_rollup *parent;
+  struct dir_rollup *child;
+  struct dir_rollup *last_child;
+  struct dir_rollup *next;
+};
+
+struct dir_rollup *dir_rollup_get(struct walk_dir *dir, int max_depth, struct sq_list *roots);
+void dir_rollup_add(struct dir_rollup *rollup, const struct line_counter *counter);
+
+#endif
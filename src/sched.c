@@ -0,0 +1,147 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "error.h"
+#include "sched.h"
+
+static void sched_push(struct sched *s, struct sched_entry entry) {
+  int i = s->size++, parent;
+
+  while (i > 0 && s->heap[parent = (i - 1) / 2].key < entry.key) {
+    s->heap[i] = s->heap[parent];
+    i = parent;
+  }
+
+  s->heap[i] = entry;
+}
+
+static void *sched_pop(struct sched *s) {
+  struct sched_entry last;
+  void *job = s->heap[0].job;
+  int i = 0, child;
+
+  last = s->heap[--s->size];
+  while ((child = i * 2 + 1) < s->size) {
+    if (child + 1 < s->size && s->heap[child + 1].key > s->heap[child].key) {
+      child++;
+    }
+    if (s->heap[child].key <= last.key) {
+      break;
+    }
+    s->heap[i] = s->heap[child];
+    i = child;
+  }
+
+  s->heap[i] = last;
+
+  return job;
+}
+
+static void *sched_worker(void *arg) {
+  struct sched *s = (struct sched *) arg;
+  void *job, *state = s->init ? s->init(s->arg) : s->arg;
+
+  for (;;) {
+    pthread_mutex_lock(&s->lock);
+    while (!s->size && !s->done) {
+      pthread_cond_wait(&s->not_empty, &s->lock);
+    }
+
+    if (!s->size) {
+      pthread_mutex_unlock(&s->lock);
+      if (s->fini) {
+        s->fini(state, s->arg);
+      }
+      return NULL;
+    }
+
+    job = sched_pop(s);
+    s->running++;
+    pthread_cond_signal(&s->not_full);
+    pthread_mutex_unlock(&s->lock);
+
+    s->func(job, state);
+
+    pthread_mutex_lock(&s->lock);
+    if (!--s->running && !s->size) {
+      pthread_cond_broadcast(&s->idle);
+    }
+    pthread_mutex_unlock(&s->lock);
+  }
+}
+
+void sched_start(struct sched *s, int nworkers, int lookahead, boolean largest_first, sched_job_func func,
+                 sched_init_func init, sched_fini_func fini, void *arg) {
+  int i;
+
+  memset(s, 0, sizeof(struct sched));
+  pthread_mutex_init(&s->lock, NULL);
+  pthread_cond_init(&s->not_empty, NULL);
+  pthread_cond_init(&s->not_full, NULL);
+  pthread_cond_init(&s->idle, NULL);
+
+  s->capacity = lookahead > 0 ? lookahead : 1;
+  s->largest_first = largest_first;
+  s->nworkers = nworkers;
+  s->func = func;
+  s->init = init;
+  s->fini = fini;
+  s->arg = arg;
+
+  if (!(s->heap = malloc(s->capacity * sizeof(struct sched_entry)))
+      || !(s->workers = malloc(nworkers * sizeof(pthread_t)))) {
+    error(EXIT_FAILURE, "Cannot alloc scheduler");
+  }
+
+  for (i = 0; i < nworkers; i++) {
+    if (pthread_create(&s->workers[i], NULL, sched_worker, s)) {
+      error(EXIT_FAILURE, "Cannot create worker thread");
+    }
+  }
+}
+
+void sched_submit(struct sched *s, void *job, off_t size) {
+  struct sched_entry entry;
+
+  pthread_mutex_lock(&s->lock);
+  while (s->size == s->capacity) {
+    pthread_cond_wait(&s->not_full, &s->lock);
+  }
+
+  /* the oldest job has the highest key in submit order */
+  entry.key = s->largest_first ? size : -s->seq;
+  entry.job = job;
+  s->seq++;
+
+  sched_push(s, entry);
+  pthread_cond_signal(&s->not_empty);
+  pthread_mutex_unlock(&s->lock);
+}
+
+void sched_wait(struct sched *s) {
+  pthread_mutex_lock(&s->lock);
+  while (s->size || s->running) {
+    pthread_cond_wait(&s->idle, &s->lock);
+  }
+  pthread_mutex_unlock(&s->lock);
+}
+
+void sched_finish(struct sched *s) {
+  int i;
+
+  pthread_mutex_lock(&s->lock);
+  s->done = TRUE;
+  pthread_cond_broadcast(&s->not_empty);
+  pthread_mutex_unlock(&s->lock);
+
+  for (i = 0; i < s->nworkers; i++) {
+    pthread_join(s->workers[i], NULL);
+  }
+
+  free(s->heap);
+  free(s->workers);
+  pthread_mutex_destroy(&s->lock);
+  pthread_cond_destroy(&s->not_empty);
+  pthread_cond_destroy(&s->not_full);
+  pthread_cond_destroy(&s->idle);
+}
@@ -0,0 +1,61 @@
+#ifndef __HCC_SCHED_H
+#define __HCC_SCHED_H
+
+#include <pthread.h>
+#include <sys/types.h>
+
+#include "hcc.h"
+
+#define DEFAULT_SCHED_LOOKAHEAD 4096
+
+typedef void (*sched_job_func) (void *job, void *arg);
+/* state of one worker, made in the worker thread before its first job */
+typedef void *(*sched_init_func) (void *arg);
+typedef void (*sched_fini_func) (void *state, void *arg);
+
+struct sched_entry {
+  long long key;
+  void *job;
+};
+
+/*
+ * A pool of workers fed from a bounded window of pending jobs. With
+ * largest_first a free worker always takes the biggest job in the window
+ * (LPT list scheduling), otherwise jobs run in submit order. Submitting
+ * blocks while the window is full.
+ */
+struct sched {
+  pthread_mutex_t lock;
+  pthread_cond_t not_empty;
+  pthread_cond_t not_full;
+  pthread_cond_t idle;
+
+  struct sched_entry *heap;     /* max heap on key */
+  int size;
+  int capacity;
+  boolean largest_first;
+  long long seq;
+  boolean done;
+  int running;                  /* jobs taken by workers and not finished */
+
+  pthread_t *workers;
+  int nworkers;
+  sched_job_func func;
+  sched_init_func init;
+  sched_fini_func fini;
+  void *arg;
+};
+
+/*
+ * func is given the state init made for the worker running the job, or
+ * arg when init is NULL. fini is called with it as the worker stops.
+ */
+void sched_start(struct sched *s, int nworkers, int lookahead, boolean largest_first, sched_job_func func,
+                 sched_init_func init, sched_fini_func fini, void *arg);
+void sched_submit(struct sched *s, void *job, off_t size);
+/* wait for all submitted jobs to finish, the workers stay for more */
+void sched_wait(struct sched *s);
+/* run all submitted jobs to the end and stop the workers */
+void sched_finish(struct sched *s);
+
+#endif
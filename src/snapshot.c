@@ -0,0 +1,173 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "error.h"
+#include "snapshot.h"
+
+static void snapshot_init(struct snapshot *snap, const char *filename, const char *mode) {
+  memset(snap, 0, sizeof(struct snapshot));
+  snap->filename = filename;
+
+  if (!(snap->file = fopen(filename, mode))) {
+    error(EXIT_FAILURE, "Cannot open snapshot: %s", filename);
+  }
+
+  setvbuf(snap->file, NULL, _IOFBF, SNAPSHOT_BUFFER_SIZE);
+}
+
+static void write_varint(struct snapshot *snap, unsigned long long n) {
+  do {
+    putc((n > 0x7f ? 0x80 : 0) | (n & 0x7f), snap->file);
+    n >>= 7;
+  } while (n);
+}
+
+static void write_bytes(struct snapshot *snap, const char *buf, size_t len) {
+  if (len && !fwrite(buf, len, 1, snap->file)) {
+    error(EXIT_FAILURE, "Cannot write snapshot: %s", snap->filename);
+  }
+}
+
+void snapshot_create(struct snapshot *snap, const char *filename) {
+  snapshot_init(snap, filename, "w");
+  write_bytes(snap, SNAPSHOT_MAGIC, SNAPSHOT_MAGIC_SIZE);
+}
+
+void snapshot_write(struct snapshot *snap, const char *path, const struct line_counter *counter) {
+  int len = strlen(path), prefix = 0, i;
+
+  if (len >= PATH_MAX) {
+    error(EXIT_FAILURE, "Too long path: %s", path);
+  }
+
+  while (prefix < len && prefix < snap->path_len && path[prefix] == snap->path[prefix]) {
+    prefix++;
+  }
+
+  write_varint(snap, prefix);
+  write_varint(snap, len - prefix);
+  write_bytes(snap, path + prefix, len - prefix);
+  memcpy(snap->path + prefix, path + prefix, len - prefix + 1);
+  snap->path_len = len;
+
+  for (i = 0; i < snap->nlangs && strcmp(snap->langs[i], counter->lang); i++);
+
+  write_varint(snap, i);
+  if (i == snap->nlangs) {
+    if (i == SNAPSHOT_MAX_LANGS) {
+      error(EXIT_FAILURE, "Too many languages in snapshot");
+    }
+    if (!(snap->langs[snap->nlangs++] = strdup(counter->lang))) {
+      error(EXIT_FAILURE, "Cannot alloc snapshot language");
+    }
+    write_varint(snap, strlen(counter->lang));
+    write_bytes(snap, counter->lang, strlen(counter->lang));
+  }
+
+  write_varint(snap, counter->code_lines);
+  write_varint(snap, counter->comment_lines);
+  write_varint(snap, counter->blank_lines);
+}
+
+void snapshot_open(struct snapshot *snap, const char *filename) {
+  char magic[SNAPSHOT_MAGIC_SIZE];
+
+  snapshot_init(snap, filename, "r");
+
+  if (fread(magic, SNAPSHOT_MAGIC_SIZE, 1, snap->file) != 1 || memcmp(magic, SNAPSHOT_MAGIC, SNAPSHOT_MAGIC_SIZE)) {
+    error(EXIT_FAILURE, "Not a snapshot: %s", filename);
+  }
+}
+
+static unsigned long long read_varint(struct snapshot *snap) {
+  unsigned long long n = 0;
+  int c, shift = 0;
+
+  do {
+    if ((c = getc(snap->file)) == EOF || shift > 63) {
+      error(EXIT_FAILURE, "Corrupt snapshot: %s", snap->filename);
+    }
+    n |= (unsigned long long) (c & 0x7f) << shift;
+    shift += 7;
+  } while (c & 0x80);
+
+  return n;
+}
+
+static void read_bytes(struct snapshot *snap, char *buf, size_t len) {
+  if (len && fread(buf, len, 1, snap->file) != 1) {
+    error(EXIT_FAILURE, "Corrupt snapshot: %s", snap->filename);
+  }
+}
+
+boolean snapshot_read(struct snapshot *snap) {
+  unsigned long long prefix, len, lang;
+  int c;
+
+  if ((c = getc(snap->file)) == EOF) {
+    return FALSE;
+  }
+  ungetc(c, snap->file);
+
+  prefix = read_varint(snap);
+  len = read_varint(snap);
+  if (prefix > snap->path_len || prefix + len >= PATH_MAX) {
+    error(EXIT_FAILURE, "Corrupt snapshot: %s", snap->filename);
+  }
+
+  read_bytes(snap, snap->path + prefix, len);
+  snap->path_len = prefix + len;
+  snap->path[snap->path_len] = '\0';
+
+  if ((lang = read_varint(snap)) > snap->nlangs || lang == SNAPSHOT_MAX_LANGS) {
+    error(EXIT_FAILURE, "Corrupt snapshot: %s", snap->filename);
+  }
+
+  if (lang == snap->nlangs) {
+    if ((len = read_varint(snap)) > PATTERN_MAX || !(snap->langs[lang] = calloc(1, len + 1))) {
+      error(EXIT_FAILURE, "Corrupt snapshot: %s", snap->filename);
+    }
+    read_bytes(snap, snap->langs[lang], len);
+    snap->nlangs++;
+  }
+
+  snap->counter.lang = snap->langs[lang];
+  snap->counter.code_lines = read_varint(snap);
+  snap->counter.comment_lines = read_varint(snap);
+  snap->counter.blank_lines = read_varint(snap);
+
+  return TRUE;
+}
+
+void snapshot_close(struct snapshot *snap) {
+  if (ferror(snap->file) | fclose(snap->file)) {
+    error(EXIT_FAILURE, "Cannot write snapshot: %s", snap->filename);
+  }
+}
+
+#define same_counts(a, b)                                               \
+  (!strcmp((a)->lang, (b)->lang) && (a)->code_lines == (b)->code_lines \
+   && (a)->comment_lines == (b)->comment_lines && (a)->blank_lines == (b)->blank_lines)
+
+void snapshot_diff(struct snapshot *old, struct snapshot *new, snapshot_diff_func func, void *arg) {
+  boolean has_old = snapshot_read(old), has_new = snapshot_read(new);
+  int cmp;
+
+  while (has_old || has_new) {
+    cmp = !has_old ? 1 : !has_new ? -1 : strcmp(old->path, new->path);
+
+    if (cmp < 0) {
+      func(old->path, &old->counter, NULL, arg);
+      has_old = snapshot_read(old);
+    } else if (cmp > 0) {
+      func(new->path, NULL, &new->counter, arg);
+      has_new = snapshot_read(new);
+    } else {
+      if (!same_counts(&old->counter, &new->counter)) {
+        func(new->path, &old->counter, &new->counter, arg);
+      }
+      has_old = snapshot_read(old);
+      has_new = snapshot_read(new);
+    }
+  }
+}
@@ -0,0 +1,44 @@
+#ifndef __HCC_SNAPSHOT_H
+#define __HCC_SNAPSHOT_H
+
+#include <stdio.h>
+#include <limits.h>
+
+#include "hcc.h"
+
+#define SNAPSHOT_MAGIC "HCCSNAP\1"
+#define SNAPSHOT_MAGIC_SIZE 8
+#define SNAPSHOT_MAX_LANGS 256
+#define SNAPSHOT_BUFFER_SIZE (256 * 1024)
+
+/*
+ * Per file results of a run, sorted by path. Each record holds the length
+ * of the prefix shared with the previous path and the rest of the path,
+ * the language as an index into the languages met so far (a new one is
+ * spelled out once) and the line counts, all numbers as LEB128 varints.
+ */
+struct snapshot {
+  FILE *file;
+  const char *filename;
+  char path[PATH_MAX];
+  int path_len;
+  char *langs[SNAPSHOT_MAX_LANGS];
+  int nlangs;
+  struct line_counter counter;  /* current record when reading */
+};
+
+void snapshot_create(struct snapshot *snap, const char *filename);
+/* paths must come in strcmp order */
+void snapshot_write(struct snapshot *snap, const char *path, const struct line_counter *counter);
+void snapshot_open(struct snapshot *snap, const char *filename);
+/* load the next record into snap->path and snap->counter, FALSE at the end */
+boolean snapshot_read(struct snapshot *snap);
+void snapshot_close(struct snapshot *snap);
+
+/* old or new is NULL for a file only in the other snapshot */
+typedef void (*snapshot_diff_func) (const char *path, const struct line_counter *old, const struct line_counter *new, void *arg);
+
+/* merge both snapshots, func gets every path whose counts differ */
+void snapshot_diff(struct snapshot *old, struct snapshot *new, snapshot_diff_func func, void *arg);
+
+#endif
@@ -0,0 +1,346 @@
+#define _XOPEN_SOURCE 700       /* required by pread & mkstemp */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <unistd.h>
+
+#include "error.h"
+#include "spill.h"
+
+/* followed by the path and the language, both NUL terminated */
+struct spill_record {
+  int code_lines;
+  int comment_lines;
+  int blank_lines;
+  struct line_metrics metrics;
+  unsigned short path_len;
+  unsigned short lang_len;
+};
+
+#define SPILL_RECORD_ALIGN sizeof(long long)
+
+#define record_path(rec) ((char *) ((rec) + 1))
+#define record_lang(rec) (record_path(rec) + (rec)->path_len + 1)
+#define record_size(path_len, lang_len)                                 \
+  ((sizeof(struct spill_record) + (path_len) + (lang_len) + 2 + SPILL_RECORD_ALIGN - 1) & ~(SPILL_RECORD_ALIGN - 1))
+
+/* a window of one run in the temporary file */
+struct run_cursor {
+  off_t pos;
+  off_t end;
+  char *buf;
+  size_t size;
+  size_t start;                 /* current record in buf */
+  size_t len;                   /* bytes of buf filled */
+  struct spill_record *rec;     /* NULL once the run is done */
+};
+
+void spill_init(struct spill *sp, size_t limit, boolean sort) {
+  memset(sp, 0, sizeof(struct spill));
+  sp->limit = limit;
+  sp->sort = sort;
+}
+
+static int compare_record(const void *a, const void *b) {
+  return strcmp(record_path(*(struct spill_record **) a), record_path(*(struct spill_record **) b));
+}
+
+/* in memory records, sorted by path when asked, NULL when there are none */
+static struct spill_record **spill_index(struct spill *sp) {
+  struct spill_record **index;
+  size_t i, pos = 0;
+
+  if (!sp->count) {
+    return NULL;
+  }
+
+  if (!(index = malloc(sp->count * sizeof(struct spill_record *)))) {
+    error(EXIT_FAILURE, "Cannot alloc spill index");
+  }
+
+  for (i = 0; i < sp->count; i++) {
+    index[i] = (struct spill_record *) (sp->buf + pos);
+    pos += record_size(index[i]->path_len, index[i]->lang_len);
+  }
+
+  if (sp->sort) {
+    qsort(index, sp->count, sizeof(struct spill_record *), compare_record);
+  }
+
+  return index;
+}
+
+static FILE *spill_open_file() {
+  char path[PATH_MAX];
+  const char *dir;
+  FILE *file;
+  int fd;
+
+  if (!(dir = getenv("TMPDIR")) || !*dir) {
+    dir = "/tmp";
+  }
+
+  snprintf(path, PATH_MAX, "%s/hcc-spill-XXXXXX", dir);
+  if ((fd = mkstemp(path)) == -1) {
+    error(EXIT_FAILURE, "Cannot create spill file in %s", dir);
+  }
+
+  /* the file goes away with the process */
+  unlink(path);
+
+  if (!(file = fdopen(fd, "w+"))) {
+    error(EXIT_FAILURE, "Cannot open spill file");
+  }
+
+  setvbuf(file, NULL, _IOFBF, SPILL_WRITE_BUFFER_SIZE);
+
+  return file;
+}
+
+/* write the records in memory out as a new run */
+static void spill_flush(struct spill *sp) {
+  if (!sp->file) {
+    sp->file = spill_open_file();
+  }
+
+  if (sp->sort) {
+    struct spill_record **index = spill_index(sp);
+    size_t i;
+
+    for (i = 0; i < sp->count; i++) {
+      if (!fwrite(index[i], record_size(index[i]->path_len, index[i]->lang_len), 1, sp->file)) {
+        error(EXIT_FAILURE, "Cannot write spill file");
+      }
+    }
+
+    free(index);
+  } else if (!fwrite(sp->buf, sp->used, 1, sp->file)) {
+    error(EXIT_FAILURE, "Cannot write spill file");
+  }
+
+  if (!(sp->runs = realloc(sp->runs, (sp->nruns + 1) * sizeof(off_t)))) {
+    error(EXIT_FAILURE, "Cannot alloc spill runs");
+  }
+
+  sp->runs[sp->nruns++] = ftello(sp->file);
+  sp->used = 0;
+  sp->count = 0;
+}
+
+void spill_add(struct spill *sp, const char *path, const struct line_counter *counter) {
+  struct spill_record *rec;
+  size_t path_len, lang_len, len, need;
+
+  path_len = strlen(path);
+  lang_len = strlen(counter->lang);
+  if (path_len >= PATH_MAX) {
+    error(EXIT_FAILURE, "Too long path: %s", path);
+  }
+
+  len = record_size(path_len, lang_len);
+
+  /* the sort index is part of the budget */
+  need = sp->used + len + (sp->sort ? (sp->count + 1) * sizeof(struct spill_record *) : 0);
+  if (sp->limit && need > sp->limit && sp->count) {
+    spill_flush(sp);
+  }
+
+  if (sp->used + len > sp->size) {
+    size_t size = sp->size ? sp->size << 1 : SPILL_INIT_BUFFER_SIZE;
+
+    if (sp->limit && size > sp->limit) {
+      size = sp->limit;
+    }
+    if (size < sp->used + len) {
+      size = sp->used + len;
+    }
+
+    if (!(sp->buf = realloc(sp->buf, size))) {
+      error(EXIT_FAILURE, "Cannot alloc spill buffer");
+    }
+    sp->size = size;
+  }
+
+  rec = (struct spill_record *) (sp->buf + sp->used);
+  rec->code_lines = counter->code_lines;
+  rec->comment_lines = counter->comment_lines;
+  rec->blank_lines = counter->blank_lines;
+  rec->metrics = counter->metrics;
+  rec->path_len = path_len;
+  rec->lang_len = lang_len;
+  memcpy(record_path(rec), path, path_len + 1);
+  memcpy(record_lang(rec), counter->lang, lang_len + 1);
+
+  sp->used += len;
+  sp->count++;
+}
+
+static void spill_emit(struct spill_record *rec, spill_record_func func, void *arg) {
+  struct line_counter counter;
+
+  counter.path = NULL;
+  counter.lang = record_lang(rec);
+  counter.code_lines = rec->code_lines;
+  counter.comment_lines = rec->comment_lines;
+  counter.blank_lines = rec->blank_lines;
+  counter.metrics = rec->metrics;
+
+  func(record_path(rec), &counter, arg);
+}
+
+/* move to the next record of the run, read more of it when needed */
+static struct spill_record *run_cursor_next(struct run_cursor *cur, int fd) {
+  struct spill_record *rec;
+  size_t left;
+  ssize_t n;
+
+  if (cur->rec) {
+    cur->start += record_size(cur->rec->path_len, cur->rec->lang_len);
+  }
+
+  for (;;) {
+    left = cur->len - cur->start;
+    rec = (struct spill_record *) (cur->buf + cur->start);
+
+    if (left >= sizeof(struct spill_record) && left >= record_size(rec->path_len, rec->lang_len)) {
+      return cur->rec = rec;
+    }
+
+    if (cur->pos == cur->end) {
+      return cur->rec = NULL;
+    }
+
+    memmove(cur->buf, cur->buf + cur->start, left);
+    cur->start = 0;
+    cur->len = left;
+
+    n = cur->size - left;
+    if (n > cur->end - cur->pos) {
+      n = cur->end - cur->pos;
+    }
+
+    if ((n = pread(fd, cur->buf + left, n, cur->pos)) <= 0) {
+      error(EXIT_FAILURE, "Cannot read spill file");
+    }
+
+    cur->pos += n;
+    cur->len += n;
+  }
+}
+
+static void run_cursor_init(struct run_cursor *cur, off_t start, off_t end, size_t size) {
+  memset(cur, 0, sizeof(struct run_cursor));
+  cur->pos = start;
+  cur->end = end;
+  cur->size = size;
+
+  if (!(cur->buf = malloc(size))) {
+    error(EXIT_FAILURE, "Cannot alloc spill run buffer");
+  }
+}
+
+#define cursor_less(a, b) (strcmp(record_path((a)->rec), record_path((b)->rec)) < 0)
+
+static void heap_down(struct run_cursor **heap, int n, int i) {
+  struct run_cursor *tmp;
+  int child;
+
+  while ((child = i * 2 + 1) < n) {
+    if (child + 1 < n && cursor_less(heap[child + 1], heap[child])) {
+      child++;
+    }
+    if (!cursor_less(heap[child], heap[i])) {
+      break;
+    }
+    tmp = heap[i];
+    heap[i] = heap[child];
+    heap[child] = tmp;
+    i = child;
+  }
+}
+
+/* k way merge of the sorted runs through a min heap on the current paths */
+static void spill_merge(struct spill *sp, size_t run_size, spill_record_func func, void *arg) {
+  struct run_cursor *cursors, **heap;
+  int fd = fileno(sp->file);
+  int i, n = 0;
+
+  if (!(cursors = malloc(sp->nruns * sizeof(struct run_cursor)))
+      || !(heap = malloc(sp->nruns * sizeof(struct run_cursor *)))) {
+    error(EXIT_FAILURE, "Cannot alloc spill merge");
+  }
+
+  for (i = 0; i < sp->nruns; i++) {
+    run_cursor_init(&cursors[i], i ? sp->runs[i - 1] : 0, sp->runs[i], run_size);
+    if (run_cursor_next(&cursors[i], fd)) {
+      heap[n++] = &cursors[i];
+    }
+  }
+
+  for (i = n / 2 - 1; i >= 0; i--) {
+    heap_down(heap, n, i);
+  }
+
+  while (n) {
+    spill_emit(heap[0]->rec, func, arg);
+
+    if (!run_cursor_next(heap[0], fd)) {
+      heap[0] = heap[--n];
+    }
+    heap_down(heap, n, 0);
+  }
+
+  for (i = 0; i < sp->nruns; i++) {
+    free(cursors[i].buf);
+  }
+  free(cursors);
+  free(heap);
+}
+
+void spill_foreach(struct spill *sp, spill_record_func func, void *arg) {
+  struct run_cursor cur;
+  size_t i, run_size;
+
+  if (!sp->file) {
+    struct spill_record **index = spill_index(sp);
+
+    for (i = 0; i < sp->count; i++) {
+      spill_emit(index[i], func, arg);
+    }
+
+    free(index);
+    return;
+  }
+
+  if (sp->count) {
+    spill_flush(sp);
+  }
+
+  /* the merge buffers reuse the budget of the record buffer */
+  free(sp->buf);
+  sp->buf = NULL;
+  sp->size = 0;
+
+  if (fflush(sp->file)) {
+    error(EXIT_FAILURE, "Cannot write spill file");
+  }
+
+  run_size = sp->limit / sp->nruns;
+  if (run_size < SPILL_MIN_RUN_BUFFER_SIZE) {
+    run_size = SPILL_MIN_RUN_BUFFER_SIZE;
+  }
+
+  if (sp->sort) {
+    spill_merge(sp, run_size, func, arg);
+    return;
+  }
+
+  /* unsorted runs simply follow each other */
+  run_cursor_init(&cur, 0, sp->runs[sp->nruns - 1], run_size);
+  while (run_cursor_next(&cur, fileno(sp->file))) {
+    spill_emit(cur.rec, func, arg);
+  }
+  free(cur.buf);
+}
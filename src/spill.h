@@ -0,0 +1,41 @@
+#ifndef __HCC_SPILL_H
+#define __HCC_SPILL_H
+
+#include <stdio.h>
+#include <sys/types.h>
+
+#include "hcc.h"
+
+#define SPILL_INIT_BUFFER_SIZE (64 * 1024)
+#define SPILL_WRITE_BUFFER_SIZE (256 * 1024)
+/* smallest merge buffer per run, must hold the biggest record */
+#define SPILL_MIN_RUN_BUFFER_SIZE (16 * 1024)
+
+/*
+ * Per file results of a verbose run. Records are packed into a buffer of at
+ * most limit bytes, a full buffer is written out as one run of a temporary
+ * file. With sort every run is sorted by path and the runs are merged when
+ * read back, so memory stays bounded however many files are counted.
+ */
+struct spill {
+  size_t limit;                 /* memory budget, 0 for none */
+  boolean sort;
+
+  char *buf;
+  size_t size;
+  size_t used;
+  size_t count;                 /* records in buf */
+
+  FILE *file;                   /* temporary run file, NULL until first spill */
+  off_t *runs;                  /* end offset of each run */
+  int nruns;
+};
+
+typedef void (*spill_record_func) (const char *path, const struct line_counter *counter, void *arg);
+
+void spill_init(struct spill *sp, size_t limit, boolean sort);
+void spill_add(struct spill *sp, const char *path, const struct line_counter *counter);
+/* call func for every record, by path when sorted, in insertion order otherwise */
+void spill_foreach(struct spill *sp, spill_record_func func, void *arg);
+
+#endif
@@ -1,19 +1,20 @@
 #include <stdlib.h>
 
-#include "error.h"
 #include "sq_list.h"
 
-void init_sq_list(struct sq_list *list, int size) {
+int init_sq_list(struct sq_list *list, int size) {
   assert(list && (size > 0));
 
   list->data = malloc(sizeof(void *) * size);
   if (!list->data) {
-    error(EXIT_FAILURE, "Cannot allocate sequence list");
+    return -1;
   }
 
   list->length = size;
   list->next_free = 0;
   list->current = 0;
+
+  return 0;
 }
 
 void *list_current(struct sq_list *list) {
@@ -24,15 +25,19 @@ void *list_current(struct sq_list *list) {
     return NULL;                              
 }
 
-void list_append(struct sq_list *list, void *value) {
+int list_append(struct sq_list *list, void *value) {
   if (list->next_free == list->length) {
     int size = list->length << 1;
+    void **data;
 
-    if (!(list->data = realloc(list->data, sizeof(void *) * size))) {
-      error(EXIT_FAILURE, "Cannot extend sequence list");
+    if (!(data = realloc(list->data, sizeof(void *) * size))) {
+      return -1;
     }
+    list->data = data;
     list->length = size;
   }
 
   list->data[list->next_free++] = value;
+
+  return 0;
 }
@@ -3,7 +3,6 @@
 
 #include <assert.h>
 #include <stdlib.h>
-#include "error.h"
 
 struct sq_list {
   void **data;
@@ -12,7 +11,7 @@ struct sq_list {
   int current;
 };
 
-void init_sq_list(struct sq_list *list, int size);
+int init_sq_list(struct sq_list *list, int size);
 
 #define list_reset(list)                        \
   do {                                          \
@@ -24,7 +23,11 @@ void init_sq_list(struct sq_list *list, int size);
     (list)->current++;                          \
   } while (0)
 
+/* index access does not move the cursor, safe for concurrent readers */
+#define list_size(list) ((list)->next_free)
+#define list_get(list, i) ((list)->data[(i)])
+
 void *list_current(struct sq_list *list);
-void list_append(struct sq_list *list, void *value);
+int list_append(struct sq_list *list, void *value);
 
 #endif
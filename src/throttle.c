@@ -0,0 +1,45 @@
+#define _POSIX_C_SOURCE 200112L /* required by nanosleep */
+
+#include <time.h>
+#include <errno.h>
+
+#include "trace.h"
+#include "throttle.h"
+
+void throttle_init(struct throttle *t, double rate) {
+  pthread_mutex_init(&t->lock, NULL);
+  t->rate = rate;
+  t->tokens = rate;
+  t->last = trace_now();
+}
+
+void throttle_destroy(struct throttle *t) {
+  pthread_mutex_destroy(&t->lock);
+}
+
+void throttle_take(struct throttle *t, double n) {
+  struct timespec ts;
+  long long now, wait = 0;
+
+  pthread_mutex_lock(&t->lock);
+
+  now = trace_now();
+  t->tokens += (now - t->last) * t->rate / 1e9;
+  if (t->tokens > t->rate) {
+    t->tokens = t->rate;
+  }
+  t->last = now;
+
+  t->tokens -= n;
+  if (t->tokens < 0) {
+    wait = -t->tokens / t->rate * 1e9;
+  }
+
+  pthread_mutex_unlock(&t->lock);
+
+  if (wait > 0) {
+    ts.tv_sec = wait / 1000000000LL;
+    ts.tv_nsec = wait % 1000000000LL;
+    while (nanosleep(&ts, &ts) && errno == EINTR);
+  }
+}
@@ -0,0 +1,23 @@
+#ifndef __HCC_THROTTLE_H
+#define __HCC_THROTTLE_H
+
+#include <pthread.h>
+
+/*
+ * Token bucket of rate units a second holding up to a second of them.
+ * Taking more than there are leaves the bucket in debt and sleeps until it
+ * is paid off, so a reader waits for its own read and the ones before it.
+ * Safe to share between threads.
+ */
+struct throttle {
+  pthread_mutex_t lock;
+  double rate;
+  double tokens;
+  long long last;               /* trace_now() of the last refill */
+};
+
+void throttle_init(struct throttle *t, double rate);
+void throttle_destroy(struct throttle *t);
+void throttle_take(struct throttle *t, double n);
+
+#endif
@@ -0,0 +1,152 @@
+#define _GNU_SOURCE             /* required by syscall */
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+#include "trace.h"
+
+long long trace_now() {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+int trace_open(struct trace *t, const char *filename) {
+  memset(t, 0, sizeof(struct trace));
+
+  if (!(t->out = fopen(filename, "w"))) {
+    return -1;
+  }
+
+  pthread_mutex_init(&t->lock, NULL);
+  t->start = trace_now();
+  fputs("{\"traceEvents\":[", t->out);
+
+  return 0;
+}
+
+void trace_close(struct trace *t) {
+  int i;
+
+  fputs("\n]}\n", t->out);
+  fclose(t->out);
+
+  for (i = 0; i < t->ntop; i++) {
+    free(t->top[i].path);
+  }
+
+  pthread_mutex_destroy(&t->lock);
+}
+
+static void trace_json_string(FILE *out, const char *str) {
+  putc('"', out);
+  for (; *str; str++) {
+    unsigned char c = *str;
+
+    if (c == '"' || c == '\\') {
+      putc('\\', out);
+      putc(c, out);
+    } else if (c < 0x20) {
+      fprintf(out, "\\u%04x", c);
+    } else {
+      putc(c, out);
+    }
+  }
+  putc('"', out);
+}
+
+void trace_span(struct trace *t, const char *cat, const char *name, const char *path, long long start, long long end, long long bytes) {
+  long tid = syscall(SYS_gettid);
+
+  pthread_mutex_lock(&t->lock);
+
+  fprintf(t->out, "%s\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"pid\":%d,\"tid\":%ld,\"ts\":%.3f,\"dur\":%.3f,\"args\":{",
+          t->events ? "," : "", name, cat, getpid(), tid, (start - t->start) / 1000.0, (end - start) / 1000.0);
+
+  if (path) {
+    fputs("\"path\":", t->out);
+    trace_json_string(t->out, path);
+  }
+
+  if (bytes >= 0) {
+    fprintf(t->out, "%s\"bytes\":%lld", path ? "," : "", bytes);
+  }
+
+  fputs("}}", t->out);
+  t->events++;
+
+  pthread_mutex_unlock(&t->lock);
+}
+
+static void trace_top_down(struct trace *t, int i) {
+  struct trace_file tmp;
+  int child;
+
+  while ((child = i * 2 + 1) < t->ntop) {
+    if (child + 1 < t->ntop && t->top[child + 1].dur < t->top[child].dur) {
+      child++;
+    }
+    if (t->top[child].dur >= t->top[i].dur) {
+      break;
+    }
+    tmp = t->top[i];
+    t->top[i] = t->top[child];
+    t->top[child] = tmp;
+    i = child;
+  }
+}
+
+void trace_file_time(struct trace *t, const char *path, long long dur) {
+  char *copy;
+  int i, parent;
+
+  pthread_mutex_lock(&t->lock);
+
+  if (t->ntop == TRACE_TOP_FILES && dur <= t->top[0].dur) {
+    pthread_mutex_unlock(&t->lock);
+    return;
+  }
+
+  /* a missing entry only makes the list shorter */
+  if (!(copy = strdup(path))) {
+    pthread_mutex_unlock(&t->lock);
+    return;
+  }
+
+  if (t->ntop == TRACE_TOP_FILES) {
+    free(t->top[0].path);
+    t->top[0].dur = dur;
+    t->top[0].path = copy;
+    trace_top_down(t, 0);
+  } else {
+    for (i = t->ntop++; i > 0 && t->top[parent = (i - 1) / 2].dur > dur; i = parent) {
+      t->top[i] = t->top[parent];
+    }
+    t->top[i].dur = dur;
+    t->top[i].path = copy;
+  }
+
+  pthread_mutex_unlock(&t->lock);
+}
+
+static int compare_trace_file(const void *a, const void *b) {
+  long long da = ((const struct trace_file *) a)->dur, db = ((const struct trace_file *) b)->dur;
+
+  return da < db ? 1 : (da > db ? -1 : 0);
+}
+
+void trace_print_top(struct trace *t, FILE *out) {
+  int i;
+
+  qsort(t->top, t->ntop, sizeof(struct trace_file), compare_trace_file);
+
+  fprintf(out, "Slowest files:\n");
+  for (i = 0; i < t->ntop; i++) {
+    fprintf(out, "%10.3f ms  %s\n", t->top[i].dur / 1000000.0, t->top[i].path);
+  }
+}
@@ -0,0 +1,37 @@
+#ifndef __HCC_TRACE_H
+#define __HCC_TRACE_H
+
+#include <stdio.h>
+#include <pthread.h>
+
+#define TRACE_TOP_FILES 10
+
+struct trace_file {
+  long long dur;
+  char *path;
+};
+
+/*
+ * Chrome trace event writer, events are streamed to the file as complete
+ * ("X") events so memory does not grow with the tree. Safe to share
+ * between threads. Times are in nanoseconds from trace_now().
+ */
+struct trace {
+  pthread_mutex_t lock;
+  FILE *out;
+  long long start;
+  int events;
+  int ntop;
+  struct trace_file top[TRACE_TOP_FILES]; /* min heap on dur */
+};
+
+long long trace_now();
+int trace_open(struct trace *t, const char *filename);
+void trace_close(struct trace *t);
+/* path and bytes are optional, NULL and -1 leave them out */
+void trace_span(struct trace *t, const char *cat, const char *name, const char *path, long long start, long long end, long long bytes);
+/* keep path when it is among the slowest files so far */
+void trace_file_time(struct trace *t, const char *path, long long dur);
+void trace_print_top(struct trace *t, FILE *out);
+
+#endif
@@ -0,0 +1,625 @@
+#define _GNU_SOURCE             /* required by statx */
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <limits.h>
+#include <sys/stat.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <sys/sysmacros.h>
+#include <linux/fs.h>
+#include <linux/fiemap.h>
+
+#include "walk.h"
+
+/*
+ * Directory walker reading entries with getdents64 straight from an
+ * openat() directory fd, so the entry type comes from d_type instead of a
+ * stat per entry. statx is only called when d_type cannot tell us enough.
+ * A directory is read to the end before its subdirectories are entered, so
+ * one dents buffer serves the whole walk, and from WALK_OPEN_DEPTH on its
+ * fd is closed by then, subdirectories are opened by path instead.
+ */
+
+struct linux_dirent64 {
+  ino64_t d_ino;
+  off64_t d_off;
+  unsigned short d_reclen;
+  unsigned char d_type;
+  char d_name[];
+};
+
+/* an entry of an ordered window, name is an offset in the names pool */
+struct walk_sorted {
+  unsigned long long key;       /* physical offset or inode number */
+  ino_t ino;
+  unsigned char type;
+  size_t name;
+};
+
+/* a bounded run of directory entries walked in key order */
+struct walk_window {
+  struct walk_sorted *ents;
+  int count;
+  int size;
+  char *names;
+  size_t names_len;
+  size_t names_size;
+};
+
+struct walk_state {
+  const struct walk_options *opts;
+  unsigned int stat_mask;
+  walk_file_func func;
+  void *arg;
+  dev_t root_dev;
+  struct inode_set *dirs;       /* directories walked, opts->seen or own_dirs */
+  struct inode_set own_dirs;
+  char *dents;                  /* getdents64 buffer */
+  struct walk_window win;       /* files of an ordered walk */
+  int error;                    /* errno of a directory that could not be walked, 0 for none */
+  int path_len;
+  char path[PATH_MAX];
+};
+
+static unsigned int walk_statx_mask(unsigned int stat_mask) {
+  unsigned int mask = STATX_TYPE;
+
+  if (stat_mask & WALK_STAT_SIZE) {
+    mask |= STATX_SIZE;
+  }
+  if (stat_mask & WALK_STAT_INODE) {
+    mask |= STATX_INO;
+  }
+  if (stat_mask & WALK_STAT_NLINK) {
+    mask |= STATX_NLINK;
+  }
+
+  return mask;
+}
+
+/* state->path is the path of name */
+static int walk_statx(struct walk_state *state, int dirfd, const char *name, int flags, unsigned int mask, struct statx *stx) {
+  if (statx(dirfd, name, flags | AT_NO_AUTOMOUNT, mask, stx) == -1) {
+    fprintf(stderr, "Cannot stat file: %s\n", state->path);
+    return -1;
+  }
+
+  return 0;
+}
+
+/*
+ * A directory left out makes the walk fail once it is done, unless it is
+ * only not readable, which nftw told as FTW_DNR and is reported alone.
+ */
+static void walk_dir_failed(struct walk_state *state, const char *what) {
+  fprintf(stderr, "Cannot %s directory: %s\n", what, state->path_len ? state->path : "/");
+  if (errno != EACCES) {
+    state->error = errno;
+  }
+}
+
+static int walk_dir_id(struct walk_dir *dir) {
+  struct stat sb;
+
+  if (!dir->has_id) {
+    if (fstat(dir->fd, &sb) == -1) {
+      return -1;
+    }
+
+    dir->dev = sb.st_dev;
+    dir->ino = sb.st_ino;
+    dir->has_id = 1;
+  }
+
+  return 0;
+}
+
+/*
+ * Return 1 when the directory was walked before, -1 on error. As with
+ * nftw, a directory met again through a symlink, a loop included, is
+ * walked once.
+ */
+static int walk_dir_seen(struct walk_state *state, struct walk_dir *dir) {
+  int ret;
+
+  if (walk_dir_id(dir) == -1 || (ret = inode_set_add(state->dirs, dir->dev, dir->ino)) == -1) {
+    return -1;
+  }
+
+  return !ret;
+}
+
+static struct path_node *walk_dir_node(struct walk_dir *dir) {
+  const char *path = dir->state->path;
+
+  if (!dir->node) {
+    if (dir->parent) {
+      int start = dir->parent->path_len + 1;
+      struct path_node *parent = walk_dir_node(dir->parent);
+
+      if (!parent) {
+        return NULL;
+      }
+
+      dir->node = path_node_new(parent, path + start, dir->path_len - start);
+    } else {
+      dir->node = path_node_new(NULL, path, dir->path_len);
+    }
+  }
+
+  return dir->node;
+}
+
+/*
+ * Shared path node of dir, NULL when out of memory. Nodes outlive the
+ * walk, so callers may keep them.
+ */
+struct path_node *walk_dir_path_node(struct walk_dir *dir) {
+  return walk_dir_node(dir);
+}
+
+struct path_node *walk_entry_dir_node(const struct walk_entry *entry) {
+  return walk_dir_node(entry->dir);
+}
+
+struct walk_fd *walk_dir_fd(struct walk_dir *dir) {
+  struct walk_fd *wfd = dir->shared;
+
+  if (!wfd) {
+    if (!(wfd = malloc(sizeof(struct walk_fd)))) {
+      return NULL;
+    }
+
+    /* the walk holds a reference of its own until it leaves dir */
+    wfd->fd = dir->fd;
+    wfd->refs = 1;
+    pthread_mutex_init(&wfd->lock, NULL);
+    dir->shared = wfd;
+  }
+
+  pthread_mutex_lock(&wfd->lock);
+  wfd->refs++;
+  pthread_mutex_unlock(&wfd->lock);
+
+  return wfd;
+}
+
+void walk_fd_release(struct walk_fd *wfd) {
+  int refs;
+
+  pthread_mutex_lock(&wfd->lock);
+  refs = --wfd->refs;
+  pthread_mutex_unlock(&wfd->lock);
+
+  if (!refs) {
+    close(wfd->fd);
+    pthread_mutex_destroy(&wfd->lock);
+    free(wfd);
+  }
+}
+
+static void walk_dir_close(struct walk_dir *dir) {
+  if (dir->shared) {
+    walk_fd_release(dir->shared);
+  } else if (dir->fd != -1) {
+    close(dir->fd);
+  }
+
+  dir->fd = -1;
+  dir->shared = NULL;
+}
+
+static int walk_dir(struct walk_state *state, struct walk_dir *dir);
+
+/* walk_dir between the caller's hooks */
+static int walk_hooked_dir(struct walk_state *state, struct walk_dir *dir) {
+  const struct walk_options *opts = state->opts;
+  int ret;
+
+  if (opts->dir_enter && opts->dir_enter(dir, state->path, opts->dir_arg)) {
+    return 0;
+  }
+
+  ret = walk_dir(state, dir);
+
+  /* not when the walk was stopped */
+  if (!ret && opts->dir_leave) {
+    opts->dir_leave(dir, opts->dir_arg);
+  }
+
+  return ret;
+}
+
+/* state->path is the path of name, opened by it once dir is closed */
+static int walk_subdir(struct walk_state *state, struct walk_dir *dir, const char *name) {
+  struct walk_dir subdir;
+  int ret;
+
+  if (dir->fd != -1) {
+    subdir.fd = openat(dir->fd, name, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  } else {
+    subdir.fd = open(state->path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  }
+  if (subdir.fd == -1) {
+    walk_dir_failed(state, "open");
+    return 0;
+  }
+
+  subdir.has_id = 0;
+  subdir.depth = dir->depth + 1;
+  subdir.data = NULL;
+  subdir.path_len = state->path_len;
+  subdir.node = NULL;
+  subdir.shared = NULL;
+  subdir.parent = dir;
+  subdir.state = state;
+
+  if ((ret = walk_dir_seen(state, &subdir)) == 1) {
+    ret = 0;
+  } else if (!ret) {
+    ret = walk_hooked_dir(state, &subdir);
+  }
+
+  walk_dir_close(&subdir);
+
+  return ret;
+}
+
+static int walk_window_add(struct walk_window *win, const char *name, unsigned char type, ino_t ino);
+
+/* return non-zero to stop the walk, directories are left in subdirs */
+static int walk_entry(struct walk_state *state, struct walk_dir *dir, const char *name, unsigned char type, ino_t ino,
+                      struct walk_window *subdirs) {
+  const struct walk_options *opts = state->opts;
+  struct walk_entry entry;
+  struct statx stx;
+  int has_stx = 0;
+
+  if (type == DT_DIR && opts->one_file_system) {
+    if (walk_statx(state, dir->fd, name, AT_SYMLINK_NOFOLLOW, STATX_TYPE, &stx) == -1) {
+      return 0;
+    }
+    has_stx = 1;
+  } else if (type == DT_UNKNOWN || type == DT_LNK) {
+    /* follow symlinks the same way stat() did, and ask for the fields the
+     * caller wants on regular files within the same call */
+    if (walk_statx(state, dir->fd, name, 0, walk_statx_mask(state->stat_mask), &stx) == -1) {
+      return 0;
+    }
+    has_stx = 1;
+
+    if (S_ISDIR(stx.stx_mode)) {
+      type = DT_DIR;
+    } else if (S_ISREG(stx.stx_mode)) {
+      type = DT_REG;
+    } else {
+      return 0;
+    }
+  }
+
+  if (type == DT_DIR) {
+    if (opts->one_file_system && makedev(stx.stx_dev_major, stx.stx_dev_minor) != state->root_dev) {
+      return 0;
+    }
+    return walk_window_add(subdirs, name, type, ino);
+  } else if (type == DT_REG) {
+    if (state->stat_mask && !has_stx) {
+      if (walk_statx(state, dir->fd, name, 0, walk_statx_mask(state->stat_mask), &stx) == -1) {
+        return 0;
+      }
+      has_stx = 1;
+    }
+
+    entry.dir = dir;
+    entry.dirfd = dir->fd;
+    entry.name = name;
+    entry.path = state->path;
+    entry.type = type;
+    entry.ino = ino;
+    entry.stat_mask = 0;
+
+    if (has_stx) {
+      entry.stat_mask = state->stat_mask;
+      entry.dev = makedev(stx.stx_dev_major, stx.stx_dev_minor);
+      entry.ino = stx.stx_ino;
+      entry.size = stx.stx_size;
+      entry.nlink = stx.stx_nlink;
+    }
+
+    /* only hard linked files can be met twice outside a seen directory */
+    if (opts->seen && entry.nlink > 1) {
+      int ret = inode_set_add(opts->seen, entry.dev, entry.ino);
+
+      if (ret == -1) {
+        return -1;
+      } else if (!ret) {
+        return 0;
+      }
+    }
+
+    return state->func(&entry, state->arg);
+  }
+
+  return 0;
+}
+
+/*
+ * walk_entry with the entry name appended to the path, or walk_subdir
+ * when subdirs is NULL, for the directories it collected
+ */
+static int walk_named(struct walk_state *state, struct walk_dir *dir, const char *name, unsigned char type, ino_t ino,
+                      struct walk_window *subdirs) {
+  int path_len = state->path_len, name_len, ret;
+
+  name_len = strlen(name);
+  if (path_len + 1 + name_len >= PATH_MAX) {
+    fprintf(stderr, "Too long path, skip: %s/%s\n", state->path, name);
+    return 0;
+  }
+
+  state->path[path_len] = '/';
+  memcpy(state->path + path_len + 1, name, name_len + 1);
+  state->path_len = path_len + 1 + name_len;
+
+  ret = subdirs ? walk_entry(state, dir, name, type, ino, subdirs) : walk_subdir(state, dir, name);
+
+  state->path_len = path_len;
+  state->path[path_len] = '\0';
+
+  return ret;
+}
+
+static int walk_window_add(struct walk_window *win, const char *name, unsigned char type, ino_t ino) {
+  size_t name_len = strlen(name) + 1;
+  struct walk_sorted *ent;
+
+  if (win->count == win->size) {
+    win->size = win->size ? win->size << 1 : WALK_WINDOW_INIT_SIZE;
+    if (!(ent = realloc(win->ents, win->size * sizeof(struct walk_sorted)))) {
+      return -1;
+    }
+    win->ents = ent;
+  }
+
+  if (win->names_len + name_len > win->names_size) {
+    char *names;
+
+    win->names_size = win->names_size ? win->names_size << 1 : WALK_WINDOW_INIT_SIZE * 16;
+    while (win->names_len + name_len > win->names_size) {
+      win->names_size <<= 1;
+    }
+    if (!(names = realloc(win->names, win->names_size))) {
+      return -1;
+    }
+    win->names = names;
+  }
+
+  ent = &win->ents[win->count++];
+  ent->key = ent->ino = ino;
+  ent->type = type;
+  ent->name = win->names_len;
+  memcpy(win->names + win->names_len, name, name_len);
+  win->names_len += name_len;
+
+  return 0;
+}
+
+/* files before directories, then by key and inode */
+static int walk_sorted_cmp(const void *a, const void *b) {
+  const struct walk_sorted *x = (const struct walk_sorted *) a, *y = (const struct walk_sorted *) b;
+
+  if ((x->type == DT_DIR) != (y->type == DT_DIR)) {
+    return x->type == DT_DIR ? 1 : -1;
+  }
+  if (x->key != y->key) {
+    return x->key < y->key ? -1 : 1;
+  }
+
+  return x->ino < y->ino ? -1 : x->ino > y->ino;
+}
+
+/*
+ * Physical offset of the first extent of a regular file, 0 when the file
+ * system has no FIEMAP or the file no extent, e.g. empty or inline.
+ */
+static unsigned long long walk_physical(int dirfd, const char *name) {
+  struct {
+    struct fiemap map;
+    struct fiemap_extent extent;
+  } fm;
+  unsigned long long physical = 0;
+  int fd;
+
+  if ((fd = openat(dirfd, name, O_RDONLY | O_NONBLOCK | O_NOCTTY | O_CLOEXEC)) == -1) {
+    return 0;
+  }
+
+  memset(&fm, 0, sizeof(fm));
+  fm.map.fm_length = FIEMAP_MAX_OFFSET;
+  fm.map.fm_extent_count = 1;
+
+  if (!ioctl(fd, FS_IOC_FIEMAP, &fm.map) && fm.map.fm_mapped_extents) {
+    physical = fm.map.fm_extents[0].fe_physical;
+  }
+  close(fd);
+
+  return physical;
+}
+
+static int walk_window_flush(struct walk_state *state, struct walk_dir *dir, struct walk_window *win, struct walk_window *subdirs) {
+  struct walk_sorted *ent;
+  int i, ret = 0;
+
+  if (state->opts->order == WALK_ORDER_EXTENT) {
+    /* the files are opened in inode order to look their extents up, others go first */
+    qsort(win->ents, win->count, sizeof(struct walk_sorted), walk_sorted_cmp);
+    for (i = 0; i < win->count && win->ents[i].type != DT_DIR; i++) {
+      ent = &win->ents[i];
+      ent->key = ent->type == DT_REG ? walk_physical(dir->fd, win->names + ent->name) : 0;
+    }
+  }
+  qsort(win->ents, win->count, sizeof(struct walk_sorted), walk_sorted_cmp);
+
+  for (i = 0; !ret && i < win->count; i++) {
+    ent = &win->ents[i];
+    ret = walk_named(state, dir, win->names + ent->name, ent->type, ent->ino, subdirs);
+  }
+
+  win->count = 0;
+  win->names_len = 0;
+
+  return ret;
+}
+
+static int walk_dir(struct walk_state *state, struct walk_dir *dir) {
+  struct walk_window *win = &state->win, subdirs;
+  char *buf = state->dents;
+  long nread, pos;
+  int i, ret = 0, ordered = state->opts->order != WALK_ORDER_READDIR;
+  long long start = state->opts->trace ? trace_now() : 0;
+
+  memset(&subdirs, 0, sizeof(struct walk_window));
+
+  while (!ret && (nread = syscall(SYS_getdents64, dir->fd, buf, WALK_DENTS_BUF_SIZE))) {
+    if (nread == -1) {
+      walk_dir_failed(state, "read");
+      break;
+    }
+
+    for (pos = 0; !ret && pos < nread; pos += ((struct linux_dirent64 *) (buf + pos))->d_reclen) {
+      struct linux_dirent64 *dent = (struct linux_dirent64 *) (buf + pos);
+      const char *name = dent->d_name;
+
+      if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) {
+        continue;
+      }
+
+      if (!ordered) {
+        ret = walk_named(state, dir, name, dent->d_type, dent->d_ino, &subdirs);
+      } else if (walk_window_add(win, name, dent->d_type, dent->d_ino)) {
+        ret = -1;
+      } else if (win->count == WALK_WINDOW_SIZE) {
+        ret = walk_window_flush(state, dir, win, &subdirs);
+      }
+    }
+  }
+
+  if (!ret && win->count) {
+    ret = walk_window_flush(state, dir, win, &subdirs);
+  }
+  win->count = 0;
+  win->names_len = 0;
+
+  /* only subdirectories are left to open, the ancestors kept open are bounded */
+  if (dir->depth >= WALK_OPEN_DEPTH) {
+    walk_dir_close(dir);
+  }
+
+  if (ordered) {
+    qsort(subdirs.ents, subdirs.count, sizeof(struct walk_sorted), walk_sorted_cmp);
+  }
+  for (i = 0; !ret && i < subdirs.count; i++) {
+    ret = walk_named(state, dir, subdirs.names + subdirs.ents[i].name, DT_DIR, subdirs.ents[i].ino, NULL);
+  }
+
+  free(subdirs.ents);
+  free(subdirs.names);
+
+  /* sub directories nest inside as their own spans */
+  if (state->opts->trace) {
+    trace_span(state->opts->trace, "walk", "dir", state->path_len ? state->path : "/", start, trace_now(), -1);
+  }
+
+  return ret;
+}
+
+int walk_tree(const char *root, const struct walk_options *opts, walk_file_func func, void *arg) {
+  struct walk_state state;
+  struct walk_dir dir;
+  int len, ret;
+
+  len = strlen(root);
+  if (len >= PATH_MAX) {
+    errno = ENAMETOOLONG;
+    return -1;
+  }
+
+  dir.fd = open(root, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (dir.fd == -1) {
+    return -1;
+  }
+
+  dir.has_id = 0;
+  dir.depth = 0;
+  dir.data = NULL;
+  dir.node = NULL;
+  dir.shared = NULL;
+  dir.parent = NULL;
+  dir.state = &state;
+
+  if (opts->one_file_system) {
+    if (walk_dir_id(&dir) == -1) {
+      close(dir.fd);
+      return -1;
+    }
+    state.root_dev = dir.dev;
+  }
+
+  state.opts = opts;
+  state.stat_mask = opts->stat_mask;
+  state.error = 0;
+  memset(&state.win, 0, sizeof(struct walk_window));
+  if (!(state.dents = malloc(WALK_DENTS_BUF_SIZE))) {
+    walk_dir_close(&dir);
+    return -1;
+  }
+  state.func = func;
+  state.arg = arg;
+
+  if (opts->seen) {
+    state.stat_mask |= WALK_STAT_INODE | WALK_STAT_NLINK;
+    state.dirs = opts->seen;
+  } else {
+    init_inode_set(&state.own_dirs);
+    state.dirs = &state.own_dirs;
+  }
+
+  /* a root walked before, e.g. the same tree through a bind mount */
+  if ((ret = walk_dir_seen(&state, &dir))) {
+    ret = ret == 1 ? 0 : -1;
+    goto out;
+  }
+
+  /* keep the root without trailing slash, entries are joined by '/' */
+  memcpy(state.path, root, len + 1);
+  while (len > 1 && state.path[len - 1] == '/') {
+    state.path[--len] = '\0';
+  }
+  state.path_len = len == 1 && state.path[0] == '/' ? 0 : len;
+  dir.path_len = state.path_len;
+
+  ret = walk_hooked_dir(&state, &dir);
+
+out:
+  if (!opts->seen) {
+    free_inode_set(&state.own_dirs);
+  }
+  walk_dir_close(&dir);
+  free(state.win.ents);
+  free(state.win.names);
+  free(state.dents);
+
+  /* the tree was walked, but not all of it */
+  if (!ret && state.error) {
+    errno = state.error;
+    ret = -1;
+  }
+
+  return ret;
+}
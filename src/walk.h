@@ -0,0 +1,112 @@
+#ifndef __HCC_WALK_H
+#define __HCC_WALK_H
+
+#include <pthread.h>
+#include <sys/types.h>
+
+#include "path.h"
+#include "inode_set.h"
+#include "trace.h"
+
+#define WALK_DENTS_BUF_SIZE (32 * 1024)
+#define WALK_OPEN_DEPTH 10              /* directories kept open while their subdirectories are walked */
+#define WALK_WINDOW_SIZE 65536          /* entries sorted at a time in an ordered walk */
+#define WALK_WINDOW_INIT_SIZE 256
+
+/* order the entries of a directory are visited in */
+enum {
+  WALK_ORDER_READDIR,           /* as getdents returns them */
+  WALK_ORDER_INODE,             /* by inode number, files then directories */
+  WALK_ORDER_EXTENT,            /* by the physical offset of the first extent, FIEMAP */
+};
+
+/* statx mask bits a walk caller may ask for on every regular file */
+#define WALK_STAT_SIZE  0x1
+#define WALK_STAT_INODE 0x2
+#define WALK_STAT_NLINK 0x4
+
+struct walk_state;
+
+/* a directory fd shared with the threads counting its files later */
+struct walk_fd {
+  int fd;
+  int refs;
+  pthread_mutex_t lock;
+};
+
+struct walk_dir {
+  int depth;                    /* 0 for the walk root */
+  void *data;                   /* free for the caller, NULL initially */
+  struct walk_dir *parent;
+
+  /* private */
+  int fd;
+  int has_id;                   /* dev & ino are filled */
+  dev_t dev;
+  ino_t ino;
+  int path_len;                 /* length of the directory path in state->path */
+  struct path_node *node;       /* created on first use */
+  struct walk_fd *shared;       /* fd handed out, closed with its last reference */
+  struct walk_state *state;
+};
+
+struct walk_entry {
+  struct walk_dir *dir;
+  int dirfd;                    /* fd of the directory holding the entry */
+  const char *name;             /* entry name relative to dirfd */
+  const char *path;             /* full path, only valid during callback */
+  unsigned char type;           /* DT_* type of the entry */
+  unsigned int stat_mask;       /* WALK_STAT_* fields filled below */
+  dev_t dev;
+  ino_t ino;
+  off_t size;
+  nlink_t nlink;
+};
+
+struct walk_options {
+  int one_file_system;          /* do not descend into other file systems */
+  unsigned int stat_mask;       /* WALK_STAT_* fields wanted for regular files */
+  /*
+   * A walk enters a directory once even when symlinks lead to it again.
+   * When set, directories and hard linked files already in it are skipped
+   * and the new ones added, so bind mounts and hard links are walked once
+   * across several walks, but not concurrent ones.
+   */
+  struct inode_set *seen;
+  struct trace *trace;          /* a span per directory when set */
+  /*
+   * WALK_ORDER_*, other than readdir the entries are sorted by windows of
+   * WALK_WINDOW_SIZE, so on a disk that seeks the inode table or the data
+   * is read front to back rather than in hash order.
+   */
+  int order;
+  /*
+   * When set, dir_enter is called with the path of every directory before
+   * it is walked, the root included, a non-zero return skips it. dir_leave
+   * follows once each of its entries went through the walk, it is not
+   * called for the directories of a stopped walk.
+   */
+  int (*dir_enter) (struct walk_dir *dir, const char *path, void *arg);
+  void (*dir_leave) (struct walk_dir *dir, void *arg);
+  void *dir_arg;
+};
+
+/* a non-zero return stops the walk and is returned by walk_tree */
+typedef int (*walk_file_func) (const struct walk_entry *entry, void *arg);
+
+struct path_node *walk_dir_path_node(struct walk_dir *dir);
+/*
+ * A reference to the fd of dir that stays open once the walk left it, so
+ * its files can be opened with openat from other threads. Each must be
+ * given back with walk_fd_release. NULL when out of memory.
+ */
+struct walk_fd *walk_dir_fd(struct walk_dir *dir);
+void walk_fd_release(struct walk_fd *wfd);
+struct path_node *walk_entry_dir_node(const struct walk_entry *entry);
+/*
+ * 0 when the whole tree is walked, -1 on error, a directory that could not
+ * be opened or read included, or what func stopped it with
+ */
+int walk_tree(const char *root, const struct walk_options *opts, walk_file_func func, void *arg);
+
+#endif
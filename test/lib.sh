@@ -0,0 +1,23 @@
+# Helpers sourced by the tests, each runs in a scratch directory of its own
+
+TMP=$(mktemp -d)
+trap 'chmod -R u+rwx "$TMP" 2>/dev/null; rm -rf "$TMP"' EXIT
+cd "$TMP" || exit 1
+
+fail() {
+  echo "$*"
+  exit 1
+}
+
+# the csv total row of a run, "total,,,CODE,COMMENT,BLANK[,metrics]"
+total() {
+  "$HCC" --format=csv "$@" 2>/dev/null | grep '^total,'
+}
+
+assert_eq() {
+  [ "$1" = "$2" ] || fail "$3: expected '$2', got '$1'"
+}
+
+assert_same_file() {
+  cmp -s "$1" "$2" || { diff "$1" "$2" | head -20; fail "$3: $1 and $2 differ"; }
+}
@@ -0,0 +1,104 @@
+/*
+ * libhcc from several threads sharing one context, built and run by
+ * t_library.sh with the scratch tree as argument
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+
+#include "libhcc.h"
+
+#define THREADS 4
+#define ROUNDS 2000
+
+static const char source[] = "int main() {\n  return 0; /* done */\n}\n\n// end\n";
+
+static struct hcc_context *ctx;
+
+static int check(const char *what, int status, int want) {
+  if (status != want) {
+    printf("%s: status %d (%s), want %d\n", what, status, hcc_strerror(status), want);
+    return 1;
+  }
+
+  return 0;
+}
+
+static int check_counter(const char *what, const struct line_counter *counter, const char *lang, int code, int comment, int blank) {
+  if (strcmp(counter->lang, lang) || counter->code_lines != code || counter->comment_lines != comment
+      || counter->blank_lines != blank) {
+    printf("%s: %s %d %d %d, want %s %d %d %d\n", what, counter->lang, counter->code_lines, counter->comment_lines,
+           counter->blank_lines, lang, code, comment, blank);
+    return 1;
+  }
+
+  return 0;
+}
+
+static void *count_buffers(void *arg) {
+  struct read_buffers rb;
+  struct line_counter counter;
+  long failed = 0;
+  int i;
+
+  init_read_buffers(&rb, &ctx->read_opts);
+  for (i = 0; i < ROUNDS && !failed; i++) {
+    failed = check("buffer", hcc_count_buffer_rb(ctx, &rb, source, sizeof(source) - 1, "main.c", NULL, &counter), HCC_OK)
+      || check_counter("buffer", &counter, "c", 3, 1, 1);
+  }
+  free_read_buffers(&rb);
+
+  return (void *) failed;
+}
+
+static int count_tree_file(const struct hcc_file *file, void *arg) {
+  int *totals = (int *) arg;
+
+  if (file->status == HCC_OK) {
+    totals[0] += file->counter->code_lines;
+    totals[1] += file->counter->comment_lines;
+    totals[2] += file->counter->blank_lines;
+  }
+
+  return 0;
+}
+
+int main(int argc, char *argv[]) {
+  pthread_t threads[THREADS];
+  struct line_counter counter;
+  int i, failed = 0, totals[3] = { 0 };
+  void *ret;
+
+  if (argc != 2 || hcc_context_new(&ctx) != HCC_OK || hcc_load_default_defs(ctx) != HCC_OK
+      || hcc_add_exclude(ctx, "*.skip.c") != HCC_OK) {
+    puts("cannot set up a context");
+    return 1;
+  }
+
+  for (i = 0; i < THREADS; i++) {
+    pthread_create(&threads[i], NULL, count_buffers, NULL);
+  }
+  for (i = 0; i < THREADS; i++) {
+    pthread_join(threads[i], &ret);
+    failed |= ret != NULL;
+  }
+
+  failed |= check("explicit language", hcc_count_buffer(ctx, source, sizeof(source) - 1, "main", "C", &counter), HCC_OK)
+    || check_counter("explicit language", &counter, "c", 3, 1, 1);
+  failed |= check("unknown language", hcc_count_buffer(ctx, source, sizeof(source) - 1, "main.c", "cobol", &counter), HCC_ERR_LANG);
+  failed |= check("no language", hcc_count_buffer(ctx, source, sizeof(source) - 1, "main.xyz", NULL, &counter), HCC_SKIPPED);
+  failed |= check("excluded", hcc_count_buffer(ctx, source, sizeof(source) - 1, "main.skip.c", NULL, &counter), HCC_EXCLUDED);
+  failed |= check("missing file", hcc_count_file(ctx, AT_FDCWD, "missing.c", -1, "missing.c", &counter), HCC_ERR_OPEN);
+
+  failed |= check("tree", hcc_count_tree(ctx, argv[1], count_tree_file, totals), HCC_OK);
+  if (totals[0] != 6 || totals[1] != 2 || totals[2] != 2) {
+    printf("tree: %d %d %d, want 6 2 2\n", totals[0], totals[1], totals[2]);
+    failed = 1;
+  }
+
+  hcc_context_free(ctx);
+
+  return failed;
+}
@@ -0,0 +1,25 @@
+#!/bin/sh
+# Run the behaviour tests, test/t_*.sh, against out/hcc or the hcc given
+
+dir=$(cd "$(dirname "$0")" && pwd)
+HCC=${1:-$dir/../out/hcc}
+HCC=$(cd "$(dirname "$HCC")" && pwd)/$(basename "$HCC")
+TEST_DIR=$dir
+export HCC TEST_DIR
+
+failed=0
+for t in "$dir"/t_*.sh; do
+  name=$(basename "$t" .sh)
+  if out=$(sh "$t" 2>&1); then
+    echo "PASS $name"
+  else
+    echo "FAIL $name"
+    printf '%s\n' "$out" | sed 's/^/    /'
+    failed=$((failed + 1))
+  fi
+done
+
+if [ $failed -ne 0 ]; then
+  echo "$failed failed"
+  exit 1
+fi
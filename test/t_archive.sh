@@ -0,0 +1,39 @@
+# archives: same counts as the tree, corrupt and hostile archives fail cleanly
+. "$TEST_DIR/lib.sh"
+
+mkdir -p src/sub
+printf 'int main() {\n  return 0; /* done */\n}\n\n// end\n' > src/a.c
+printf '# run\necho 1\n\n' > src/sub/b.sh
+want=$(total src)
+
+tar -cf src.tar src
+tar -czf src.tar.gz src
+zip -qr src.zip src
+for a in src.tar src.tar.gz src.zip; do
+  assert_eq "$(total $a)" "$want" "$a"
+done
+
+# exit status of a run over a corrupt archive, failed but not crashed
+corrupt_status() {
+  "$HCC" "$1" >/dev/null 2>&1
+  status=$?
+  [ $status -ne 0 ] || fail "$1 was counted"
+  [ $status -lt 128 ] || fail "$1 crashed hcc with status $status"
+}
+
+# central directory headers whose name or extra field runs past the directory
+cdh=$(grep -obUaP 'PK\x01\x02' src.zip | head -1 | cut -d: -f1)
+cp src.zip name.zip
+printf '\377\377' | dd of=name.zip bs=1 seek=$((cdh + 28)) conv=notrunc 2>/dev/null
+corrupt_status name.zip
+cp src.zip extra.zip
+printf '\377\377' | dd of=extra.zip bs=1 seek=$((cdh + 30)) conv=notrunc 2>/dev/null
+corrupt_status extra.zip
+
+head -c $(($(wc -c < src.zip) - 30)) src.zip > truncated.zip
+corrupt_status truncated.zip
+
+# a member name too long for a path is skipped, the others are counted
+long=$(printf 'x%.0s' $(seq 5000))
+tar -cf long.tar --transform "s|^src/a.c|$long/a.c|" src
+assert_eq "$(total long.tar)" "total,,,1,1,1" "member name past PATH_MAX"
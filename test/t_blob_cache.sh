@@ -0,0 +1,32 @@
+# blob cache: hits give the counted result, across checkouts, edited files miss
+. "$TEST_DIR/lib.sh"
+
+export GIT_AUTHOR_NAME=test GIT_AUTHOR_EMAIL=test@example.com
+export GIT_COMMITTER_NAME=test GIT_COMMITTER_EMAIL=test@example.com
+git init -q repo || fail "git init failed"
+mkdir repo/src
+printf 'int a;\n/* b */\n\n' > repo/src/a.c
+printf 'echo 1\n# x\n' > repo/src/b.sh
+# the index is trusted only for files older than itself
+sleep 1
+git -C repo add -A && git -C repo commit -q -m init || fail "git commit failed"
+
+want=$(total repo)
+assert_eq "$(total --blob-cache=cache repo)" "$want" "first run"
+[ -n "$(find cache -type f)" ] || fail "nothing stored"
+assert_eq "$(total --blob-cache=cache repo)" "$want" "second run"
+
+# a hit is the stored line, tell it by storing another one
+entry=$(find cache -type f -name '*.c')
+sed -i 's/^c 1 1 1 /c 7 1 1 /' "$entry"
+assert_eq "$(total --blob-cache=cache repo)" "total,,,8,2,1" "hit on the stored line"
+
+# another checkout of the same blobs hits too
+git clone -q repo clone || fail "git clone failed"
+sleep 1
+git -C clone update-index -q --refresh
+assert_eq "$(total --blob-cache=cache clone)" "total,,,8,2,1" "hit from another checkout"
+
+# a file edited since it was staged is counted again
+printf 'int a;\nint c;\n/* b */\n\n' > repo/src/a.c
+assert_eq "$(total --blob-cache=cache repo)" "total,,,3,2,1" "edited file"
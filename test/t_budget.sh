@@ -0,0 +1,24 @@
+# --progress and --time-budget: progress lines and a well formed partial result
+. "$TEST_DIR/lib.sh"
+
+i=0
+while [ $i -lt 200 ]; do
+  [ -d tree/d$((i % 4)) ] || mkdir -p tree/d$((i % 4))
+  printf 'int a;\n' > tree/d$((i % 4))/f$i.c
+  i=$((i + 1))
+done
+
+"$HCC" --progress=1 --file-rate=100 tree 2> progress.txt >/dev/null || fail "run with progress failed"
+grep -q "^hcc: [0-9]* files" progress.txt || fail "no progress lines"
+
+# 50 files a second against a budget of 1 second
+"$HCC" --time-budget=1 --file-rate=50 tree > out.txt 2>/dev/null
+grep -q "^Partial result, the time budget ran out after [0-9]* files$" out.txt || fail "no partial result note"
+
+# the partial marker row has the fields of the header
+for opts in "" "--metrics" "-v --metrics"; do
+  "$HCC" --format=csv --time-budget=1 --file-rate=50 $opts tree > out.csv 2>/dev/null
+  grep -q '^partial,' out.csv || fail "no partial row with '$opts'"
+  fields=$(head -1 out.csv | awk -F, '{ print NF }')
+  assert_eq "$(awk -F, '{ print NF }' out.csv | sort -u)" "$fields" "csv fields with '$opts'"
+done
@@ -0,0 +1,18 @@
+# checkpoint and resume: a run stopped halfway and resumed counts as a fresh one
+. "$TEST_DIR/lib.sh"
+
+i=0
+while [ $i -lt 150 ]; do
+  mkdir -p tree/d$((i % 5))/e$((i % 4))
+  printf 'int a%d;\n/* %d */\n\nint b;\n' $i $i > tree/d$((i % 5))/e$((i % 4))/f$i.c
+  i=$((i + 1))
+done
+fresh=$(total --metrics tree)
+
+# 50 files a second against a budget of 1 second stops the run early
+"$HCC" --metrics --checkpoint=run.ckpt --checkpoint-interval=1 --time-budget=1 --file-rate=50 tree > partial.txt 2>&1
+[ -f run.ckpt ] || fail "no checkpoint kept by the stopped run"
+grep -q "Partial result" partial.txt || fail "the run was not stopped by its budget"
+
+assert_eq "$(total --metrics --checkpoint=run.ckpt --resume tree)" "$fresh" "resumed run"
+[ ! -f run.ckpt ] || fail "checkpoint kept after the run completed"
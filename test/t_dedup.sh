@@ -0,0 +1,13 @@
+# --dedup-inodes: hard linked files are counted once, in a tree and across roots
+. "$TEST_DIR/lib.sh"
+
+mkdir -p tree/a tree/b
+printf 'int a;\n/* b */\n' > tree/a/f.c
+ln tree/a/f.c tree/b/g.c
+ln tree/a/f.c tree/h.c
+printf 'int c;\n' > tree/b/other.c
+
+assert_eq "$(total tree)" "total,,,4,3,0" "without dedup"
+assert_eq "$(total --dedup-inodes tree)" "total,,,2,1,0" "hard links in a tree"
+assert_eq "$(total --dedup-inodes tree tree/a tree/h.c)" "total,,,2,1,0" "the same files as several roots"
+assert_eq "$(total --dedup-inodes -j3 tree tree/b)" "total,,,2,1,0" "with worker threads"
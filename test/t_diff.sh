@@ -0,0 +1,29 @@
+# hcc diff of two saved runs: added, removed and changed files and their deltas
+. "$TEST_DIR/lib.sh"
+
+mkdir v1 v2
+printf 'int a;\n' > v1/a.c
+printf 'int a;\nint b;\n/* c */\n' > v2/a.c
+printf 'echo 1\n# x\n\n' > v1/gone.sh
+printf 'int n;\n' > v2/new.c
+printf 'int same;\n' > v1/same.c
+cp v1/same.c v2/same.c
+
+"$HCC" --save=v1.snap v1 >/dev/null 2>&1 || fail "cannot save v1"
+"$HCC" --save=v2.snap v2 >/dev/null 2>&1 || fail "cannot save v2"
+
+# languages come in no particular order
+"$HCC" diff -v --format=csv v1.snap v2.snap 2>&1 | sort > diff.csv
+sort > want.csv <<'CSV'
+type,name,language,code,comment,blank
+changed,a.c,c,1,1,0
+removed,gone.sh,shell,-1,-1,-1
+added,new.c,c,1,0,0
+language,,c,2,1,0
+language,,shell,-1,-1,-1
+total,,,1,0,-1
+CSV
+assert_same_file diff.csv want.csv "diff of v1 and v2"
+
+# nothing changed, nothing to add up
+assert_eq "$("$HCC" diff --format=csv v1.snap v1.snap | grep '^total,')" "total,,,0,0,0" "diff of a run with itself"
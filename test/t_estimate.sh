@@ -0,0 +1,23 @@
+# --estimate: exact when every file is sampled or all files count alike
+. "$TEST_DIR/lib.sh"
+
+# few files are sampled in full
+mkdir small
+printf 'int a;\n/* b */\n\n' > small/a.c
+printf 'int a;\nint b;\n' > small/b.c
+printf '# x\necho\n' > small/c.sh
+"$HCC" --estimate=5% --format=csv small > est.csv 2>/dev/null || fail "estimate failed"
+assert_eq "$(grep '^total,' est.csv)" "$(total small),0,0,0" "fully sampled tree"
+
+# a sample of files that all count alike scales to the exact totals
+i=0
+while [ $i -lt 2000 ]; do
+  [ -d big/d$((i % 10)) ] || mkdir -p big/d$((i % 10))
+  printf 'int a;\n/* b */\n\n' > big/d$((i % 10))/f$i.c
+  i=$((i + 1))
+done
+"$HCC" --estimate=5% big > est.txt 2>/dev/null || fail "estimate failed"
+grep -q "^Estimated from [0-9]* of 2000 files" est.txt || fail "no sample size reported"
+[ "$(sed -n 's/^Estimated from \([0-9]*\) of.*/\1/p' est.txt)" -lt 2000 ] || fail "every file was sampled"
+"$HCC" --estimate=5% --format=csv big 2>/dev/null | grep '^total,' > est.csv
+assert_eq "$(cat est.csv)" "total,,,2000,2000,2000,0,0,0" "sampled tree of like files"
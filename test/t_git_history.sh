@@ -0,0 +1,59 @@
+# --git-history: the rows of each commit are the totals --git-rev gives for it
+. "$TEST_DIR/lib.sh"
+
+export GIT_AUTHOR_NAME=test GIT_AUTHOR_EMAIL=test@example.com
+export GIT_COMMITTER_NAME=test GIT_COMMITTER_EMAIL=test@example.com
+git init -q repo || fail "git init failed"
+
+commit() {
+  git -C repo add -A && git -C repo commit -q -m "$1" || fail "git commit failed"
+}
+
+# unchanged, changed, added and removed files, and a merge
+i=0
+while [ $i -lt 4 ]; do
+  printf 'int a%d;\n// c\n\n' $i >> repo/a.c
+  printf 'echo %d\n' $i > repo/s$i.sh
+  [ $i -ne 2 ] || rm repo/s0.sh
+  commit "rev $i"
+  i=$((i + 1))
+done
+git -C repo checkout -q -b side HEAD~1
+mkdir repo/side
+printf '# x\nls\n' > repo/side/x.sh
+commit side
+git -C repo checkout -q -
+git -C repo merge -q --no-edit side || fail "git merge failed"
+
+# the language rows of a commit as --git-history prints them
+rev_rows() {
+  "$HCC" --format=csv --git-rev=$1 repo | sed -n "s/^language,,/commit,$1,/p" | sort
+}
+
+# leaves the commits in the order printed in the file commits
+check() {
+  "$HCC" --format=csv "$@" repo > history.csv || fail "--git-history $* failed"
+  grep '^commit,' history.csv | cut -d, -f2 | uniq > commits
+  for c in $(cat commits); do
+    grep "^commit,$c," history.csv | sort > rows
+    rev_rows $c > rev.rows
+    assert_same_file rows rev.rows "commit $c of $*"
+  done
+}
+
+# every commit once, oldest first
+check --git-history=HEAD
+sort commits > got
+git -C repo rev-list HEAD | sort > want
+assert_same_file got want "commits of the whole history"
+assert_eq "$(tail -n 1 commits)" "$(git -C repo rev-parse HEAD)" "last commit"
+
+git -C repo rev-list --reverse --first-parent HEAD~2..HEAD > want
+check --git-history=HEAD~2..HEAD --first-parent
+assert_same_file commits want "first parent commits of a range"
+
+git -C repo repack -q -a -d
+git -C repo prune-packed
+git -C repo rev-list --reverse --first-parent HEAD > want
+check --git-history=HEAD --first-parent
+assert_same_file commits want "first parent commits of a packed repository"
@@ -0,0 +1,41 @@
+# --git-rev: loose and packed objects, deltas included, count as the checkout
+. "$TEST_DIR/lib.sh"
+
+export GIT_AUTHOR_NAME=test GIT_AUTHOR_EMAIL=test@example.com
+export GIT_COMMITTER_NAME=test GIT_COMMITTER_EMAIL=test@example.com
+git init -q repo || fail "git init failed"
+
+# each commit changes a little of big files, so a repack stores deltas
+i=0
+while [ $i -lt 6 ]; do
+  mkdir -p repo/src/m$((i % 2))
+  n=0
+  while [ $n -lt 200 ]; do
+    printf 'int v%d = %d;\n/* rev %d */\n\n' $n $((n * i)) $((n % (i + 1)))
+    n=$((n + 1))
+  done > repo/src/m$((i % 2))/big.c
+  printf '# %d\nprint(%d)\n' $i $i > repo/src/s$i.py
+  git -C repo add -A && git -C repo commit -q -m "rev $i" || fail "git commit failed"
+  i=$((i + 1))
+done
+
+# the revision as a plain tree, to count it the usual way
+checkout() {
+  rm -rf co
+  mkdir co
+  git -C repo archive "$1" | tar -x -C co
+}
+
+for rev in HEAD HEAD~3; do
+  checkout $rev
+  assert_eq "$(total --git-rev=$rev repo)" "$(total co)" "loose objects at $rev"
+done
+
+git -C repo repack -q -a -d -f --depth=50 --window=50
+git -C repo prune-packed
+[ -z "$(find repo/.git/objects -type f -path '*/objects/??/*')" ] || fail "objects left loose"
+
+for rev in HEAD HEAD~3 HEAD~5; do
+  checkout $rev
+  assert_eq "$(total --git-rev=$rev repo)" "$(total co)" "packed objects at $rev"
+done
@@ -0,0 +1,24 @@
+# worker threads: the same results as a serial run, whatever the schedule
+. "$TEST_DIR/lib.sh"
+
+# files of very different sizes, spread over directories
+i=0
+while [ $i -lt 60 ]; do
+  mkdir -p tree/d$((i % 7))/e$((i % 3))
+  f=tree/d$((i % 7))/e$((i % 3))/f$i.c
+  n=0
+  while [ $n -lt $((i * i % 97 + 1)) ]; do
+    printf 'int v%d = %d; /* %d */\n\n// x\n' $n $n $i
+    n=$((n + 1))
+  done > $f
+  i=$((i + 1))
+done
+
+# directory rows come in walk order, so each order has a serial run of its own
+for order in readdir inode; do
+  "$HCC" --format=csv -v --sort --by-dir --walk-order=$order tree > serial.csv 2>&1
+  for opts in "-j4" "-j4 --schedule=walk" "-j3 --lookahead=2"; do
+    "$HCC" --format=csv -v --sort --by-dir --walk-order=$order $opts tree > jobs.csv 2>&1
+    assert_same_file jobs.csv serial.csv "--walk-order=$order $opts"
+  done
+done
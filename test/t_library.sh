@@ -0,0 +1,14 @@
+# libhcc: one context counting from several threads, status codes of failures
+. "$TEST_DIR/lib.sh"
+
+command -v cc >/dev/null 2>&1 || exit 0
+
+root=$TEST_DIR/..
+cc -o libhcc_test -I"$root/src" -I"$root/deps/inih" "$TEST_DIR/libhcc_test.c" "$root/out/libhcc.a" -lz -lpthread -lm \
+  || fail "cannot build libhcc_test"
+
+mkdir -p tree/sub
+printf 'int main() {\n  return 0; /* done */\n}\n\n// end\n' > tree/a.c
+cp tree/a.c tree/sub/b.c
+cp tree/a.c tree/sub/c.skip.c
+./libhcc_test tree || fail "libhcc_test failed"
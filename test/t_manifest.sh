@@ -0,0 +1,17 @@
+# manifest: roots that cannot be counted fail the run, the others are counted
+. "$TEST_DIR/lib.sh"
+
+mkdir r1 r2
+printf 'int a;\n' > r1/a.c
+printf 'int b;\n// x\n\n' > r2/b.c
+mkfifo fifo
+printf '%s\n' "$TMP/r1" "# a comment" "" "$TMP/missing" "$TMP/fifo" "$TMP/r2" > list
+
+"$HCC" --manifest=list --format=csv > out.csv 2>/dev/null && fail "failed roots did not fail the run"
+assert_eq "$(grep '^total,' out.csv)" "total,,,2,1,1" "totals of the roots counted"
+assert_eq "$(grep -c '^root,.*/r[12],c,' out.csv)" "2" "rows of the roots counted"
+
+"$HCC" --manifest=list 2>/dev/null | grep -q "^4 roots, 2 failed$" || fail "failed roots not reported"
+
+printf '%s\n' "$TMP/r1" "$TMP/r2" > good
+"$HCC" --manifest=good >/dev/null 2>&1 || fail "a manifest of good roots failed"
@@ -0,0 +1,20 @@
+# --metrics: bytes, line lengths, trailing spaces and tab indents of crafted files
+. "$TEST_DIR/lib.sh"
+
+mkdir tree
+printf 'int a;  \n\tint b;\n\n// comment\r\nint c;\t\n' > tree/a.c
+# a last line without a line end is measured, but not counted as a line
+printf 'int d;' > tree/b.c
+
+"$HCC" --format=csv -v --sort --metrics tree 2>/dev/null | grep -v '^type,' | sed "s|$TMP/tree/||" > got.csv
+cat > want.csv <<'CSV'
+file,a.c,c,3,1,1,38,10,6.4,2,1
+file,b.c,c,0,0,0,6,6,0.0,0,0
+language,,c,3,1,1,44,10,6.4,2,1
+total,,,3,1,1,44,10,6.4,2,1
+CSV
+assert_same_file got.csv want.csv "metrics"
+
+# the same columns in a table
+"$HCC" --metrics tree 2>/dev/null | head -1 | grep -q "BYTES.*MAX LINE.*AVG LINE.*TRAILING SPACE.*TAB INDENT" \
+  || fail "no metrics columns in the table"
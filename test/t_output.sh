@@ -0,0 +1,46 @@
+# verbose output past the writer buffer: every row whole, in order, csv quoted
+. "$TEST_DIR/lib.sh"
+
+# over 1M of rows, with long paths
+long=dir_with_a_rather_long_name_to_fill_the_output_buffer_with_rows_sooner
+i=0
+while [ $i -lt 60 ]; do
+  mkdir -p tree/$long$i
+  n=0
+  while [ $n -lt 200 ]; do
+    printf 'int a;\n// b\n\n' > tree/$long$i/file_number_$n.c
+    n=$((n + 1))
+  done
+  i=$((i + 1))
+done
+
+for opts in "" "--metrics" "--sort" "--sort --mem-limit=64K" "-j3"; do
+  "$HCC" -v --format=csv $opts tree > rows.csv || fail "csv run failed: $opts"
+  [ $(wc -c < rows.csv) -gt 1048576 ] || fail "output within one buffer: $opts"
+  assert_eq "$(head -n 1 rows.csv | cut -d, -f1-6)" "type,name,language,code,comment,blank" "header first: $opts"
+  assert_eq "$(tail -n 1 rows.csv | cut -d, -f1-6)" "total,,,12000,12000,12000" "total last: $opts"
+  assert_eq "$(grep -c '^file,.*/file_number_[0-9]*\.c,c,1,1,1' rows.csv)" "12000" "file rows: $opts"
+  assert_eq "$(grep -vc '^file,' rows.csv)" "3" "other rows: $opts"
+done
+
+# a slow reader of a pipe takes the same bytes
+"$HCC" -v --format=csv --sort tree > rows.csv
+"$HCC" -v --format=csv --sort tree | (sleep 1; cat) > piped.csv
+assert_same_file piped.csv rows.csv "slow pipe"
+
+"$HCC" -v tree > rows.txt || fail "table run failed"
+assert_eq "$(grep -c '/file_number_[0-9]*\.c$' rows.txt)" "12000" "table file names"
+assert_eq "$(grep -c '^c  *1  *1  *1 *$' rows.txt)" "12000" "table file rows"
+
+# names with commas and quotes are quoted, quotes doubled
+mkdir odd
+printf 'int a;\n' > 'odd/a,b.c'
+printf 'int a;\n' > 'odd/q"x.c'
+printf 'int a;\n' > 'odd/sp ace.c'
+"$HCC" -v --format=csv --sort odd | grep '^file,' > got
+cat > want <<END
+file,"$(pwd)/odd/a,b.c",c,1,0,0
+file,"$(pwd)/odd/q""x.c",c,1,0,0
+file,$(pwd)/odd/sp ace.c,c,1,0,0
+END
+assert_same_file got want "quoted names"
@@ -0,0 +1,18 @@
+# verbose paths: every file under its full path, however deep or oddly named
+. "$TEST_DIR/lib.sh"
+
+mkdir -p "tree/with space/deeper" tree/a/b/c/d/e/f/g/h/i/j/k/l
+for d in tree "tree/with space" "tree/with space/deeper" tree/a/b tree/a/b/c/d/e/f/g/h/i/j/k/l; do
+  printf 'int x;\n' > "$d/f.c"
+  printf 'int y;\n' > "$d/g.h"
+done
+
+find "$TMP/tree" -type f | sort > want.txt
+"$HCC" --format=csv -v tree 2>/dev/null | grep '^file,' | cut -d, -f2 | sort > got.txt
+assert_same_file got.txt want.txt "verbose paths"
+
+# a root given with trailing slashes or through a relative path
+for root in tree/ tree// ./tree "tree/with space/.."; do
+  "$HCC" --format=csv -v "$root" 2>/dev/null | grep '^file,' | cut -d, -f2 | sort > got.txt
+  assert_same_file got.txt want.txt "verbose paths of $root"
+done
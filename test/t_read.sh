@@ -0,0 +1,49 @@
+# read strategies: the same counts whatever the buffers, one read for a small file
+. "$TEST_DIR/lib.sh"
+
+mkdir tree
+i=0
+while [ $i -lt 3000 ]; do
+  printf 'int a%d; /* x */\n/* start\n   middle */ int b;\n\n// line %d\n  \t\n' $i $i
+  i=$((i + 1))
+done > tree/big.c
+printf 'int small;\n' > tree/small.c
+: > tree/empty.c
+
+want=$(total --metrics tree)
+for opts in "--buffer-size=20 --small-file-size=0 --large-file-size=0" "--buffer-size=37 --small-file-size=0" \
+            "--large-file-size=1K --large-buffer-size=21" "--small-file-size=1M"; do
+  assert_eq "$(total --metrics $opts tree)" "$want" "$opts"
+done
+
+# through a pipe short reads are not the end
+assert_eq "$(cat tree/big.c | total --metrics --stdin-name=big.c | cut -d, -f4-)" \
+          "$(total --metrics tree/big.c | cut -d, -f4-)" "stdin pipe"
+
+# a small file is one read() and no read() that only returns 0
+if command -v cc >/dev/null 2>&1; then
+  cat > shim.c <<'C'
+#define _GNU_SOURCE
+#include <dlfcn.h>
+#include <stdio.h>
+#include <unistd.h>
+
+ssize_t read(int fd, void *buf, size_t len) {
+  static ssize_t (*next) (int, void *, size_t);
+  char line[64];
+  ssize_t n;
+
+  if (!next) {
+    next = (ssize_t (*) (int, void *, size_t)) dlsym(RTLD_NEXT, "read");
+  }
+  n = next(fd, buf, len);
+  if (fd > 2) {
+    write(2, line, snprintf(line, sizeof(line), "read %zd\n", n));
+  }
+  return n;
+}
+C
+  cc -shared -fPIC -o shim.so shim.c -ldl || fail "cannot build the read shim"
+  reads=$(LD_PRELOAD=$TMP/shim.so "$HCC" tree/small.c 2>&1 >/dev/null | grep '^read ')
+  assert_eq "$reads" "read 11" "reads of a small file"
+fi
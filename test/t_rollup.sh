@@ -0,0 +1,17 @@
+# --by-dir: each directory total is the count of that directory alone
+. "$TEST_DIR/lib.sh"
+
+mkdir -p tree/a/b/c tree/d tree/empty
+printf 'int a;\n' > tree/x.c
+printf 'int a;\n\n' > tree/a/y.c
+printf 'int a;\n// z\n' > tree/a/b/c/z.c
+printf '# w\necho\n' > tree/d/w.sh
+
+"$HCC" --format=csv --by-dir tree 2>/dev/null | grep '^dir,' > dirs.csv
+assert_eq "$(wc -l < dirs.csv)" "5" "directory rows"
+while IFS=, read -r type name lang counts; do
+  assert_eq "$counts" "$(total "$name" | cut -d, -f4-)" "rollup of $name"
+done < dirs.csv
+
+# depth 1 keeps the root and its own subdirectories
+assert_eq "$("$HCC" --format=csv --by-dir=1 tree 2>/dev/null | grep -c '^dir,')" "3" "rows down to depth 1"
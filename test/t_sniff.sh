@@ -0,0 +1,22 @@
+# extensionless files: the language comes from a shebang or a modeline
+. "$TEST_DIR/lib.sh"
+
+mkdir tree
+printf '#!/bin/sh\necho 1\n' > tree/plain
+printf '#!/usr/bin/env bash\n# c\necho 1\n\n' > tree/env
+printf '// -*- mode: c -*-\nint a;\n' > tree/emacs
+printf 'int a;\n/* vim: set ft=c : */\n' > tree/vim
+printf 'no language here\n' > tree/none
+
+"$HCC" --format=csv -v tree 2>/dev/null | grep '^file,' | sed "s|$TMP/tree/||" | sort > got.csv
+sort > want.csv <<'CSV'
+file,plain,shell,1,1,0
+file,env,shell,1,2,1
+file,emacs,c,1,1,0
+file,vim,c,1,1,0
+CSV
+assert_same_file got.csv want.csv "sniffed languages"
+
+# a name with an extension is not opened to look inside
+printf '#!/bin/sh\necho 1\n' > tree/script.txt
+assert_eq "$(total tree/script.txt)" "total,,,0,0,0" "file with an unknown extension"
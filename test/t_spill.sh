@@ -0,0 +1,25 @@
+# verbose results spilled to disk: merged back in the same order as kept in memory
+. "$TEST_DIR/lib.sh"
+
+# far more results than a 16K run buffer holds
+i=0
+while [ $i -lt 1500 ]; do
+  d=tree/dir_$((i % 13))/sub_$((i % 7))
+  [ -d $d ] || mkdir -p $d
+  printf 'int a;\n/* %d */\n' $i > $d/some_longer_file_name_$i.c
+  i=$((i + 1))
+done
+
+mkdir tmp
+export TMPDIR=$TMP/tmp
+
+"$HCC" --format=csv -v --sort tree > memory.csv 2>&1
+"$HCC" --format=csv -v --sort --mem-limit=16K tree > spilled.csv 2>&1
+assert_same_file spilled.csv memory.csv "sorted results"
+
+# unsorted, the rows are the same once sorted
+"$HCC" --format=csv -v tree 2>&1 | sort > memory.csv
+"$HCC" --format=csv -v --mem-limit=16K tree 2>&1 | sort > spilled.csv
+assert_same_file spilled.csv memory.csv "unsorted results"
+
+[ -z "$(ls tmp)" ] || fail "spill files left in TMPDIR"
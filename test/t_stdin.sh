@@ -0,0 +1,26 @@
+# --stdin: a pipe or a redirected file counts as the same file would
+. "$TEST_DIR/lib.sh"
+
+printf 'int a; // x\n/* c */\n\nint b;\n' > a.c
+want=$(total a.c)
+assert_eq "$(cat a.c | total --stdin-name=a.c)" "$want" "pipe named by --stdin-name"
+assert_eq "$(cat a.c | total --stdin --lang=c)" "$want" "pipe with --lang"
+assert_eq "$(total --stdin-name=a.c < a.c)" "$want" "redirected file"
+"$HCC" -v --format=csv --stdin-name=x/a.c < a.c | grep -q '^file,x/a\.c,c,2,1,1$' || fail "stdin not reported by its name"
+
+# a pipe larger than the read buffers comes in many reads
+i=0
+while [ $i -lt 5000 ]; do
+  printf 'int a%d; /* x */\n// y\n\n' $i
+  i=$((i + 1))
+done > big.c
+assert_eq "$(cat big.c | total --buffer-size=4K --stdin-name=big.c)" "$(total big.c)" "large pipe"
+
+# stdin adds to the files given
+assert_eq "$(cat a.c | total --stdin-name=a.c a.c)" "total,,,4,2,2" "stdin and a file"
+
+# the language is guessed from a shebang
+assert_eq "$(printf '#!/bin/sh\n# c\necho\n' | total --stdin)" "total,,,1,2,0" "guessed language"
+
+! echo x | "$HCC" --stdin --lang=nope > /dev/null 2>&1 || fail "unknown language accepted"
+! echo x | "$HCC" --stdin > /dev/null 2>&1 || fail "stdin without a language counted"
@@ -0,0 +1,33 @@
+# --io-rate, --file-rate and --nice-io: slower, but the same counts
+. "$TEST_DIR/lib.sh"
+
+mkdir tree
+i=0
+while [ $i -lt 60 ]; do
+  printf 'int a;\n// b\n\n' > tree/f$i.c
+  i=$((i + 1))
+done
+want=$(total tree)
+assert_eq "$want" "total,,,60,60,60" "unthrottled run"
+
+# a second of tokens comes up front, the rest is paced, 2s or more here
+secs() {
+  start=$(date +%s)
+  got=$(total "$@" tree)
+  elapsed=$(($(date +%s) - start))
+}
+
+secs --file-rate=20 -j2
+assert_eq "$got" "$want" "--file-rate"
+[ $elapsed -ge 1 ] || fail "--file-rate did not slow the run down"
+
+# 60 files of 14 bytes at 250 bytes a second
+secs --io-rate=250
+assert_eq "$got" "$want" "--io-rate"
+[ $elapsed -ge 1 ] || fail "--io-rate did not slow the run down"
+
+assert_eq "$(total --nice-io tree)" "$want" "--nice-io"
+assert_eq "$(total -j auto tree)" "$want" "-j auto"
+
+! "$HCC" --io-rate=0 tree > /dev/null 2>&1 || fail "zero --io-rate accepted"
+! "$HCC" --file-rate=x tree > /dev/null 2>&1 || fail "invalid --file-rate accepted"
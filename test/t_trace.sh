@@ -0,0 +1,21 @@
+# --trace: a valid Chrome trace with a file span for every counted file
+. "$TEST_DIR/lib.sh"
+
+mkdir -p tree/sub
+printf 'int a;\n' > tree/a.c
+printf 'int b;\n' > tree/sub/b.c
+printf 'x\n' > tree/notes.txt
+
+for jobs in 1 3; do
+  "$HCC" -j$jobs --trace=trace.json tree > out.txt 2>&1 || fail "traced run failed"
+  grep -q "^Slowest files:" out.txt || fail "no slowest files listed"
+  head -1 trace.json | grep -q '^{"traceEvents":\[$' || fail "not a trace file"
+  tail -1 trace.json | grep -q '^\]}$' || fail "trace file not closed"
+  if command -v python3 >/dev/null 2>&1; then
+    python3 -m json.tool trace.json >/dev/null || fail "trace file is not JSON"
+  fi
+  for f in a.c sub/b.c; do
+    grep -q '"name":"file","cat":"file".*"path":"'"$TMP/tree/$f"'"' trace.json || fail "no span of $f with -j$jobs"
+  done
+  assert_eq "$(grep -c '"name":"file","cat":"file"' trace.json)" "2" "file spans with -j$jobs"
+done
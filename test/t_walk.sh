@@ -0,0 +1,29 @@
+# walker: deep trees within the fd limit, directories reached twice, skipped subtrees
+. "$TEST_DIR/lib.sh"
+
+# a file on each of 200 levels, far more than the fds allowed
+mkdir deep
+d=deep
+i=0
+while [ $i -lt 200 ]; do
+  d=$d/d
+  mkdir $d
+  echo 'int x;' > $d/f.c
+  i=$((i + 1))
+done
+out=$(ulimit -n 32; total deep) || fail "deep tree walk failed"
+assert_eq "$out" "total,,,200,0,0" "deep tree"
+
+# symlinks back to an ancestor or to a sibling do not count a directory twice
+mkdir -p links/src
+printf 'int a;\n/* b */\n' > links/src/a.c
+ln -s .. links/src/up
+ln -s src links/alias
+assert_eq "$(total links)" "total,,,1,1,0" "symlinked directories"
+
+# a subtree left out for lack of fds fails the run
+mkdir -p shallow/$(printf 'd/%.0s' $(seq 30))
+echo 'int x;' > shallow/top.c
+if (ulimit -n 10; "$HCC" shallow >/dev/null 2>&1); then
+  fail "a skipped subtree did not fail the run"
+fi
@@ -0,0 +1,28 @@
+# --walk-order: inode and extent orders visit the same files as readdir
+. "$TEST_DIR/lib.sh"
+
+mkdir -p tree/a/b
+i=0
+while [ $i -lt 50 ]; do
+  printf 'int a;\n// b\n' > tree/f$i.c
+  printf '# x\n\necho\n' > tree/a/s$i.sh
+  i=$((i + 1))
+done
+printf '/* z */\n' > tree/a/b/z.c
+"$HCC" -v --format=csv --sort tree > readdir.csv || fail "readdir order failed"
+
+for order in inode extent; do
+  "$HCC" -v --format=csv --sort --walk-order=$order tree > $order.csv || fail "$order order failed"
+  assert_same_file $order.csv readdir.csv "--walk-order=$order"
+  assert_eq "$(total -j3 --walk-order=$order tree)" "$(total tree)" "$order order with worker threads"
+done
+
+# in inode order the files of a directory come by inode, before its subdirectories
+"$HCC" -v --format=csv --walk-order=inode --schedule=walk tree | grep '^file,' | cut -d, -f2 > visited
+for f in $(cat visited); do
+  echo "$(dirname "$f") $(stat -c %i "$f")"
+done > got
+sort -k1,1 -k2,2n got > want
+assert_same_file got want "files by inode, a directory before its subdirectories"
+
+! "$HCC" --walk-order=bad tree > /dev/null 2>&1 || fail "unknown walk order accepted"
@@ -0,0 +1,16 @@
+# UTF-16 and UTF-32: the counts and metrics of the same source in UTF-8
+. "$TEST_DIR/lib.sh"
+
+mkdir utf8 utf16le utf16be utf32
+printf '/*\n * note\n */\nint main() {\n\treturn 0; \n}\n\n// end\n' > utf8/a.c
+iconv -f UTF-8 -t UTF-16 utf8/a.c > utf16le/a.c
+{ printf '\376\377'; iconv -f UTF-8 -t UTF-16BE utf8/a.c; } > utf16be/a.c
+iconv -f UTF-8 -t UTF-32 utf8/a.c > utf32/a.c
+
+# all but the bytes column
+want=$(total --metrics utf8 | cut -d, -f1-6,8-)
+assert_eq "$want" "total,,,3,4,1,12,5.2,1,1" "UTF-8 metrics"
+
+for d in utf16le utf16be utf32; do
+  assert_eq "$(total --metrics $d | cut -d, -f1-6,8-)" "$want" "$d"
+done